@@ -17,13 +17,33 @@ QML_IMPORT_PATH =
 SOURCES += main.cpp \
     programmer.cpp \
     util.cpp \
+    utilhex.cpp \
     settings.cpp \
     serial.cpp \
-    terminal.cpp
+    terminal.cpp \
+    hexformatter.cpp \
+    log.cpp \
+    serialcapture.cpp \
+    capturesink.cpp \
+    triggerengine.cpp \
+    framedecoder.cpp \
+    framemodel.cpp \
+    telemetry.cpp \
+    transmitqueue.cpp \
+    testscript.cpp \
+    multiterminal.cpp \
+    scrollbackindex.cpp \
+    portdiscovery.cpp \
+    portmonitor.cpp \
+    productionline.cpp \
+    verifyprobe.cpp
 
 # Installation path
 # target.path =
 
+# Hex images, the bootloader protocol and asynchronous flashing
+include(core.pri)
+
 # Please do not modify the following two lines. Required for deployment.
 include(qtquick2applicationviewer/qtquick2applicationviewer.pri)
 qtcAddDeployment()
@@ -33,6 +53,36 @@ HEADERS += \
     util.h \
     settings.h \
     serial.h \
-    terminal.h
+    terminal.h \
+    hexformatter.h \
+    log.h \
+    ringbuffer.h \
+    boundedqueue.h \
+    serialcapture.h \
+    capturesink.h \
+    triggerengine.h \
+    framedecoder.h \
+    framemodel.h \
+    telemetry.h \
+    transmitqueue.h \
+    testscript.h \
+    multiterminal.h \
+    scrollbackindex.h \
+    portdiscovery.h \
+    portmonitor.h \
+    productionline.h \
+    verifyprobe.h
+
+# Compressed terminal captures
+unix {
+    LIBS += -lz
+    DEFINES += SCREAMER_HAVE_ZLIB
+}
+
+# Hotplug notifications for the port list
+linux {
+    LIBS += -ludev
+    DEFINES += SCREAMER_HAVE_UDEV
+}
 
 OTHER_FILES +=
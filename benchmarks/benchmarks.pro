@@ -0,0 +1,29 @@
+# Throughput benchmarks for Screamer's stream processing, hex parsing, block
+# encoding and hex formatting.
+# Build and run in release mode: qmake && make && ./screamer-bench [triggers|hex|blocks|format]
+# Allocations per operation are counted on glibc only.
+
+QT += core serialport
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = screamer-bench
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+# Only the hex helpers from Util, not the rest of it, so none of Settings,
+# the serial port code or udev is linked into the measurements.
+SOURCES += main.cpp \
+    ../triggerengine.cpp \
+    ../utilhex.cpp \
+    ../hexformatter.cpp
+
+HEADERS += \
+    ../triggerengine.h \
+    ../util.h \
+    ../hexformatter.h
+
+include(../core.pri)
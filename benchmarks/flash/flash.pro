@@ -0,0 +1,27 @@
+# End-to-end flashing benchmark: the core's Flasher, which the app's
+# programmer runs its jobs through, against the simulated board from
+# screamer-sim, over a pty. Unix only.
+# Build and run in release mode: qmake && make && ./screamer-flash-bench
+# Runs are compared with baseline.json next to this file when it exists;
+# --record rewrites it from a known good release build, to be committed.
+
+QT += core
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = screamer-flash-bench
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+DEFINES += BASELINE_FILE=\\\"$$PWD/baseline.json\\\"
+
+SOURCES += main.cpp \
+    ../../bootsimulator.cpp
+
+HEADERS += \
+    ../../bootsimulator.h
+
+include(../../core.pri)
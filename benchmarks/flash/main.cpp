@@ -0,0 +1,462 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QFile>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QSerialPort>
+#include <sys/utsname.h>
+
+#include "flasher.h"
+#include "bootsimulator.h"
+#include "trace.h"
+
+// A serial byte is 10 bits on the wire (start + 8 data + stop).
+#define BITS_PER_BYTE 10
+#define MEMORY_SIZE 32768
+// A run that takes longer than this is cancelled and counted as failed, ms.
+#define RUN_TIMEOUT 300000
+// A run this much slower than the baseline is a regression.
+#define REGRESSION_THRESHOLD 0.10
+
+// Exit codes
+#define EXIT_OK 0
+#define EXIT_REGRESSED 1
+#define EXIT_USAGE 2
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+class SimulatorThread : public QThread
+{
+public:
+    explicit SimulatorThread(BootSimulator *simulator) : m_simulator(simulator) {}
+
+protected:
+    void run() { m_simulator->run(); }
+
+private:
+    BootSimulator *m_simulator;
+};
+
+// Times the phases of one job. Called on the flasher's thread, read once
+// the flasher is done.
+class RunListener : public Flasher::Listener
+{
+public:
+    RunListener() : connectedAt(-1), finishedAt(-1), resends(0), transmittedBytes(0), success(false) {}
+
+    void stateChanged(Bootloader::State state, const QString &)
+    {
+        if (state == Bootloader::Connected && connectedAt < 0)
+            connectedAt = clock.nsecsElapsed();
+    }
+    void blockResent(int) { ++resends; }
+    void transmitted(const char *, int length) { transmittedBytes += length; }
+    void finished(int, bool ok, const QString &text)
+    {
+        finishedAt = clock.nsecsElapsed();
+        success = ok;
+        error = text;
+    }
+
+    QElapsedTimer clock;
+    qint64 connectedAt;
+    qint64 finishedAt;
+    int resends;
+    qint64 transmittedBytes;
+    bool success;
+    QString error;
+};
+
+struct Config
+{
+    int size;
+    int pageSize;
+    int baudRate;
+    qreal latency;
+    double errorRate;
+
+    QString key() const
+    {
+        return QString("size=%1 page=%2 baud=%3 latency=%4 errors=%5")
+                .arg(size).arg(pageSize).arg(baudRate).arg(latency).arg(errorRate);
+    }
+};
+
+static quint32 s_random = 12345;
+
+static quint32 nextRandom()
+{
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+    return s_random;
+}
+
+// Intel HEX, 16 data bytes per record, the way avr-objcopy writes it.
+static QByteArray toIntelHex(const QByteArray &data)
+{
+    QByteArray hex;
+    for (int address = 0; address < data.size(); address += 16) {
+        const int length = qMin(16, data.size() - address);
+        QByteArray record;
+        record.append((char)length);
+        record.append((char)(address >> 8));
+        record.append((char)address);
+        record.append((char)0);
+        record.append(data.mid(address, length));
+
+        unsigned int sum = 0;
+        for (int i = 0; i < record.size(); ++i)
+            sum += (unsigned char)record[i];
+        record.append((char)(0x100 - (sum & 0xFF)));
+
+        hex.append(':');
+        hex.append(record.toHex().toUpper());
+        hex.append("\r\n");
+    }
+    hex.append(":00000001FF\r\n");
+    return hex;
+}
+
+static QVariantMap runOne(Flasher *flasher, const Config &config)
+{
+    QVariantMap result;
+    result["size"] = config.size;
+    result["pageSize"] = config.pageSize;
+    result["baudRate"] = config.baudRate;
+    result["latency"] = config.latency;
+    result["errorRate"] = config.errorRate;
+
+    QByteArray image(config.size, 0);
+    for (int i = 0; i < image.size(); ++i)
+        image[i] = (char)nextRandom();
+
+    QTemporaryFile hexFile(QDir::tempPath() + "/screamer-bench-XXXXXX.hex");
+    if (!hexFile.open() || hexFile.write(toIntelHex(image)) < 0 || !hexFile.flush()) {
+        result["error"] = "Unable to write the hex file";
+        return result;
+    }
+
+    BootSimulator::Options options;
+    options.pageSize = config.pageSize;
+    options.memorySize = MEMORY_SIZE;
+    options.baudRate = config.baudRate;
+    options.latency = config.latency;
+    options.bitErrorRate = config.errorRate;
+    BootSimulator simulator(options);
+    if (!simulator.open()) {
+        result["error"] = simulator.errorString();
+        return result;
+    }
+    SimulatorThread thread(&simulator);
+    thread.start();
+
+    FlashJob job;
+    job.portName = simulator.slaveName();
+    job.baudRate = config.baudRate;
+    job.hexFile = hexFile.fileName();
+    job.memorySize = MEMORY_SIZE;
+    job.pageSize = config.pageSize;
+    // Modem lines don't cross a pty.
+    job.resetType = Bootloader::Software;
+    job.resetProfile.settle = 0;
+    job.logTraffic = false;
+
+    // Opened here and handed over, the way the app's Worker passes the port
+    // it shares with the terminal, so the run goes the app's way through
+    // the flasher.
+    QSerialPort port(job.portName);
+    if (!port.open(QIODevice::ReadWrite)) {
+        result["error"] = port.errorString();
+        simulator.stop();
+        thread.wait();
+        return result;
+    }
+    port.setBaudRate(job.baudRate);
+    port.setDataBits(QSerialPort::Data8);
+    port.setParity(QSerialPort::NoParity);
+    port.setStopBits(QSerialPort::OneStop);
+    port.setFlowControl(QSerialPort::NoFlowControl);
+
+    RunListener listener;
+    listener.clock.start();
+    const int id = flasher->submit(job, &listener, &port);
+    if (!flasher->waitForDone(RUN_TIMEOUT)) {
+        flasher->cancel(id);
+        flasher->waitForDone();
+        listener.error = "Timed out";
+    }
+
+    simulator.stop();
+    thread.wait();
+
+    const BootSimulator::Stats stats = simulator.stats();
+    const double wall = listener.finishedAt / 1e9;
+    const double send = (listener.finishedAt - qMax(Q_INT64_C(0), listener.connectedAt)) / 1e9;
+
+    result["success"] = listener.success;
+    result["verified"] = listener.success && simulator.flash().left(image.size()) == image;
+    result["wallMs"] = wall * 1000;
+    result["sendMs"] = send * 1000;
+    result["bytesPerSecond"] = wall > 0 ? image.size() / wall : 0;
+    // How much of the line's capacity the host kept busy while sending.
+    result["linkUtilization"] = send > 0 && config.baudRate > 0
+            ? listener.transmittedBytes * BITS_PER_BYTE / double(config.baudRate) / send : 0;
+    result["resends"] = listener.resends;
+    result["targetFailures"] = stats.failures;
+    result["bitsFlipped"] = stats.bitsFlipped;
+    if (!listener.error.isEmpty())
+        result["error"] = listener.error;
+    return result;
+}
+
+// What the numbers were measured on, so results from another machine or
+// build aren't taken for a regression.
+static QVariantMap machine()
+{
+    QVariantMap map;
+    struct utsname name;
+    if (uname(&name) == 0) {
+        map["host"] = QString::fromLocal8Bit(name.nodename);
+        map["system"] = QString("%1 %2 %3").arg(name.sysname).arg(name.release).arg(name.machine);
+    }
+    QFile cpuinfo("/proc/cpuinfo");
+    if (cpuinfo.open(QIODevice::ReadOnly)) {
+        foreach (const QByteArray &line, cpuinfo.readAll().split('\n')) {
+            if (line.startsWith("model name")) {
+                map["cpu"] = QString::fromLatin1(line.mid(line.indexOf(':') + 1).trimmed());
+                break;
+            }
+        }
+    }
+    map["cores"] = QThread::idealThreadCount();
+    map["qt"] = QString(qVersion());
+#ifdef __VERSION__
+    map["compiler"] = QString(__VERSION__);
+#endif
+#ifdef QT_NO_DEBUG
+    map["build"] = QString("release");
+#else
+    map["build"] = QString("debug");
+#endif
+    return map;
+}
+
+static bool parseList(const QString &value, QList<double> *list)
+{
+    list->clear();
+    foreach (const QString &item, value.split(',', QString::SkipEmptyParts)) {
+        bool ok;
+        list->append(item.toDouble(&ok));
+        if (!ok) return false;
+    }
+    return !list->isEmpty();
+}
+
+static void usage(QTextStream &stream)
+{
+    stream << "Usage: screamer-flash-bench [options]\n"
+           << "\n"
+           << "Flashes generated images into screamer-sim's simulated board over a pty,\n"
+           << "for every combination of the lists below, and writes the results as JSON.\n"
+           << "\n"
+           << "  --sizes LIST        Image sizes in bytes (default 4096,16384,30720)\n"
+           << "  --pages LIST        Page sizes (default 128,256)\n"
+           << "  --bauds LIST        Baud rates (default 57600,115200)\n"
+           << "  --latencies LIST    Target reply latency in ms (default 0,5)\n"
+           << "  --errors LIST       Bit error rates (default 0,0.00001)\n"
+           << "  --quick             One of each, 4096 bytes at 115200 baud\n"
+           << "  --out FILE          Write the JSON here instead of stdout\n"
+           << "  --trace FILE        Write a timeline of every run to FILE, as Chrome\n"
+           << "                      trace JSON for Perfetto or chrome://tracing\n"
+           << "  --baseline FILE     Compare with an earlier run; exits with 1 if any\n"
+           << "                      configuration got more than 10% slower. Defaults to\n"
+           << "                      " BASELINE_FILE " when it exists\n"
+           << "  --no-baseline       Don't compare with anything\n"
+           << "  --record            Write the results to " BASELINE_FILE "\n"
+           << "                      instead of comparing with it\n"
+           << "  -h, --help          Show this help\n";
+    stream.flush();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QList<double> sizes, pages, bauds, latencies, errors;
+    sizes << 4096 << 16384 << 30720;
+    pages << 128 << 256;
+    bauds << 57600 << 115200;
+    latencies << 0 << 5;
+    errors << 0 << 0.00001;
+    QString outPath;
+    QString baselinePath;
+    bool useBaseline = true;
+    bool record = false;
+    QString tracePath;
+
+    QStringList args = app.arguments().mid(1);
+    while (!args.isEmpty()) {
+        const QString arg = args.takeFirst();
+        const bool hasValue = !args.isEmpty();
+        bool ok = true;
+
+        if (arg == "-h" || arg == "--help") {
+            usage(out);
+            return EXIT_OK;
+        } else if (arg == "--quick") {
+            sizes = QList<double>() << 4096;
+            pages = QList<double>() << 128;
+            bauds = QList<double>() << 115200;
+            latencies = QList<double>() << 0;
+            errors = QList<double>() << 0;
+        } else if (arg == "--sizes" && hasValue) {
+            ok = parseList(args.takeFirst(), &sizes);
+        } else if (arg == "--pages" && hasValue) {
+            ok = parseList(args.takeFirst(), &pages);
+        } else if (arg == "--bauds" && hasValue) {
+            ok = parseList(args.takeFirst(), &bauds);
+        } else if (arg == "--latencies" && hasValue) {
+            ok = parseList(args.takeFirst(), &latencies);
+        } else if (arg == "--errors" && hasValue) {
+            ok = parseList(args.takeFirst(), &errors);
+        } else if (arg == "--out" && hasValue) {
+            outPath = args.takeFirst();
+        } else if (arg == "--baseline" && hasValue) {
+            baselinePath = args.takeFirst();
+        } else if (arg == "--no-baseline") {
+            useBaseline = false;
+        } else if (arg == "--record") {
+            record = true;
+        } else if (arg == "--trace" && hasValue) {
+            tracePath = args.takeFirst();
+        } else {
+            err << "Unexpected argument: " << arg << "\n";
+            usage(err);
+            return EXIT_USAGE;
+        }
+        if (!ok) {
+            err << "Bad list for " << arg << "\n";
+            return EXIT_USAGE;
+        }
+    }
+
+    if (record) {
+        outPath = BASELINE_FILE;
+        useBaseline = false;
+    } else if (baselinePath.isEmpty() && useBaseline) {
+        if (QFile::exists(BASELINE_FILE))
+            baselinePath = BASELINE_FILE;
+        else
+            err << "No baseline at " << BASELINE_FILE << "; --record makes one\n";
+    }
+
+    QVariantMap baseline;
+    if (useBaseline && !baselinePath.isEmpty()) {
+        QFile file(baselinePath);
+        if (!file.open(QIODevice::ReadOnly)) {
+            err << "Unable to read " << baselinePath << "\n";
+            return EXIT_USAGE;
+        }
+        const QVariantMap recorded = QJsonDocument::fromJson(file.readAll()).object().toVariantMap();
+        const QVariantMap recordedOn = recorded.value("machine").toMap();
+        const QVariantMap here = machine();
+        if (recordedOn.value("host") != here.value("host") || recordedOn.value("cpu") != here.value("cpu")
+                || recordedOn.value("build") != here.value("build"))
+            err << "Warning: " << baselinePath << " was recorded on another machine or build\n";
+        foreach (const QVariant &run, recorded.value("runs").toList()) {
+            const QVariantMap map = run.toMap();
+            Config config;
+            config.size = map.value("size").toInt();
+            config.pageSize = map.value("pageSize").toInt();
+            config.baudRate = map.value("baudRate").toInt();
+            config.latency = map.value("latency").toReal();
+            config.errorRate = map.value("errorRate").toDouble();
+            baseline[config.key()] = map.value("bytesPerSecond");
+        }
+    }
+
+    Trace::setEnabled(!tracePath.isEmpty());
+
+    Flasher flasher;
+    QVariantList runs;
+    bool regressed = false;
+    bool failed = false;
+
+    foreach (double size, sizes)
+    foreach (double page, pages)
+    foreach (double baud, bauds)
+    foreach (double latency, latencies)
+    foreach (double errorRate, errors) {
+        Config config;
+        config.size = int(size);
+        config.pageSize = int(page);
+        config.baudRate = int(baud);
+        config.latency = latency;
+        config.errorRate = errorRate;
+
+        QVariantMap result = runOne(&flasher, config);
+        const double rate = result.value("bytesPerSecond").toDouble();
+
+        err << config.key().leftJustified(56)
+            << QString::number(result.value("wallMs").toDouble(), 'f', 0).rightJustified(8) << " ms"
+            << QString::number(rate, 'f', 0).rightJustified(8) << " B/s"
+            << QString::number(result.value("linkUtilization").toDouble() * 100, 'f', 1).rightJustified(7) << "% link"
+            << QString::number(result.value("resends").toInt()).rightJustified(5) << " resends";
+        if (!result.value("verified").toBool()) {
+            err << "  FAILED " << result.value("error").toString();
+            failed = true;
+        }
+
+        if (baseline.contains(config.key())) {
+            const double before = baseline.value(config.key()).toDouble();
+            result["baselineBytesPerSecond"] = before;
+            if (before > 0 && rate < before * (1 - REGRESSION_THRESHOLD)) {
+                err << "  REGRESSED from " << QString::number(before, 'f', 0) << " B/s";
+                regressed = true;
+            }
+        }
+        err << "\n";
+        err.flush();
+
+        runs << result;
+    }
+
+    QVariantMap report;
+    report["benchmark"] = "flash";
+    report["machine"] = machine();
+    report["runs"] = runs;
+    const QByteArray json = QJsonDocument(QJsonObject::fromVariantMap(report)).toJson();
+
+    // A baseline with failed runs in it would hide the next real failure.
+    if (record && failed) {
+        err << "Not recording a baseline with failed runs\n";
+        return EXIT_USAGE;
+    }
+
+    if (outPath.isEmpty()) {
+        out << json;
+        out.flush();
+    } else {
+        QFile file(outPath);
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            err << "Unable to write " << outPath << "\n";
+            return EXIT_USAGE;
+        }
+    }
+
+    QString error;
+    if (!tracePath.isEmpty() && !Trace::save(tracePath, &error)) {
+        err << "Unable to write " << tracePath << ": " << error << "\n";
+        return EXIT_USAGE;
+    }
+
+    return regressed ? EXIT_REGRESSED : EXIT_OK;
+}
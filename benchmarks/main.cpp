@@ -0,0 +1,365 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QByteArray>
+#include <QStringList>
+#include <QAtomicInteger>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "triggerengine.h"
+#include "heximage.h"
+#include "bootloader.h"
+#include "hexformatter.h"
+#include "util.h"
+
+// A serial byte is 10 bits on the wire (start + 8 data + stop).
+#define BITS_PER_BYTE 10
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+// Every heap allocation in the process, Qt's containers included (they
+// use malloc directly, so counting operator new would miss them). Only
+// glibc lets us get underneath malloc; elsewhere allocations aren't shown.
+static QBasicAtomicInteger<qint64> s_allocations = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+#if defined(__GLIBC__)
+#define COUNTING_ALLOCATIONS 1
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    s_allocations.fetchAndAddRelaxed(1);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    s_allocations.fetchAndAddRelaxed(1);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    s_allocations.fetchAndAddRelaxed(1);
+    return __libc_realloc(ptr, size);
+}
+
+// The aligned ones all come down to memalign, whose blocks free() takes.
+void *memalign(size_t alignment, size_t size)
+{
+    s_allocations.fetchAndAddRelaxed(1);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    s_allocations.fetchAndAddRelaxed(1);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    s_allocations.fetchAndAddRelaxed(1);
+    void *p = __libc_memalign(alignment, size);
+    if (!p && size > 0) return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+}
+#else
+#define COUNTING_ALLOCATIONS 0
+#endif
+
+static qint64 allocations()
+{
+    return s_allocations.load();
+}
+
+// ops and allocs, when given, add the allocations per operation.
+static void report(const QString &name, qint64 bytes, qint64 nsecs, qint64 ops = 0, qint64 allocs = 0)
+{
+    double seconds = nsecs / 1e9;
+    double mbPerSec = bytes / seconds / 1e6;
+    double mbaud = bytes * BITS_PER_BYTE / seconds / 1e6;
+    out << name.leftJustified(40) << QString::number(mbPerSec, 'f', 1).rightJustified(10) << " MB/s"
+        << QString::number(mbaud, 'f', 1).rightJustified(10) << " Mbaud"
+        << QString::number(double(nsecs) / bytes, 'f', 2).rightJustified(10) << " ns/byte";
+    if (ops > 0 && COUNTING_ALLOCATIONS)
+        out << QString::number(double(allocs) / ops, 'f', 2).rightJustified(10) << " allocs/op";
+    out << "\n";
+    out.flush();
+}
+
+static QByteArray randomBytes(int size)
+{
+    QByteArray bytes(size, 0);
+    quint32 x = 12345;
+    for (int i = 0; i < size; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        bytes[i] = (char)x;
+    }
+    return bytes;
+}
+
+static void appendRecord(QByteArray *hex, int type, int address, const char *data, int length)
+{
+    QByteArray record;
+    record.append((char)length).append((char)(address >> 8)).append((char)address).append((char)type);
+    record.append(data, length);
+
+    unsigned int sum = 0;
+    for (int i = 0; i < record.size(); ++i)
+        sum += (unsigned char)record[i];
+    record.append((char)(0x100 - (sum & 0xFF)));
+    hex->append(':').append(record.toHex().toUpper()).append("\r\n");
+}
+
+// Intel HEX for data, 16 bytes a record, with an extended linear address
+// record at each 64K like avr-objcopy.
+static QByteArray intelHex(const QByteArray &data)
+{
+    QByteArray hex;
+    hex.reserve(data.size() * 3);
+    for (int address = 0; address < data.size(); address += 16) {
+        if (address > 0 && (address & 0xFFFF) == 0) {
+            const char base[2] = { (char)(address >> 24), (char)(address >> 16) };
+            appendRecord(&hex, 4, 0, base, 2);
+        }
+        appendRecord(&hex, 0, address & 0xFFFF, data.constData() + address, qMin(16, data.size() - address));
+    }
+    appendRecord(&hex, 1, 0, 0, 0);
+    return hex;
+}
+
+// Results go here so the compiler can't drop the work.
+static volatile int s_sink;
+
+// Mostly printable log output with the occasional binary byte, split into
+// chunks about the size a serial read returns.
+static QList<QByteArray> syntheticStream(int totalBytes, int chunkSize)
+{
+    static const char *lines[] = {
+        "temp=23.5 hum=41.2 batt=3.91\r\n",
+        "radio: tx ok seq=1234 rssi=-71\r\n",
+        "tick 000123456\r\n",
+        "sensor 3 sample 0x1f2e 0x0a0b 0x7f7f\r\n",
+    };
+
+    QByteArray all;
+    all.reserve(totalBytes);
+    int i = 0;
+    while (all.size() < totalBytes) {
+        all.append(lines[i % 4]);
+        if (i % 97 == 0) all.append("READY\r\n");
+        if (i % 1013 == 0) all.append("ASSERT failed: main.c:42\r\n");
+        ++i;
+    }
+    all.resize(totalBytes);
+
+    QList<QByteArray> chunks;
+    for (int pos = 0; pos < all.size(); pos += chunkSize)
+        chunks << all.mid(pos, chunkSize);
+    return chunks;
+}
+
+static void benchTriggers()
+{
+    const int total = 64 * 1024 * 1024;
+    QList<QByteArray> chunks = syntheticStream(total, 512);
+
+    QList<int> literalCounts;
+    literalCounts << 1 << 16 << 256;
+    foreach (int count, literalCounts) {
+        TriggerEngine engine;
+        engine.addLiteral("ready", "READY");
+        engine.addLiteral("assert", "ASSERT");
+        for (int i = 2; i < count; ++i)
+            engine.addLiteral(QString("err%1").arg(i), QString("ERR%1:").arg(i, 4, 10, QChar('0')));
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < chunks.size(); ++i)
+            engine.feed(chunks[i], i);
+        report(QString("triggers/literals=%1").arg(count), total, timer.nsecsElapsed());
+    }
+
+    {
+        TriggerEngine engine;
+        engine.addLiteral("ready", "READY");
+        engine.addRegex("assert", "ASSERT failed: (\\w+\\.c):(\\d+)");
+        engine.addRegex("rssi", "rssi=-(9\\d|1\\d\\d)");
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < chunks.size(); ++i)
+            engine.feed(chunks[i], i);
+        report("triggers/literal+2 regex", total, timer.nsecsElapsed());
+    }
+}
+
+// Files the parser must refuse, checked before anything is timed. Returns
+// false and says which if one got through.
+static bool checkHex()
+{
+    // A 04 record of FFFF puts the next record at 0xFFFFFFF8, where the
+    // end of its data wraps past 4 GB.
+    QByteArray wrapped;
+    const char base[2] = { (char)0xFF, (char)0xFF };
+    appendRecord(&wrapped, 4, 0, base, 2);
+    appendRecord(&wrapped, 0, 0xFFF8, randomBytes(16).constData(), 16);
+    appendRecord(&wrapped, 1, 0, 0, 0);
+
+    HexImage image(32 * 1024);
+    if (image.parse(wrapped) || !image.isEmpty()) {
+        err << "hex/check: data at 0xFFFFFFF8 was accepted\n";
+        return false;
+    }
+    return true;
+}
+
+static void benchHex()
+{
+    // Roughly the same amount of text through each size, so small images
+    // aren't just measuring the timer.
+    const qint64 textPerSize = 64 * 1024 * 1024;
+
+    QList<int> sizes;
+    sizes << 1024 << 32 * 1024 << 1024 * 1024 << 4 * 1024 * 1024;
+    foreach (int size, sizes) {
+        const QByteArray text = intelHex(randomBytes(size));
+        const int repeats = qMax(1, int(textPerSize / text.size()));
+        HexImage image(size);
+
+        QElapsedTimer timer;
+        const qint64 before = allocations();
+        timer.start();
+        for (int i = 0; i < repeats; ++i)
+            image.parse(text.constData(), text.size());
+        const qint64 nsecs = timer.nsecsElapsed();
+        report(QString("hex/parse %1 KB").arg(size / 1024), qint64(text.size()) * repeats, nsecs,
+               repeats, allocations() - before);
+    }
+}
+
+static void benchBlocks()
+{
+    const QByteArray image = randomBytes(32 * 1024);
+    const int repeats = 2048;
+
+    QList<int> pageSizes;
+    pageSizes << 128 << 256;
+    foreach (int pageSize, pageSizes) {
+        QByteArray block(1 + Bootloader::headerSize(pageSize) + pageSize, 0);
+        const int blocks = image.size() / pageSize;
+
+        QElapsedTimer timer;
+        const qint64 before = allocations();
+        timer.start();
+        for (int r = 0; r < repeats; ++r)
+            for (int address = 0; address < image.size(); address += pageSize)
+                s_sink = Bootloader::encodeBlock(block.data(), image.constData() + address, pageSize, address, pageSize);
+        const qint64 nsecs = timer.nsecsElapsed();
+        report(QString("blocks/encode page=%1").arg(pageSize), qint64(image.size()) * repeats, nsecs,
+               qint64(blocks) * repeats, allocations() - before);
+
+        timer.start();
+        for (int r = 0; r < repeats; ++r)
+            for (int address = 0; address < image.size(); address += pageSize)
+                s_sink = Bootloader::checksum(image.constData() + address, pageSize, address);
+        report(QString("blocks/checksum page=%1").arg(pageSize), qint64(image.size()) * repeats,
+               timer.nsecsElapsed());
+    }
+}
+
+static void benchFormat()
+{
+    const int total = 64 * 1024 * 1024;
+    const int chunkSize = 512;
+    const QByteArray stream = randomBytes(total);
+
+    QList<HexFormatter::Mode> modes;
+    modes << HexFormatter::Hex << HexFormatter::Dec;
+    foreach (HexFormatter::Mode mode, modes) {
+        HexFormatter formatter(mode);
+        QByteArray formatted;
+        formatted.reserve(formatter.maxFormattedSize(chunkSize));
+
+        QElapsedTimer timer;
+        const qint64 before = allocations();
+        timer.start();
+        for (int pos = 0; pos < total; pos += chunkSize) {
+            formatted.resize(0);
+            formatter.format(stream.constData() + pos, chunkSize, &formatted);
+        }
+        const qint64 nsecs = timer.nsecsElapsed();
+        report(mode == HexFormatter::Hex ? "format/hex" : "format/dec", total, nsecs,
+               total / chunkSize, allocations() - before);
+    }
+
+    // The Util helpers the terminal and log use.
+    const int utilTotal = 8 * 1024 * 1024;
+    const QByteArray chunk = stream.left(chunkSize);
+    const QString text = QString::fromLatin1(chunk);
+
+    QElapsedTimer timer;
+    qint64 before = allocations();
+    timer.start();
+    for (int pos = 0; pos < utilTotal; pos += chunkSize)
+        s_sink = Util::byte2hex(chunk).size();
+    qint64 nsecs = timer.nsecsElapsed();
+    report("format/Util::byte2hex", utilTotal, nsecs, utilTotal / chunkSize, allocations() - before);
+
+    before = allocations();
+    timer.start();
+    for (int i = 0; i < utilTotal; ++i)
+        s_sink = Util::int2hex((unsigned char)stream.at(i)).size();
+    nsecs = timer.nsecsElapsed();
+    report("format/Util::int2hex", utilTotal, nsecs, utilTotal, allocations() - before);
+
+    before = allocations();
+    timer.start();
+    for (int pos = 0; pos < utilTotal; pos += chunkSize)
+        s_sink = Util::string2hex(text).size();
+    nsecs = timer.nsecsElapsed();
+    report("format/Util::string2hex", utilTotal, nsecs, utilTotal / chunkSize, allocations() - before);
+
+    before = allocations();
+    timer.start();
+    for (int pos = 0; pos < utilTotal; pos += chunkSize)
+        s_sink = Util::string2decimal(text).size();
+    nsecs = timer.nsecsElapsed();
+    report("format/Util::string2decimal", utilTotal, nsecs, utilTotal / chunkSize, allocations() - before);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList args = app.arguments().mid(1);
+    bool all = args.isEmpty();
+
+    if (all || args.contains("triggers"))
+        benchTriggers();
+    if (all || args.contains("hex")) {
+        if (!checkHex())
+            return 1;
+        benchHex();
+    }
+    if (all || args.contains("blocks"))
+        benchBlocks();
+    if (all || args.contains("format"))
+        benchFormat();
+
+    return 0;
+}
@@ -0,0 +1,328 @@
+#include "bootloader.h"
+
+#include <QSerialPort>
+#include <QElapsedTimer>
+#include <QThread>
+#include <string.h>
+#include "heximage.h"
+#include "trace.h"
+
+// How long each wait on the port lasts before checking for cancellation, ms.
+#define CONNECT_WAIT_STEP 50
+#define RESPONSE_WAIT_STEP 10
+
+const char Bootloader::SlaveReady;
+const char Bootloader::LoadModeStart;
+const char Bootloader::BlockSuccess;
+const char Bootloader::BlockFailure;
+
+static QString toHex(const char *data, int length)
+{
+    return QString::fromLatin1(QByteArray::fromRawData(data, length).toHex());
+}
+
+// The port calls, traced.
+static void writeAll(QSerialPort *port, const char *data, int length)
+{
+    Trace::Scope scope("QSerialPort::write");
+    scope.setArg("bytes", length);
+    port->write(data, length);
+    port->flush();
+}
+
+static QByteArray readAll(QSerialPort *port)
+{
+    Trace::Scope scope("QSerialPort::readAll");
+    const QByteArray data = port->readAll();
+    scope.setArg("bytes", data.size());
+    return data;
+}
+
+static bool waitForReadyRead(QSerialPort *port, int msecs)
+{
+    TRACE_SCOPE("QSerialPort::waitForReadyRead");
+    return port->waitForReadyRead(msecs);
+}
+
+static void hold(const char *name, int msecs)
+{
+    TRACE_SCOPE(name);
+    QThread::msleep(msecs);
+}
+
+Bootloader::Bootloader(QSerialPort *port, Listener *listener) :
+    m_port(port),
+    m_listener(listener)
+{
+}
+
+QString Bootloader::errorString() const
+{
+    return m_error;
+}
+
+bool Bootloader::fail(const QString &message)
+{
+    m_error = message;
+    log(ErrorMessage, message);
+    setState(Error, message);
+    return false;
+}
+
+void Bootloader::setState(State state, const QString &text)
+{
+    if (m_listener) m_listener->stateChanged(state, text);
+}
+
+void Bootloader::log(MessageLevel level, const QString &text)
+{
+    if (m_listener) m_listener->message(level, text);
+}
+
+bool Bootloader::cancelled()
+{
+    return m_listener && m_listener->cancelled();
+}
+
+bool Bootloader::enterProgramMode(bool ready)
+{
+    TRACE_SCOPE("Bootloader::enterProgramMode");
+    m_error.clear();
+
+    while (!ready) {
+        if (cancelled()) {
+            m_error = "Programming cancelled. Target chip did not enter programming mode.";
+            log(WarningMessage, "Programming cancelled before chip entered programming mode.");
+            setState(Error, m_error);
+            return false;
+        }
+        if (m_port->bytesAvailable() == 0 && !waitForReadyRead(m_port, CONNECT_WAIT_STEP))
+            continue;
+
+        QByteArray response = readAll(m_port);
+        if (m_listener) m_listener->received(response.constData(), response.size());
+        log(DebugMessage, "<-" + toHex(response.constData(), response.size()));
+        ready = response.indexOf(SlaveReady) >= 0;
+    }
+    log(InfoMessage, "Received Broadcast!");
+    Trace::instant("broadcast");
+
+    // Now put the chip into program mode
+    writeAll(m_port, &LoadModeStart, 1);
+    if (m_listener) m_listener->transmitted(&LoadModeStart, 1);
+    log(DebugMessage, "->" + toHex(&LoadModeStart, 1));
+
+    setState(Connected, "Load Mode Command Sent");
+    return true;
+}
+
+bool Bootloader::send(const HexImage &image, int pageSize)
+{
+    TRACE_SCOPE("Bootloader::send");
+    m_error.clear();
+
+    if (pageSize <= 0)
+        return fail("Error: Undefined Page size for chip type.");
+    if (image.isEmpty())
+        return fail("Error: The hex file has no data to send.");
+
+    const char *buffer = image.data().constData();
+    const int startAddress = image.startAddress();
+    const int endAddress = image.endAddress();
+    const int headerBytes = headerSize(pageSize);
+
+    // One block's worth, reused for every block.
+    QByteArray block(1 + headerBytes + pageSize, 0);
+
+    int currentAddress = startAddress;
+    int blockSize = 0;
+    bool cancel = false;
+    QElapsedTimer sent;
+    // When the block went, on the trace's clock.
+    qint64 traceSent = -1;
+
+    while (true) {
+        while (!cancel && m_port->bytesAvailable() == 0) {
+            waitForReadyRead(m_port, RESPONSE_WAIT_STEP);
+            cancel = cancelled();
+        }
+        if (cancel) break;
+
+        char response;
+        {
+            TRACE_SCOPE("QSerialPort::read");
+            m_port->read(&response, 1);
+        }
+        if (m_listener) m_listener->received(&response, 1);
+        log(DebugMessage, "<-" + toHex(&response, 1));
+
+        if (response == SlaveReady) {
+            // Hmmm a stray signal
+            Trace::instant("strayBroadcast");
+            writeAll(m_port, &LoadModeStart, 1);
+            if (m_listener) m_listener->transmitted(&LoadModeStart, 1);
+            continue;
+        } else if (response == BlockSuccess) {
+            if (blockSize > 0) {
+                Trace::complete("block", traceSent, Trace::now(), "address", currentAddress - blockSize);
+                if (m_listener)
+                    m_listener->blockAnswered(currentAddress - blockSize, blockSize, true, sent.nsecsElapsed());
+            }
+            setState(Programming);
+            if (currentAddress > endAddress) break;
+        } else if (response == BlockFailure) {
+            if (blockSize == 0)
+                return fail("Error : Incorrect initial response from target IC. Programming is incomplete and will now halt.");
+            Trace::complete("blockFailed", traceSent, Trace::now(), "address", currentAddress - blockSize);
+            if (m_listener)
+                m_listener->blockAnswered(currentAddress - blockSize, blockSize, false, sent.nsecsElapsed());
+            setState(Failure);
+            currentAddress -= blockSize;
+            if (m_listener) m_listener->blockResent(currentAddress);
+        } else {
+            return fail("Error : Incorrect response from target IC. Programming is incomplete and will now halt.");
+        }
+
+        if (m_listener)
+            m_listener->progress(currentAddress, endAddress, qreal(currentAddress - startAddress) / (endAddress - startAddress + 1));
+
+        blockSize = qMin(pageSize, endAddress - currentAddress + 1);
+        const int length = encodeBlock(block.data(), buffer + currentAddress, blockSize, currentAddress, pageSize);
+        writeAll(m_port, block.constData(), length);
+        sent.start();
+        traceSent = Trace::now();
+        if (m_listener) m_listener->transmitted(block.constData(), length);
+        log(DebugMessage, QString("-> :%1[+%2 bytes of data]")
+            .arg(toHex(block.constData() + 1, headerBytes)).arg(blockSize));
+
+        currentAddress += blockSize;
+    }
+
+    // Need to tell the chip that we're done, even if it didn't finish.
+    const QByteArray end = endOfProgram(pageSize);
+    writeAll(m_port, end.constData(), end.size());
+    if (m_listener) m_listener->transmitted(end.constData(), end.size());
+    log(DebugMessage, "-> " + QString::fromLatin1(end));
+
+    if (cancel) {
+        m_error = "The target chip did not finish loading. You will likely experience unexpected program execution.";
+        setState(Error, m_error);
+        return false;
+    }
+
+    setState(Programming);
+    return true;
+}
+
+bool Bootloader::reset(QSerialPort *port, ResetType type, const ResetProfile &profile,
+                       const QByteArray &expect, QByteArray *received, Listener *listener, qreal *latency)
+{
+    TRACE_SCOPE("Bootloader::reset");
+    if (latency) *latency = -1;
+
+    switch (type) {
+    case RTS:
+        port->setRequestToSend(true);
+        if (listener) listener->lineChanged(RequestToSend, true);
+        hold("pulse", profile.pulseWidth);
+        port->setRequestToSend(false);
+        if (listener) listener->lineChanged(RequestToSend, false);
+        if (listener) listener->message(DebugMessage, "-- Reset RTS");
+        break;
+
+    case DTR:
+        port->setDataTerminalReady(true);
+        if (listener) listener->lineChanged(DataTerminalReady, true);
+        hold("pulse", profile.pulseWidth);
+        port->setDataTerminalReady(false);
+        if (listener) listener->lineChanged(DataTerminalReady, false);
+        if (listener) listener->message(DebugMessage, "-- Reset DTR");
+        break;
+
+    case Software:
+        if (!port->isOpen()) {
+            if (listener) listener->message(ErrorMessage, "Port must be open for software reset");
+            return false;
+        }
+        writeAll(port, "R", 1);
+        if (listener) listener->transmitted("R", 1);
+        break;
+    }
+
+    const QByteArray pattern = expect.isEmpty() ? profile.pattern : expect;
+    QByteArray response;
+    bool found = false;
+
+    if (pattern.isEmpty()) {
+        hold("settle", profile.settle);
+        if (port->isOpen())
+            response = readAll(port);
+    } else {
+        // Done as soon as the board answers, rather than after a fixed sleep.
+        QElapsedTimer timer;
+        timer.start();
+        const int deadline = profile.deadline();
+        while (port->isOpen()) {
+            if (port->bytesAvailable() > 0 || waitForReadyRead(port, qMax(0, deadline - int(timer.elapsed())))) {
+                response.append(readAll(port));
+                if (response.indexOf(pattern) >= 0) {
+                    found = true;
+                    if (latency) *latency = timer.nsecsElapsed() / 1000000.0;
+                    break;
+                }
+            }
+            if (timer.elapsed() >= deadline) break;
+        }
+    }
+
+    if (listener) {
+        listener->received(response.constData(), response.size());
+        if (!response.isEmpty())
+            listener->message(DebugMessage, QString::fromLatin1(response));
+    }
+    if (received)
+        received->append(response);
+
+    return pattern.isEmpty() || found;
+}
+
+int Bootloader::headerSize(int pageSize)
+{
+    return pageSize >= 256 ? 5 : 4;
+}
+
+unsigned char Bootloader::checksum(const char *data, int length, int address)
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+    unsigned int sum = (length & 0xFF) + ((length >> 8) & 0xFF)
+            + (address & 0xFF) + ((address >> 8) & 0xFF);
+    for (int i = 0; i < length; ++i)
+        sum += bytes[i];
+    // Two's complement, so the whole block sums to 0
+    return (unsigned char)(0x100 - (sum & 0xFF));
+}
+
+int Bootloader::encodeBlock(char *out, const char *data, int length, int address, int pageSize)
+{
+    const unsigned char sum = checksum(data, length, address);
+
+    int i = 0;
+    out[i++] = ':';
+    if (headerSize(pageSize) == 5) {
+        out[i++] = (char)(length & 0xFF);
+        out[i++] = (char)((length >> 8) & 0xFF);
+    } else {
+        out[i++] = (char)length;
+    }
+    out[i++] = (char)(address & 0xFF);
+    out[i++] = (char)((address >> 8) & 0xFF);
+    out[i++] = (char)sum;
+
+    memcpy(out + i, data, length);
+    return i + length;
+}
+
+QByteArray Bootloader::endOfProgram(int pageSize)
+{
+    return headerSize(pageSize) == 5 ? QByteArray(": S") : QByteArray(":S");
+}
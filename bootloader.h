@@ -0,0 +1,102 @@
+#ifndef BOOTLOADER_H
+#define BOOTLOADER_H
+
+#include <QByteArray>
+#include <QString>
+#include "resetprofile.h"
+
+class QSerialPort;
+class HexImage;
+
+/*
+ * The Screamer bootloader protocol, over an open serial port.
+ *
+ * After a reset the bootloader broadcasts SlaveReady; answering LoadModeStart
+ * keeps it in load mode. The image then goes over one block at a time:
+ *
+ *   ':' length address(low, high) checksum data...
+ *
+ * with a one byte length for pages under 256 bytes and a two byte (low,
+ * high) length otherwise. The checksum makes the header and data sum to 0
+ * mod 256. Each block is answered with BlockSuccess, or BlockFailure to have
+ * it sent again. ":S" (": S" for wide headers) ends the transfer.
+ *
+ * Everything here blocks, so run it on a thread of its own. Progress, the
+ * bytes on the wire and log messages go to a Listener, which is also asked
+ * whether to give up.
+ */
+class Bootloader
+{
+public:
+    // Matches Programmer::Status
+    enum State { Idle=0, Connecting=1, Connected=2, Programming=3, Failure=4, Error=5 };
+    // Matches Settings::ResetType
+    enum ResetType { RTS=0, DTR=1, Software=2 };
+    // Matches Log::Level
+    enum MessageLevel { DebugMessage=0, InfoMessage=1, WarningMessage=2, ErrorMessage=3 };
+    enum Line { RequestToSend, DataTerminalReady };
+
+    static const char SlaveReady = 0x05;
+    static const char LoadModeStart = 0x06;
+    static const char BlockSuccess = 0x54;
+    static const char BlockFailure = 0x07;
+
+    // Every callback is made on the thread doing the work.
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+        virtual void stateChanged(State, const QString &) {}
+        virtual void progress(int /*address*/, int /*endAddress*/, qreal /*fraction*/) {}
+        virtual void blockResent(int /*address*/) {}
+        // Each block's answer, with the ns from writing the block to reading
+        // the answer.
+        virtual void blockAnswered(int /*address*/, int /*length*/, bool /*success*/, qint64 /*nsecs*/) {}
+        virtual void transmitted(const char *, int) {}
+        virtual void received(const char *, int) {}
+        virtual void lineChanged(Line, bool) {}
+        virtual void message(MessageLevel, const QString &) {}
+        // Polled while waiting on the board.
+        virtual bool cancelled() { return false; }
+    };
+
+    // listener may be 0.
+    Bootloader(QSerialPort *port, Listener *listener);
+
+    // Waits for SlaveReady, unless ready says it has already been seen, and
+    // sends LoadModeStart. Waits until the listener cancels.
+    bool enterProgramMode(bool ready);
+    // Sends the image's written range, page by page.
+    bool send(const HexImage &image, int pageSize);
+
+    QString errorString() const;
+
+    // Pulses the reset line (or sends "R" for a software reset) and waits
+    // for expect, or the profile's pattern when expect is empty, or for the
+    // settle time when there is neither. Whatever was read is appended to
+    // received. latency, if given, is set to the ms from reset to the
+    // pattern, or -1 if it never showed.
+    static bool reset(QSerialPort *port, ResetType type, const ResetProfile &profile,
+                      const QByteArray &expect = QByteArray(), QByteArray *received = 0,
+                      Listener *listener = 0, qreal *latency = 0);
+
+    // Header bytes in a block: 4 below 256 byte pages, 5 from there on.
+    static int headerSize(int pageSize);
+    static unsigned char checksum(const char *data, int length, int address);
+    // Writes the whole block, ':' included, to out, which must have room for
+    // 1 + headerSize(pageSize) + length bytes. Returns the bytes written.
+    static int encodeBlock(char *out, const char *data, int length, int address, int pageSize);
+    static QByteArray endOfProgram(int pageSize);
+
+private:
+    bool fail(const QString &message);
+    void setState(State state, const QString &text = QString());
+    void log(MessageLevel level, const QString &text);
+    bool cancelled();
+
+    QSerialPort *m_port;
+    Listener *m_listener;
+    QString m_error;
+};
+
+#endif // BOOTLOADER_H
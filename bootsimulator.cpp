@@ -0,0 +1,390 @@
+#include "bootsimulator.h"
+
+#include <QDebug>
+#include <QThread>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "bootloader.h"
+
+// A serial byte is 10 bits on the wire (start + 8 data + stop).
+#define BITS_PER_BYTE 10
+// How long each wait on the pty lasts, ms. Also how quickly the board
+// notices the port being opened.
+#define POLL_INTERVAL 5
+#define READ_CHUNK 4096
+
+BootSimulator::Options::Options() :
+    pageSize(128),
+    memorySize(32768),
+    baudRate(57600),
+    latency(0),
+    writeTime(0),
+    bitErrorRate(0),
+    dropRate(0),
+    readyInterval(20),
+    frameTimeout(50),
+    seed(1)
+{
+}
+
+BootSimulator::Stats::Stats() :
+    boots(0),
+    programs(0),
+    blocks(0),
+    failures(0),
+    bytesReceived(0),
+    bitsFlipped(0),
+    bytesDropped(0)
+{
+}
+
+BootSimulator::BootSimulator(const Options &options) :
+    m_options(options),
+    m_master(-1),
+    m_stop(0),
+    m_verbose(false),
+    m_state(Off),
+    m_flash(options.memorySize, char(0xFF)),
+    m_parse(Start),
+    m_length(0),
+    m_address(0),
+    m_blockBytes(0),
+    m_discard(false),
+    m_random(options.seed ? options.seed : 1),
+    m_nextError(0)
+{
+    m_nextError = bitsToNextError();
+}
+
+BootSimulator::~BootSimulator()
+{
+    close();
+}
+
+bool BootSimulator::open()
+{
+    m_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (m_master < 0 || grantpt(m_master) != 0 || unlockpt(m_master) != 0) {
+        m_error = QString("Unable to create a pty: %1").arg(strerror(errno));
+        close();
+        return false;
+    }
+    m_slaveName = QString::fromLocal8Bit(ptsname(m_master));
+
+    struct termios tio;
+    if (tcgetattr(m_master, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(m_master, TCSANOW, &tio);
+    }
+    fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+
+    // The master only reports a hangup once the slave has been opened and
+    // closed again; do that once so "nobody has the port open" looks the
+    // same before the first open as after.
+    const int slave = ::open(m_slaveName.toLocal8Bit().constData(), O_RDWR | O_NOCTTY);
+    if (slave >= 0) ::close(slave);
+
+    return true;
+}
+
+void BootSimulator::close()
+{
+    if (m_master >= 0) ::close(m_master);
+    m_master = -1;
+}
+
+QString BootSimulator::slaveName() const
+{
+    return m_slaveName;
+}
+
+QString BootSimulator::errorString() const
+{
+    return m_error;
+}
+
+void BootSimulator::setVerbose(bool arg)
+{
+    m_verbose = arg;
+}
+
+const QByteArray &BootSimulator::flash() const
+{
+    return m_flash;
+}
+
+BootSimulator::Stats BootSimulator::stats() const
+{
+    return m_stats;
+}
+
+void BootSimulator::stop()
+{
+    m_stop.store(1);
+}
+
+void BootSimulator::run()
+{
+    char buffer[READ_CHUNK];
+
+    while (!m_stop.load() && m_master >= 0) {
+        struct pollfd pfd;
+        pfd.fd = m_master;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (::poll(&pfd, 1, POLL_INTERVAL) < 0) {
+            if (errno == EINTR) continue;
+            m_error = QString("poll: %1").arg(strerror(errno));
+            break;
+        }
+
+        if (pfd.revents & POLLHUP) {
+            // Nobody has the port open, so the board has no power.
+            if (m_state != Off && m_verbose) qDebug() << "Sim: port closed";
+            m_state = Off;
+            QThread::msleep(POLL_INTERVAL);
+            continue;
+        }
+        if (m_state == Off)
+            boot();
+
+        if (pfd.revents & POLLIN) {
+            const ssize_t count = ::read(m_master, buffer, sizeof(buffer));
+            if (count > 0) feed(buffer, int(count));
+        }
+
+        if (m_state == Booting && m_lastReady.elapsed() >= m_options.readyInterval) {
+            write(&Bootloader::SlaveReady, 1);
+            m_lastReady.restart();
+        }
+        if (m_state == Loading && m_parse != Start && m_lastByte.elapsed() >= m_options.frameTimeout)
+            endBlock();
+    }
+}
+
+void BootSimulator::boot()
+{
+    if (m_verbose) qDebug() << "Sim: boot";
+    ++m_stats.boots;
+    m_state = Booting;
+    m_parse = Start;
+    write(&Bootloader::SlaveReady, 1);
+    m_lastReady.start();
+}
+
+void BootSimulator::feed(const char *data, int length)
+{
+    m_discard = false;
+    for (int i = 0; i < length && m_state != Off; ++i) {
+        unsigned char byte = (unsigned char)data[i];
+        ++m_stats.bytesReceived;
+        if (!corrupt(&byte)) continue;
+
+        switch (m_state) {
+        case Booting:
+            if (byte == (unsigned char)Bootloader::LoadModeStart) {
+                if (m_verbose) qDebug() << "Sim: load mode";
+                m_state = Loading;
+                m_parse = Start;
+                reply(Bootloader::BlockSuccess);
+            } else if (byte == 'R') {
+                boot();
+            }
+            break;
+
+        case Loading:
+            feedLoader(byte);
+            // A failed block throws away the rest of what was read with it.
+            if (m_discard) return;
+            break;
+
+        case Running:
+            if (byte == 'R') boot();
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+void BootSimulator::feedLoader(unsigned char byte)
+{
+    const int headerBytes = Bootloader::headerSize(m_options.pageSize);
+    m_lastByte.start();
+
+    switch (m_parse) {
+    case Start:
+        // Anything between blocks (e.g. a late LoadModeStart) is ignored.
+        if (byte != ':') return;
+        m_header.clear();
+        m_data.clear();
+        m_blockStarted.start();
+        m_blockBytes = 1;
+        m_parse = Header;
+        return;
+
+    case Header:
+        ++m_blockBytes;
+        m_header.append((char)byte);
+        if (headerBytes == 5 && m_header == " S") {
+            endProgram();
+            return;
+        }
+        // ":S" can't be a block when 'S' is too long for a page, and "R"
+        // can't follow it in a header when it's the software reset the
+        // host sends once the load is done.
+        if (headerBytes == 4 && m_header == "S" && 'S' > m_options.pageSize) {
+            endProgram();
+            return;
+        }
+        if (headerBytes == 4 && m_header == "SR") {
+            endProgram();
+            boot();
+            return;
+        }
+        if (m_header.size() < headerBytes) return;
+
+        if (headerBytes == 5) {
+            m_length = (unsigned char)m_header[0] | ((unsigned char)m_header[1] << 8);
+            m_address = (unsigned char)m_header[2] | ((unsigned char)m_header[3] << 8);
+        } else {
+            m_length = (unsigned char)m_header[0];
+            m_address = (unsigned char)m_header[1] | ((unsigned char)m_header[2] << 8);
+        }
+        if (m_length == 0 || m_length > m_options.pageSize) {
+            endBlock();
+            return;
+        }
+        m_parse = Data;
+        return;
+
+    case Data:
+        ++m_blockBytes;
+        m_data.append((char)byte);
+        if (m_data.size() == m_length)
+            endBlock();
+        return;
+    }
+}
+
+void BootSimulator::endBlock()
+{
+    // With 4 byte headers and pages of 83 bytes or more, ":S" looks like the
+    // start of an 83 byte block; unless a reset follows straight away, it's
+    // only the end once nothing more does.
+    if (m_parse == Header && m_header == "S") {
+        endProgram();
+        return;
+    }
+
+    bool ok = (m_parse == Data && m_data.size() == m_length
+               && m_address + m_length <= m_flash.size());
+    if (ok) {
+        unsigned int sum = 0;
+        for (int i = 0; i < m_header.size(); ++i)
+            sum += (unsigned char)m_header[i];
+        for (int i = 0; i < m_data.size(); ++i)
+            sum += (unsigned char)m_data[i];
+        ok = (sum & 0xFF) == 0;
+    }
+    m_parse = Start;
+
+    // The reply goes once the block would have finished arriving.
+    if (m_options.baudRate > 0)
+        pace(m_blockBytes * BITS_PER_BYTE * Q_INT64_C(1000000000) / m_options.baudRate
+             - m_blockStarted.nsecsElapsed());
+
+    if (!ok) {
+        if (m_verbose) qDebug() << "Sim: bad block at" << m_address;
+        ++m_stats.failures;
+        // Whatever else is on its way belongs to the broken block.
+        char scratch[READ_CHUNK];
+        while (::read(m_master, scratch, sizeof(scratch)) > 0) {}
+        m_discard = true;
+        reply(Bootloader::BlockFailure);
+        return;
+    }
+
+    memcpy(m_flash.data() + m_address, m_data.constData(), m_length);
+    ++m_stats.blocks;
+    if (m_options.writeTime > 0)
+        pace(qint64(m_options.writeTime * 1000000));
+    reply(Bootloader::BlockSuccess);
+}
+
+void BootSimulator::endProgram()
+{
+    if (m_verbose) qDebug() << "Sim: load finished," << m_stats.blocks << "blocks so far";
+    ++m_stats.programs;
+    m_parse = Start;
+    m_state = Running;
+    if (!m_options.banner.isEmpty())
+        write(m_options.banner.constData(), m_options.banner.size());
+}
+
+void BootSimulator::reply(char byte)
+{
+    if (m_options.latency > 0)
+        pace(qint64(m_options.latency * 1000000));
+    write(&byte, 1);
+}
+
+void BootSimulator::write(const char *data, int length)
+{
+    if (m_options.baudRate > 0)
+        pace(qint64(length) * BITS_PER_BYTE * Q_INT64_C(1000000000) / m_options.baudRate);
+    // Fails while nobody has the port open, which is just what a real
+    // line does with bytes nobody is listening for.
+    if (::write(m_master, data, length) < 0 && m_verbose)
+        qDebug() << "Sim: write failed:" << strerror(errno);
+}
+
+void BootSimulator::pace(qint64 nsecs)
+{
+    if (nsecs > 0)
+        QThread::usleep(nsecs / 1000);
+}
+
+bool BootSimulator::corrupt(unsigned char *byte)
+{
+    if (m_options.dropRate > 0 && random() < m_options.dropRate * 4294967296.0) {
+        ++m_stats.bytesDropped;
+        return false;
+    }
+
+    if (m_options.bitErrorRate > 0) {
+        while (m_nextError < 8) {
+            *byte ^= (unsigned char)(1 << m_nextError);
+            ++m_stats.bitsFlipped;
+            m_nextError += 1 + bitsToNextError();
+        }
+        m_nextError -= 8;
+    }
+    return true;
+}
+
+quint32 BootSimulator::random()
+{
+    // xorshift32: fast, and the same faults for the same seed every run.
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    return m_random;
+}
+
+qint64 BootSimulator::bitsToNextError()
+{
+    // Geometric gap between errors, so a clean bit costs nothing.
+    const double p = m_options.bitErrorRate;
+    if (p <= 0) return Q_INT64_C(0x7FFFFFFFFFFFFFFF) / 2;
+    if (p >= 1) return 0;
+    const double u = (random() + 1.0) / 4294967296.0;
+    return qint64(floor(log(u) / log(1 - p)));
+}
@@ -0,0 +1,127 @@
+#ifndef BOOTSIMULATOR_H
+#define BOOTSIMULATOR_H
+
+#include <QByteArray>
+#include <QString>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+
+/*
+ * A pretend board running the Screamer bootloader, on the far side of a
+ * pseudo-terminal, so the programmer can be run end to end without hardware.
+ * Open the port named by slaveName() like any other serial port.
+ *
+ * Opening the port powers the board up: it broadcasts SlaveReady every
+ * readyInterval ms until it gets LoadModeStart, then takes blocks as
+ * described in bootloader.h, checks each checksum and writes the block to
+ * its flash before answering. ":S" (": S") ends the load and starts the
+ * "application", which prints the banner if there is one. RTS and DTR don't
+ * reach the far side of a pty, so a reset means reopening the port or a
+ * software reset ("R").
+ *
+ * Everything the host sends first goes through the injected faults: each
+ * bit flips with probability bitErrorRate and each byte is lost with
+ * probability dropRate. A block that stops arriving for frameTimeout ms is
+ * answered with BlockFailure, so lost bytes cost a resend rather than a hang.
+ * Replies wait out latency ms, and with a baud rate set, the time the bytes
+ * would have taken on a real line.
+ *
+ * run() blocks until stop() is called from another thread.
+ */
+class BootSimulator
+{
+public:
+    struct Options
+    {
+        Options();
+
+        int pageSize;           // 256 and up uses 5 byte headers
+        int memorySize;
+        qint32 baudRate;        // 0 replies as fast as the pty goes
+        qreal latency;          // ms before every reply
+        qreal writeTime;        // ms to write a page to flash
+        double bitErrorRate;    // per bit received
+        double dropRate;        // per byte received
+        int readyInterval;      // ms between SlaveReady broadcasts
+        int frameTimeout;       // ms of silence that ends a partial block
+        QByteArray banner;      // printed when the application starts
+        quint32 seed;
+    };
+
+    struct Stats
+    {
+        Stats();
+
+        int boots;
+        int programs;           // loads finished with ":S"
+        int blocks;             // written to flash
+        int failures;           // answered with BlockFailure
+        qint64 bytesReceived;
+        qint64 bitsFlipped;
+        qint64 bytesDropped;
+    };
+
+    explicit BootSimulator(const Options &options = Options());
+    ~BootSimulator();
+
+    // Creates the pty pair. False (see errorString()) if it couldn't.
+    bool open();
+    void close();
+    QString slaveName() const;
+    QString errorString() const;
+
+    void run();
+    // Safe from any thread.
+    void stop();
+
+    void setVerbose(bool arg);
+
+    // Read these once run() has returned.
+    const QByteArray &flash() const;
+    Stats stats() const;
+
+private:
+    enum State { Off, Booting, Loading, Running };
+    enum Parse { Start, Header, Data };
+
+    void boot();
+    void feed(const char *data, int length);
+    void feedLoader(unsigned char byte);
+    void endBlock();
+    void endProgram();
+    void reply(char byte);
+    void write(const char *data, int length);
+    void pace(qint64 nsecs);
+
+    bool corrupt(unsigned char *byte);
+    quint32 random();
+    qint64 bitsToNextError();
+
+    Options m_options;
+    int m_master;
+    QString m_slaveName;
+    QString m_error;
+    QAtomicInt m_stop;
+    bool m_verbose;
+
+    State m_state;
+    QElapsedTimer m_lastReady;
+    QByteArray m_flash;
+    Stats m_stats;
+
+    // The block being received
+    Parse m_parse;
+    QByteArray m_header;
+    QByteArray m_data;
+    int m_length;
+    int m_address;
+    QElapsedTimer m_blockStarted;
+    QElapsedTimer m_lastByte;
+    qint64 m_blockBytes;
+    bool m_discard;
+
+    quint32 m_random;
+    qint64 m_nextError;     // bits until the next flipped one
+};
+
+#endif // BOOTSIMULATOR_H
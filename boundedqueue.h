@@ -0,0 +1,92 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QAtomicInt>
+#include <QVector>
+
+/*
+ * Lock-free bounded queue for many producer threads and a single consumer.
+ *
+ * Each cell carries a sequence number telling producers whether it is free
+ * and the consumer whether it is filled (D. Vyukov's bounded MPMC queue). A
+ * producer never waits: tryPush() returns false when the queue is full and
+ * it is up to the caller to drop or count the value.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    // The capacity is rounded up to a power of two.
+    explicit BoundedQueue(int capacity = 1024) :
+        m_dequeuePos(0)
+    {
+        int size = 2;
+        while (size < capacity) size <<= 1;
+
+        m_mask = size - 1;
+        m_cells = QVector<Cell>(size);
+        for (int i = 0; i < size; ++i)
+            m_cells[i].sequence.storeRelease(i);
+    }
+
+    int capacity() const { return m_mask + 1; }
+
+    // Safe to call from any thread.
+    bool tryPush(const T &value)
+    {
+        Cell *cell;
+        int pos = m_enqueuePos.loadAcquire();
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const int diff = int(uint(cell->sequence.loadAcquire()) - uint(pos));
+            if (diff == 0) {
+                if (m_enqueuePos.testAndSetOrdered(pos, pos + 1))
+                    break;
+                pos = m_enqueuePos.loadAcquire();
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = m_enqueuePos.loadAcquire();
+            }
+        }
+
+        cell->value = value;
+        cell->sequence.storeRelease(pos + 1);
+        return true;
+    }
+
+    // Only ever call from the single consumer thread.
+    bool tryPop(T *value)
+    {
+        Cell &cell = m_cells[m_dequeuePos & m_mask];
+        const int diff = int(uint(cell.sequence.loadAcquire()) - uint(m_dequeuePos + 1));
+        if (diff < 0) return false; // Empty
+
+        *value = cell.value;
+        cell.value = T();
+        cell.sequence.storeRelease(m_dequeuePos + m_mask + 1);
+        ++m_dequeuePos;
+        return true;
+    }
+
+private:
+    struct Cell {
+        Cell() {}
+        Cell(const Cell &other) : sequence(other.sequence.loadAcquire()), value(other.value) {}
+        Cell &operator=(const Cell &other) {
+            sequence.storeRelease(other.sequence.loadAcquire());
+            value = other.value;
+            return *this;
+        }
+
+        QAtomicInt sequence;
+        T value;
+    };
+
+    QVector<Cell> m_cells;
+    int m_mask;
+    QAtomicInt m_enqueuePos;
+    int m_dequeuePos;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,377 @@
+#include "capturesink.h"
+
+#include <QThread>
+#include <QFile>
+#include <QDir>
+#include <QDateTime>
+#include <QDebug>
+#include <string.h>
+
+#ifdef SCREAMER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define SINK_MAX_PENDING (16*1024*1024)
+#define SINK_WAKE_INTERVAL 1000
+
+/*
+ * The writer owns the open file. Everything it touches on the sink other than
+ * the pending list and config (both behind the sink's mutex) is its own.
+ */
+class CaptureSinkWriter : public QThread
+{
+public:
+    explicit CaptureSinkWriter(CaptureSink *sink) :
+        m_sink(sink),
+#ifdef SCREAMER_HAVE_ZLIB
+        m_gz(0),
+#endif
+        m_written(0),
+        m_openedAt(0),
+        m_atLineStart(true)
+    {
+    }
+
+protected:
+    void run();
+
+private:
+    bool openFile(const CaptureSink::Config &config, qint64 now);
+    bool fail(const QString &message);
+    bool failWrite();
+    void closeFile();
+    bool writeBytes(const char *data, int length);
+    bool writeChunk(const CaptureSink::Chunk &chunk, const CaptureSink::Config &config);
+    bool needsRotation(const CaptureSink::Config &config, qint64 now) const;
+
+    CaptureSink *m_sink;
+
+    QFile m_file;
+#ifdef SCREAMER_HAVE_ZLIB
+    gzFile m_gz;
+#endif
+    QString m_fileName;
+    qint64 m_written;
+    qint64 m_openedAt;
+    bool m_atLineStart;
+};
+
+void CaptureSinkWriter::run()
+{
+    QVector<CaptureSink::Chunk> chunks;
+
+    QMutexLocker lock(&m_sink->m_mutex);
+    CaptureSink::Config config = m_sink->m_config;
+    lock.unlock();
+
+    if (!openFile(config, QDateTime::currentMSecsSinceEpoch()))
+        return;
+
+    lock.relock();
+    while (true) {
+        if (m_sink->m_pending.isEmpty() && m_sink->m_running)
+            m_sink->m_wake.wait(&m_sink->m_mutex, SINK_WAKE_INTERVAL);
+
+        chunks.swap(m_sink->m_pending);
+        m_sink->m_pendingBytes = 0;
+        qint64 dropped = m_sink->m_dropped;
+        m_sink->m_dropped = 0;
+        bool running = m_sink->m_running;
+        bool reopen = (config.directory != m_sink->m_config.directory
+                       || config.baseName != m_sink->m_config.baseName
+                       || config.compress != m_sink->m_config.compress);
+        config = m_sink->m_config;
+        lock.unlock();
+
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        if (reopen || needsRotation(config, now)) {
+            closeFile();
+            if (!openFile(config, now)) return;
+        }
+
+        if (dropped > 0) {
+            QByteArray msg = QString("\n[capture dropped %1 bytes]\n").arg(dropped).toLatin1();
+            if (!writeBytes(msg.constData(), msg.size())) {
+                failWrite();
+                return;
+            }
+            m_atLineStart = true;
+        }
+
+        for (int i = 0; i < chunks.size(); ++i) {
+            if (needsRotation(config, chunks[i].timestamp)) {
+                closeFile();
+                if (!openFile(config, chunks[i].timestamp)) return;
+            }
+            if (!writeChunk(chunks[i], config)) {
+                failWrite();
+                return;
+            }
+        }
+        chunks.resize(0);
+
+        if (m_file.isOpen() && !m_file.flush()) {
+            failWrite();
+            return;
+        }
+
+        if (!running) break;
+        lock.relock();
+    }
+
+    closeFile();
+}
+
+bool CaptureSinkWriter::needsRotation(const CaptureSink::Config &config, qint64 now) const
+{
+    if (config.maxFileSize > 0 && m_written >= config.maxFileSize)
+        return true;
+    if (config.rotateInterval > 0 && now - m_openedAt >= qint64(config.rotateInterval) * 1000)
+        return true;
+    return false;
+}
+
+bool CaptureSinkWriter::openFile(const CaptureSink::Config &config, qint64 now)
+{
+    QDir dir(config.directory);
+    if (!dir.exists() && !dir.mkpath("."))
+        return fail("Unable to create capture directory " + config.directory);
+
+    QString fileName = dir.filePath(QString("%1-%2.log")
+            .arg(config.baseName.isEmpty() ? QString("terminal") : config.baseName)
+            .arg(QDateTime::fromMSecsSinceEpoch(now).toString("yyyyMMdd-HHmmss-zzz")));
+
+    bool compress = config.compress && CaptureSink::canCompress();
+    if (compress) {
+        fileName += ".gz";
+#ifdef SCREAMER_HAVE_ZLIB
+        // Level 1: we're here to keep up with the line, not to win on ratio.
+        m_gz = gzopen(QFile::encodeName(fileName).constData(), "wb1");
+        if (!m_gz)
+            return fail("Unable to open capture file " + fileName);
+#endif
+    } else {
+        m_file.setFileName(fileName);
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append))
+            return fail("Unable to open capture file " + fileName + ": " + m_file.errorString());
+    }
+
+    m_fileName = fileName;
+    m_written = 0;
+    m_openedAt = now;
+    m_atLineStart = true;
+
+    {
+        QMutexLocker lock(&m_sink->m_mutex);
+        m_sink->m_currentFile = fileName;
+    }
+    emit m_sink->fileOpened(fileName);
+    return true;
+}
+
+// Stops the sink, so write() returns straight away instead of queueing data
+// nothing will write. start() (e.g. on the next config change) tries again.
+bool CaptureSinkWriter::fail(const QString &message)
+{
+    {
+        QMutexLocker lock(&m_sink->m_mutex);
+        m_sink->m_running = false;
+        m_sink->m_error = message;
+        m_sink->m_pending.clear();
+        m_sink->m_pendingBytes = 0;
+        m_sink->m_currentFile.clear();
+    }
+    emit m_sink->error(message);
+    return false;
+}
+
+// A full disk or an I/O error. Whatever follows would be lost too, so the
+// sink stops rather than go on looking like it's logging.
+bool CaptureSinkWriter::failWrite()
+{
+    QString reason = m_file.errorString();
+#ifdef SCREAMER_HAVE_ZLIB
+    if (m_gz) {
+        int code;
+        reason = QString::fromLocal8Bit(gzerror(m_gz, &code));
+    }
+#endif
+    closeFile();
+    return fail("Unable to write capture file " + m_fileName + ": " + reason);
+}
+
+void CaptureSinkWriter::closeFile()
+{
+#ifdef SCREAMER_HAVE_ZLIB
+    if (m_gz) {
+        gzclose(m_gz);
+        m_gz = 0;
+    }
+#endif
+    if (m_file.isOpen())
+        m_file.close();
+}
+
+bool CaptureSinkWriter::writeBytes(const char *data, int length)
+{
+    if (length <= 0) return true;
+    m_written += length;
+#ifdef SCREAMER_HAVE_ZLIB
+    if (m_gz)
+        return gzwrite(m_gz, data, length) == length;
+#endif
+    return m_file.write(data, length) == length;
+}
+
+bool CaptureSinkWriter::writeChunk(const CaptureSink::Chunk &chunk, const CaptureSink::Config &config)
+{
+    const char *data = chunk.data.constData();
+    const int length = chunk.data.size();
+
+    if (config.mode == CaptureSink::Raw)
+        return writeBytes(data, length);
+
+    // Every line starting in this chunk shares the chunk's arrival time.
+    QByteArray prefix = "[" + QDateTime::fromMSecsSinceEpoch(chunk.timestamp)
+            .toString("yyyy-MM-dd HH:mm:ss.zzz").toLatin1() + "] ";
+
+    int start = 0;
+    while (start < length) {
+        if (m_atLineStart) {
+            if (!writeBytes(prefix.constData(), prefix.size())) return false;
+            m_atLineStart = false;
+        }
+
+        const char *newline = static_cast<const char *>(memchr(data + start, '\n', length - start));
+        int end = newline ? int(newline - data) + 1 : length;
+        if (!writeBytes(data + start, end - start)) return false;
+        if (newline) m_atLineStart = true;
+        start = end;
+    }
+    return true;
+}
+
+
+CaptureSink::CaptureSink(QObject *parent) :
+    QObject(parent),
+    m_pendingBytes(0),
+    m_dropped(0),
+    m_droppedTotal(0),
+    m_running(false),
+    m_writer(0)
+{
+}
+
+CaptureSink::~CaptureSink()
+{
+    stop();
+}
+
+bool CaptureSink::canCompress()
+{
+#ifdef SCREAMER_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool CaptureSink::start(const Config &config)
+{
+    stop();
+
+    {
+        QMutexLocker lock(&m_mutex);
+        m_config = config;
+        m_running = true;
+        m_droppedTotal = 0;
+        m_error.clear();
+    }
+
+    m_writer = new CaptureSinkWriter(this);
+    m_writer->start(QThread::LowPriority);
+    return true;
+}
+
+void CaptureSink::stop()
+{
+    if (!m_writer) return;
+
+    {
+        QMutexLocker lock(&m_mutex);
+        m_running = false;
+        m_wake.wakeOne();
+    }
+
+    m_writer->wait();
+    delete m_writer;
+    m_writer = 0;
+
+    QMutexLocker lock(&m_mutex);
+    m_pending.clear();
+    m_pendingBytes = 0;
+    m_currentFile.clear();
+}
+
+bool CaptureSink::isRunning() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_running;
+}
+
+void CaptureSink::setConfig(const Config &config)
+{
+    QMutexLocker lock(&m_mutex);
+    m_config = config;
+}
+
+CaptureSink::Config CaptureSink::config() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_config;
+}
+
+void CaptureSink::write(const QByteArray &data)
+{
+    write(data, QDateTime::currentMSecsSinceEpoch());
+}
+
+void CaptureSink::write(const QByteArray &data, qint64 msecsSinceEpoch)
+{
+    if (data.isEmpty()) return;
+
+    QMutexLocker lock(&m_mutex);
+    if (!m_running) return;
+
+    if (m_pendingBytes + data.size() > SINK_MAX_PENDING) {
+        m_dropped += data.size();
+        m_droppedTotal += data.size();
+        return;
+    }
+
+    Chunk chunk;
+    chunk.timestamp = msecsSinceEpoch;
+    chunk.data = data;
+    m_pending.append(chunk);
+    m_pendingBytes += data.size();
+
+    m_wake.wakeOne();
+}
+
+QString CaptureSink::currentFile() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_currentFile;
+}
+
+qint64 CaptureSink::droppedBytes() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_droppedTotal;
+}
+
+QString CaptureSink::errorString() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_error;
+}
@@ -0,0 +1,91 @@
+#ifndef CAPTURESINK_H
+#define CAPTURESINK_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+
+class CaptureSinkWriter;
+
+/*
+ * Streams the terminal's incoming bytes to disk.
+ *
+ * write() only appends the chunk to a pending list under a short lock; a
+ * background thread swaps the list out and does all of the formatting, file
+ * I/O, rotation and compression. If the disk can't keep up the pending list
+ * is capped and further chunks are dropped (and reported in the file) rather
+ * than stalling the caller. If a file can't be opened, at start or on
+ * rotation, or a write fails (e.g. the disk is full), the sink stops and
+ * reports error() once; start() again to retry.
+ */
+class CaptureSink : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode { Raw, Timestamped };
+
+    struct Config {
+        Config() : mode(Raw), compress(false), maxFileSize(0), rotateInterval(0) {}
+
+        QString directory;
+        QString baseName;
+        Mode mode;
+        bool compress;
+        qint64 maxFileSize;  // Uncompressed bytes per file, 0 for no limit
+        int rotateInterval;  // Seconds per file, 0 for no limit
+    };
+
+    explicit CaptureSink(QObject *parent = 0);
+    ~CaptureSink();
+
+    static bool canCompress();
+
+    bool start(const Config &config);
+    void stop();
+    // False once stopped, including by an error.
+    bool isRunning() const;
+
+    // Takes effect from the next chunk written.
+    void setConfig(const Config &config);
+    Config config() const;
+
+    // Thread safe and never waits on the disk.
+    void write(const QByteArray &data);
+    void write(const QByteArray &data, qint64 msecsSinceEpoch);
+
+    QString currentFile() const;
+    qint64 droppedBytes() const;
+    // Why the sink last stopped by itself, empty if it didn't.
+    QString errorString() const;
+
+signals:
+    // Emitted from the writer thread.
+    void fileOpened(QString fileName);
+    void error(QString message);
+
+private:
+    friend class CaptureSinkWriter;
+
+    struct Chunk {
+        qint64 timestamp;
+        QByteArray data;
+    };
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    QVector<Chunk> m_pending;
+    qint64 m_pendingBytes;
+    qint64 m_dropped;
+    qint64 m_droppedTotal;
+    bool m_running;
+    QString m_error;
+    Config m_config;
+    QString m_currentFile;
+
+    CaptureSinkWriter *m_writer;
+};
+
+#endif // CAPTURESINK_H
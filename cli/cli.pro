@@ -0,0 +1,50 @@
+# Headless flashing tool: the programmer without the GUI.
+# Build: qmake && make, then ./screamer-cli --help
+# --daemon keeps running and takes jobs over a local socket.
+
+QT += core serialport network
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = screamer-cli
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    jobreporter.cpp \
+    flashdaemon.cpp \
+    ../programmer.cpp \
+    ../settings.cpp \
+    ../util.cpp \
+    ../utilhex.cpp \
+    ../serial.cpp \
+    ../log.cpp \
+    ../hexformatter.cpp \
+    ../serialcapture.cpp \
+    ../portmonitor.cpp \
+    ../verifyprobe.cpp
+
+HEADERS += \
+    jobreporter.h \
+    flashdaemon.h \
+    ../programmer.h \
+    ../settings.h \
+    ../util.h \
+    ../serial.h \
+    ../log.h \
+    ../ringbuffer.h \
+    ../boundedqueue.h \
+    ../hexformatter.h \
+    ../serialcapture.h \
+    ../portmonitor.h \
+    ../verifyprobe.h
+
+include(../core.pri)
+
+linux {
+    LIBS += -ludev
+    DEFINES += SCREAMER_HAVE_UDEV
+}
@@ -0,0 +1,423 @@
+#include "flashdaemon.h"
+
+#include <QFileInfo>
+#include <QMetaEnum>
+#include <QUrl>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+#include "programmer.h"
+#include "verifyprobe.h"
+#include "jobreporter.h"
+
+// Longest request line accepted before the client is dropped.
+#define MAX_REQUEST_SIZE 65536
+#define DEFAULT_VERIFY_TIMEOUT 3000
+// How long a daemon already on the socket has to answer, ms.
+#define LISTEN_PROBE_TIMEOUT 500
+
+static QByteArray toJsonLine(const QVariantMap &data)
+{
+    return QJsonDocument(QJsonObject::fromVariantMap(data)).toJson(QJsonDocument::Compact) + "\n";
+}
+
+
+PortQueue::PortQueue(const QString &portName, QObject *parent) :
+    QObject(parent),
+    m_portName(portName),
+    m_settings(new Settings(this, false)),
+    m_programmer(new Programmer(this)),
+    m_probe(0),
+    m_busy(false)
+{
+    m_settings->setAutoOpenTerminal(false);
+    m_settings->setPortName(portName);
+    // This port is only ever used for programming.
+    m_settings->setProgrammerActive(true);
+
+    m_programmer->setKeepPortOpen(true);
+
+    m_reporter = new JobReporter(m_programmer, this);
+    connect(m_reporter, &JobReporter::done, this, &PortQueue::programmingDone);
+    connect(m_programmer, &Programmer::resetFinished, this, &PortQueue::resetDone);
+}
+
+PortQueue::~PortQueue()
+{
+    if (m_probe) {
+        m_probe->wait();
+        delete m_probe;
+    }
+}
+
+void PortQueue::submit(const Job &job)
+{
+    m_jobs.enqueue(job);
+    next();
+}
+
+void PortQueue::cancel()
+{
+    while (!m_jobs.isEmpty()) {
+        QVariantMap data;
+        data["success"] = false;
+        data["text"] = QString("Cancelled");
+        reply(m_jobs.dequeue(), "result", data);
+    }
+
+    // Stops only the programmer's current job, so one that has just ended
+    // leaves the next job alone.
+    m_programmer->stopProgramming();
+
+    // A verify gives the port up straight away rather than at its timeout.
+    if (m_probe) {
+        m_probe->abort();
+        m_probe->wait();
+        delete m_probe;
+        m_probe = 0;
+
+        QVariantMap data;
+        data["success"] = false;
+        data["text"] = QString("Cancelled");
+        reply(m_current, "result", data);
+        m_current = Job();
+        // Queued behind the probe's finished(), already posted, so that
+        // finds no probe and the next job's can't be mistaken for it.
+        QMetaObject::invokeMethod(this, "jobDone", Qt::QueuedConnection);
+    }
+}
+
+QString PortQueue::portName() const
+{
+    return m_portName;
+}
+
+bool PortQueue::busy() const
+{
+    return m_busy;
+}
+
+int PortQueue::pending() const
+{
+    return m_jobs.size();
+}
+
+void PortQueue::next()
+{
+    while (!m_busy && !m_jobs.isEmpty()) {
+        m_current = m_jobs.dequeue();
+        // Nobody left to tell; don't bother.
+        if (!m_current.client) continue;
+
+        m_busy = true;
+        const QString type = m_current.request.value("type").toString();
+        if (type == "flash")
+            runFlash();
+        else if (type == "reset")
+            runReset();
+        else
+            runVerify(false);
+    }
+}
+
+void PortQueue::applySettings(const QVariantMap &request)
+{
+    Settings::Chip chip;
+    if (request.contains("chip") && FlashDaemon::parseChip(request.value("chip").toString(), &chip))
+        m_settings->setChip(chip);
+
+    Settings::ResetType resetType;
+    if (request.contains("reset") && FlashDaemon::parseResetType(request.value("reset").toString(), &resetType))
+        m_settings->setResetType(resetType);
+
+    if (request.value("baud").toInt() > 0)
+        m_settings->setBaudProgram((QSerialPort::BaudRate)request.value("baud").toInt());
+    if (request.value("verifyBaud").toInt() > 0)
+        m_settings->setBaudTerminal((QSerialPort::BaudRate)request.value("verifyBaud").toInt());
+}
+
+void PortQueue::runFlash()
+{
+    applySettings(m_current.request);
+
+    QFileInfo hex(m_current.request.value("hex").toString());
+    if (!hex.isFile()) {
+        QVariantMap data;
+        data["success"] = false;
+        data["text"] = QString("No such file: %1").arg(hex.filePath());
+        reply(m_current, "result", data);
+        jobDone();
+        return;
+    }
+    m_settings->setHexFile(QUrl::fromLocalFile(hex.absoluteFilePath()));
+
+    QVariantMap tag;
+    tag["id"] = m_current.request.value("id");
+    tag["port"] = m_portName;
+    const bool verify = m_current.request.contains("verify");
+    m_reporter->start(m_current.client, tag, verify ? "flashed" : "result");
+
+    m_programmer->programMicro(m_settings);
+    if (!m_programmer->isProgramming()) {
+        m_reporter->stop();
+        QVariantMap data;
+        data["success"] = false;
+        data["text"] = QString("Port could not be opened");
+        reply(m_current, "result", data);
+        jobDone();
+    }
+}
+
+void PortQueue::programmingDone(bool success)
+{
+    if (success && m_current.request.contains("verify"))
+        runVerify(true);
+    else
+        jobDone();
+}
+
+void PortQueue::runReset()
+{
+    applySettings(m_current.request);
+
+    // On the programmer's thread, so the pulse and settle time don't hold
+    // up the other ports and clients. The port stays open for the next job,
+    // like after programming.
+    if (!m_programmer->startReset(m_settings)) {
+        QVariantMap data;
+        data["success"] = false;
+        data["text"] = QString("Port could not be opened");
+        reply(m_current, "result", data);
+        jobDone();
+    }
+}
+
+void PortQueue::resetDone()
+{
+    QVariantMap data;
+    data["success"] = true;
+    reply(m_current, "result", data);
+    jobDone();
+}
+
+void PortQueue::runVerify(bool afterFlash)
+{
+    if (!afterFlash)
+        applySettings(m_current.request);
+
+    // The probe opens the port itself.
+    m_programmer->closePort();
+
+    QVariantMap result;
+    result["portName"] = m_portName;
+    int timeout = m_current.request.value("verifyTimeout", DEFAULT_VERIFY_TIMEOUT).toInt();
+    m_probe = new VerifyProbe(result, m_settings, m_current.request.value("verify").toString().toUtf8(), timeout);
+    connect(m_probe, &QThread::finished, this, &PortQueue::verifyFinished);
+    m_probe->start();
+}
+
+void PortQueue::verifyFinished()
+{
+    // Cancelled.
+    if (!m_probe) return;
+
+    m_probe->wait();
+    QVariantMap result = m_probe->m_result;
+    delete m_probe;
+    m_probe = 0;
+
+    QVariantMap data;
+    data["success"] = result.value("verified");
+    data["verified"] = result.value("verified");
+    data["verifyTime"] = result.value("duration");
+    if (result.contains("detail"))
+        data["text"] = result.value("detail");
+    reply(m_current, "result", data);
+    jobDone();
+}
+
+void PortQueue::reply(const Job &job, const QString &event, QVariantMap data)
+{
+    if (!job.client) return;
+    data["id"] = job.request.value("id");
+    data["port"] = m_portName;
+    data["event"] = event;
+    job.client->write(toJsonLine(data));
+}
+
+void PortQueue::jobDone()
+{
+    m_busy = false;
+    m_current = Job();
+    next();
+}
+
+
+FlashDaemon::FlashDaemon(QObject *parent) :
+    QObject(parent)
+{
+    connect(&m_server, &QLocalServer::newConnection, this, &FlashDaemon::newConnection);
+}
+
+bool FlashDaemon::listen(const QString &name)
+{
+    m_error.clear();
+
+    // Only a socket nobody answers on is left over from a daemon that didn't
+    // exit cleanly; one that answers belongs to a daemon still running.
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(LISTEN_PROBE_TIMEOUT)) {
+        probe.disconnectFromServer();
+        m_error = "Another daemon is already listening";
+        return false;
+    }
+    QLocalServer::removeServer(name);
+    return m_server.listen(name);
+}
+
+QString FlashDaemon::errorString() const
+{
+    return m_error.isEmpty() ? m_server.errorString() : m_error;
+}
+
+static int enumValue(const char *enumName, const QString &name, bool *ok)
+{
+    const QMetaObject &meta = Settings::staticMetaObject;
+    QMetaEnum metaEnum = meta.enumerator(meta.indexOfEnumerator(enumName));
+    for (int i = 0; i < metaEnum.keyCount(); ++i) {
+        if (name.compare(metaEnum.key(i), Qt::CaseInsensitive) == 0) {
+            *ok = true;
+            return metaEnum.value(i);
+        }
+    }
+    *ok = false;
+    return 0;
+}
+
+bool FlashDaemon::parseChip(const QString &name, Settings::Chip *chip)
+{
+    bool ok;
+    int value = enumValue("Chip", name, &ok);
+    if (ok) *chip = (Settings::Chip)value;
+    return ok;
+}
+
+bool FlashDaemon::parseResetType(const QString &name, Settings::ResetType *resetType)
+{
+    bool ok;
+    int value = enumValue("ResetType", name, &ok);
+    if (ok) *resetType = (Settings::ResetType)value;
+    return ok;
+}
+
+void FlashDaemon::newConnection()
+{
+    while (m_server.hasPendingConnections()) {
+        QLocalSocket *client = m_server.nextPendingConnection();
+        connect(client, &QLocalSocket::readyRead, this, &FlashDaemon::readClient);
+        connect(client, &QLocalSocket::disconnected, client, &QObject::deleteLater);
+    }
+}
+
+void FlashDaemon::readClient()
+{
+    QLocalSocket *client = qobject_cast<QLocalSocket *>(sender());
+    if (!client) return;
+
+    while (client->canReadLine()) {
+        QByteArray line = client->readLine().trimmed();
+        if (!line.isEmpty())
+            handle(client, line);
+    }
+
+    if (client->bytesAvailable() > MAX_REQUEST_SIZE) {
+        QVariantMap data;
+        data["text"] = QString("Request too long");
+        reply(client, QVariant(), "error", data);
+        client->disconnectFromServer();
+    }
+}
+
+void FlashDaemon::reply(QLocalSocket *client, const QVariant &id, const QString &event, QVariantMap data)
+{
+    data["id"] = id;
+    data["event"] = event;
+    client->write(toJsonLine(data));
+}
+
+PortQueue *FlashDaemon::queue(const QString &portName)
+{
+    PortQueue *queue = m_queues.value(portName);
+    if (!queue) {
+        queue = new PortQueue(portName, this);
+        m_queues.insert(portName, queue);
+    }
+    return queue;
+}
+
+void FlashDaemon::handle(QLocalSocket *client, const QByteArray &line)
+{
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(line, &error);
+    if (!doc.isObject()) {
+        QVariantMap data;
+        data["text"] = "Bad request: " + error.errorString();
+        reply(client, QVariant(), "error", data);
+        return;
+    }
+
+    QVariantMap request = doc.object().toVariantMap();
+    const QVariant id = request.value("id");
+    const QString type = request.value("type").toString();
+    const QString portName = request.value("port").toString();
+
+    if (type == "ports") {
+        QVariantList ports;
+        foreach (PortQueue *queue, m_queues) {
+            QVariantMap port;
+            port["port"] = queue->portName();
+            port["busy"] = queue->busy();
+            port["pending"] = queue->pending();
+            ports << port;
+        }
+        QVariantMap data;
+        data["ports"] = ports;
+        reply(client, id, "ports", data);
+        return;
+    }
+
+    if (type != "flash" && type != "reset" && type != "verify" && type != "cancel") {
+        QVariantMap data;
+        data["text"] = QString("Unknown request type: %1").arg(type);
+        reply(client, id, "error", data);
+        return;
+    }
+    if (portName.isEmpty()) {
+        QVariantMap data;
+        data["text"] = QString("No port given");
+        reply(client, id, "error", data);
+        return;
+    }
+
+    if (type == "cancel") {
+        if (m_queues.contains(portName))
+            m_queues.value(portName)->cancel();
+        QVariantMap data;
+        data["success"] = true;
+        data["port"] = portName;
+        reply(client, id, "result", data);
+        return;
+    }
+
+    PortQueue::Job job;
+    job.client = client;
+    job.request = request;
+
+    QVariantMap data;
+    data["port"] = portName;
+    // Queued comes first, even if the job starts (and reports) straight away.
+    data["position"] = queue(portName)->pending() + (queue(portName)->busy() ? 1 : 0);
+    reply(client, id, "queued", data);
+    queue(portName)->submit(job);
+}
@@ -0,0 +1,116 @@
+#ifndef FLASHDAEMON_H
+#define FLASHDAEMON_H
+
+#include <QObject>
+#include <QHash>
+#include <QQueue>
+#include <QPointer>
+#include <QVariantMap>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include "settings.h"
+
+class Programmer;
+class JobReporter;
+class VerifyProbe;
+
+/*
+ * One port's job queue. Jobs run strictly in the order they were submitted;
+ * different ports run at the same time, each on its own Programmer thread.
+ *
+ * The port stays open between jobs and the worker keeps the last parsed
+ * image, so a repeat flash of the same file skips both.
+ */
+class PortQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Job {
+        QPointer<QLocalSocket> client;
+        QVariantMap request;
+    };
+
+    explicit PortQueue(const QString &portName, QObject *parent = 0);
+    ~PortQueue();
+
+    void submit(const Job &job);
+    // Stops the running job and drops the waiting ones.
+    void cancel();
+
+    QString portName() const;
+    bool busy() const;
+    int pending() const;
+
+private slots:
+    void programmingDone(bool success);
+    void resetDone();
+    void verifyFinished();
+    void jobDone();
+
+private:
+    void next();
+    void runFlash();
+    void runReset();
+    void runVerify(bool afterFlash);
+    void reply(const Job &job, const QString &event, QVariantMap data = QVariantMap());
+    void applySettings(const QVariantMap &request);
+
+    QString m_portName;
+    Settings *m_settings;
+    Programmer *m_programmer;
+    JobReporter *m_reporter;
+    VerifyProbe *m_probe;
+
+    QQueue<Job> m_jobs;
+    Job m_current;
+    bool m_busy;
+};
+
+/*
+ * Flashing daemon. Clients connect to a QLocalServer and write requests,
+ * one JSON object per line:
+ *
+ *   {"id":1, "type":"flash", "port":"ttyUSB0", "hex":"/abs/path.hex",
+ *    "chip":"atmega328", "baud":57600, "reset":"rts",
+ *    "verify":"READY", "verifyBaud":9600, "verifyTimeout":3000}
+ *   {"id":2, "type":"reset", "port":"ttyUSB0"}
+ *   {"id":3, "type":"verify", "port":"ttyUSB0", "verify":"READY"}
+ *   {"id":4, "type":"cancel", "port":"ttyUSB0"}
+ *   {"id":5, "type":"ports"}
+ *
+ * Only type and port are required; chip, baud and reset default to the
+ * port's previous job. Replies are JSON lines carrying the request's id:
+ * "queued" with the position in the port's queue, then for flash jobs the
+ * progress lines of JobReporter, and a final "result".
+ */
+class FlashDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FlashDaemon(QObject *parent = 0);
+
+    bool listen(const QString &name);
+    QString errorString() const;
+
+    // Case insensitive names as on the command line, e.g. "atmega32u4" or
+    // "dtr". Return false for anything else.
+    static bool parseChip(const QString &name, Settings::Chip *chip);
+    static bool parseResetType(const QString &name, Settings::ResetType *resetType);
+
+private slots:
+    void newConnection();
+    void readClient();
+
+private:
+    void handle(QLocalSocket *client, const QByteArray &line);
+    void reply(QLocalSocket *client, const QVariant &id, const QString &event, QVariantMap data = QVariantMap());
+    PortQueue *queue(const QString &portName);
+
+    QLocalServer m_server;
+    QString m_error;
+    QHash<QString, PortQueue *> m_queues;
+};
+
+#endif // FLASHDAEMON_H
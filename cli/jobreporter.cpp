@@ -0,0 +1,118 @@
+#include "jobreporter.h"
+
+#include <QCoreApplication>
+#include <QMetaEnum>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+JobReporter::JobReporter(Programmer *programmer, QObject *parent) :
+    QObject(parent),
+    m_programmer(programmer),
+    m_resultEvent("result"),
+    m_active(false),
+    m_exitWhenDone(false),
+    m_lastProgress(-1),
+    m_resends(0)
+{
+    m_clock.start();
+
+    // The worker reports from its own thread; these are queued to ours so
+    // lines come out whole and in order.
+    connect(programmer, &Programmer::statusTextChanged, this, &JobReporter::statusChanged, Qt::QueuedConnection);
+    connect(programmer, &Programmer::progressChanged, this, &JobReporter::progressChanged, Qt::QueuedConnection);
+    connect(programmer, &Programmer::resendsChanged, this, &JobReporter::resendsChanged, Qt::QueuedConnection);
+    connect(programmer, &Programmer::programmingFinished, this, &JobReporter::finished, Qt::QueuedConnection);
+}
+
+void JobReporter::start(QIODevice *out, const QVariantMap &tag, const QString &resultEvent)
+{
+    m_out = out;
+    m_tag = tag;
+    m_resultEvent = resultEvent;
+    m_clock.start();
+    m_active = true;
+    m_lastProgress = -1;
+    m_resends = 0;
+}
+
+bool JobReporter::active() const
+{
+    return m_active;
+}
+
+void JobReporter::stop()
+{
+    m_active = false;
+    m_out = 0;
+}
+
+void JobReporter::setExitWhenDone(bool arg)
+{
+    m_exitWhenDone = arg;
+}
+
+void JobReporter::emitEvent(const QString &event, QVariantMap data)
+{
+    if (!m_out) return;
+
+    for (QVariantMap::const_iterator it = m_tag.constBegin(); it != m_tag.constEnd(); ++it)
+        data.insert(it.key(), it.value());
+    data["event"] = event;
+    data["time"] = m_clock.elapsed();
+    m_out->write(QJsonDocument(QJsonObject::fromVariantMap(data)).toJson(QJsonDocument::Compact) + "\n");
+}
+
+void JobReporter::statusChanged()
+{
+    if (!m_active) return;
+
+    const QMetaObject &meta = Programmer::staticMetaObject;
+    QMetaEnum status = meta.enumerator(meta.indexOfEnumerator("Status"));
+
+    QVariantMap data;
+    data["status"] = QString(status.valueToKey(m_programmer->status()));
+    data["text"] = m_programmer->statusText();
+    emitEvent("status", data);
+}
+
+void JobReporter::progressChanged()
+{
+    if (!m_active) return;
+
+    // One line per percent is plenty for anything reading this.
+    const qreal progress = m_programmer->progress();
+    if (m_lastProgress >= 0 && qAbs(progress - m_lastProgress) < 0.01 && progress < 1)
+        return;
+    m_lastProgress = progress;
+
+    QVariantMap data;
+    data["progress"] = progress;
+    data["address"] = m_programmer->currentAddress();
+    data["lastAddress"] = m_programmer->lastAddress();
+    emitEvent("progress", data);
+}
+
+void JobReporter::resendsChanged(int count)
+{
+    // The worker zeroes the count once it's done; keep the job's total.
+    if (count > m_resends) m_resends = count;
+}
+
+void JobReporter::finished(bool success)
+{
+    if (!m_active) return;
+    m_active = false;
+
+    QVariantMap data;
+    data["success"] = success;
+    data["resends"] = m_resends;
+    data["text"] = m_programmer->statusText();
+    data["job"] = m_programmer->job().toVariant();
+    if (!m_programmer->jobSummary().isEmpty())
+        data["summary"] = m_programmer->jobSummary();
+    emitEvent(m_resultEvent, data);
+
+    emit done(success);
+    if (m_exitWhenDone)
+        QCoreApplication::exit(success ? 0 : 1);
+}
@@ -0,0 +1,66 @@
+#ifndef JOBREPORTER_H
+#define JOBREPORTER_H
+
+#include <QObject>
+#include <QVariantMap>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QIODevice>
+#include "programmer.h"
+
+/*
+ * Turns a Programmer's signals into JSON, one object per line:
+ *
+ *   {"event":"status","status":"Connecting","text":"...","time":3}
+ *   {"event":"progress","progress":0.25,"address":2048,"lastAddress":8191,"time":410}
+ *   {"event":"result","success":true,"resends":0,"text":"Idle","job":{...},"time":1502}
+ *
+ * time is in ms since start(). job is the snapshot of settings the job ran
+ * with (FlashJob::toVariant()), enough to run it again exactly. Once any
+ * blocks were sent the result also has a summary (LinkStats::summary()).
+ * Every line also carries the tag given to start(), so a client with
+ * several jobs in flight can tell them apart. The output device may go
+ * away mid-job; the job carries on regardless.
+ */
+class JobReporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit JobReporter(Programmer *programmer, QObject *parent = 0);
+
+    // Begin reporting a job to out. The last line of a job is a result
+    // event, unless something follows the programming and will report the
+    // result itself; then give that line another name.
+    void start(QIODevice *out, const QVariantMap &tag = QVariantMap(), const QString &resultEvent = "result");
+    bool active() const;
+    // Forget the current job without reporting a result.
+    void stop();
+
+    // Quit the application once the result is out: 0 on success, 1 if not.
+    void setExitWhenDone(bool arg);
+
+    void emitEvent(const QString &event, QVariantMap data = QVariantMap());
+
+signals:
+    void done(bool success);
+
+public slots:
+    void statusChanged();
+    void progressChanged();
+    void resendsChanged(int count);
+    void finished(bool success);
+
+private:
+    Programmer *m_programmer;
+    QPointer<QIODevice> m_out;
+    QVariantMap m_tag;
+    QString m_resultEvent;
+    QElapsedTimer m_clock;
+    bool m_active;
+    bool m_exitWhenDone;
+    qreal m_lastProgress;
+    int m_resends;
+};
+
+#endif // JOBREPORTER_H
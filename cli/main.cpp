@@ -0,0 +1,186 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QUrl>
+#include <QSerialPortInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+
+#include "settings.h"
+#include "programmer.h"
+#include "jobreporter.h"
+#include "flashdaemon.h"
+#include "trace.h"
+
+#define DEFAULT_SOCKET "screamer"
+
+// Exit codes
+#define EXIT_OK 0
+#define EXIT_FAILED 1
+#define EXIT_USAGE 2
+
+static void usage(QTextStream &out)
+{
+    out << "Usage: screamer-cli --port NAME [options] FILE.hex\n"
+        << "       screamer-cli --daemon [--socket NAME]\n"
+        << "\n"
+        << "  -p, --port NAME      Serial port, e.g. ttyUSB0 or COM3\n"
+        << "  -c, --chip CHIP      atmega168, atmega328 (default) or atmega32u4\n"
+        << "  -b, --baud RATE      Programming baud rate (default 57600)\n"
+        << "  -r, --reset TYPE     rts (default), dtr or software\n"
+        << "  -l, --list-ports     Print the serial ports as JSON and exit\n"
+        << "  -d, --daemon         Take jobs over a local socket until killed\n"
+        << "  -s, --socket NAME    Socket name for --daemon (default " DEFAULT_SOCKET ")\n"
+        << "  -t, --trace FILE     Write a timeline of the job to FILE, as Chrome trace\n"
+        << "                       JSON for Perfetto or chrome://tracing\n"
+        << "  -h, --help           Show this help\n"
+        << "\n"
+        << "Progress and the result are written to stdout as one JSON object per line.\n"
+        << "Exits with 0 on success, 1 if programming failed, 2 on bad arguments.\n";
+    out.flush();
+}
+
+static int listPorts(QTextStream &out)
+{
+    foreach (const QSerialPortInfo &info, QSerialPortInfo::availablePorts()) {
+        QVariantMap port;
+        port["portName"] = info.portName();
+        port["systemLocation"] = info.systemLocation();
+        port["description"] = info.description();
+        port["manufacturer"] = info.manufacturer();
+        port["vendorId"] = info.hasVendorIdentifier() ? info.vendorIdentifier() : 0;
+        port["productId"] = info.hasProductIdentifier() ? info.productIdentifier() : 0;
+        out << QJsonDocument(QJsonObject::fromVariantMap(port)).toJson(QJsonDocument::Compact) << "\n";
+    }
+    out.flush();
+    return EXIT_OK;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QString portName;
+    QString hexPath;
+    Settings::Chip chip = Settings::Atmega328;
+    int baud = QSerialPort::Baud57600;
+    Settings::ResetType resetType = Settings::RTS;
+    bool daemon = false;
+    QString socketName = DEFAULT_SOCKET;
+    QString tracePath;
+
+    QStringList args = app.arguments().mid(1);
+    while (!args.isEmpty()) {
+        const QString arg = args.takeFirst();
+        const bool hasValue = !args.isEmpty();
+
+        if (arg == "-h" || arg == "--help") {
+            usage(out);
+            return EXIT_OK;
+        } else if (arg == "-l" || arg == "--list-ports") {
+            return listPorts(out);
+        } else if (arg == "-d" || arg == "--daemon") {
+            daemon = true;
+        } else if ((arg == "-s" || arg == "--socket") && hasValue) {
+            socketName = args.takeFirst();
+        } else if ((arg == "-t" || arg == "--trace") && hasValue) {
+            tracePath = args.takeFirst();
+        } else if ((arg == "-p" || arg == "--port") && hasValue) {
+            portName = args.takeFirst();
+        } else if ((arg == "-c" || arg == "--chip") && hasValue) {
+            const QString value = args.takeFirst();
+            if (!FlashDaemon::parseChip(value, &chip)) {
+                err << "Unknown chip: " << value << "\n";
+                return EXIT_USAGE;
+            }
+        } else if ((arg == "-b" || arg == "--baud") && hasValue) {
+            bool ok;
+            baud = args.takeFirst().toInt(&ok);
+            if (!ok || baud <= 0) {
+                err << "Bad baud rate\n";
+                return EXIT_USAGE;
+            }
+        } else if ((arg == "-r" || arg == "--reset") && hasValue) {
+            const QString value = args.takeFirst();
+            if (!FlashDaemon::parseResetType(value, &resetType)) {
+                err << "Unknown reset type: " << value << "\n";
+                return EXIT_USAGE;
+            }
+        } else if (!arg.startsWith("-") && hexPath.isEmpty()) {
+            hexPath = arg;
+        } else {
+            err << "Unexpected argument: " << arg << "\n";
+            usage(err);
+            return EXIT_USAGE;
+        }
+    }
+
+    if (daemon && !tracePath.isEmpty()) {
+        err << "--trace is for a single job, not --daemon\n";
+        return EXIT_USAGE;
+    }
+
+    if (daemon) {
+        FlashDaemon server;
+        if (!server.listen(socketName)) {
+            err << "Unable to listen on " << socketName << ": " << server.errorString() << "\n";
+            return EXIT_FAILED;
+        }
+        err << "Listening on " << socketName << "\n";
+        err.flush();
+        return app.exec();
+    }
+
+    if (portName.isEmpty() || hexPath.isEmpty()) {
+        usage(err);
+        return EXIT_USAGE;
+    }
+    if (!QFileInfo(hexPath).isFile()) {
+        err << "No such file: " << hexPath << "\n";
+        return EXIT_USAGE;
+    }
+
+    // Only what's on the command line; settings.txt is left alone.
+    Settings settings(0, false);
+    settings.setAutoOpenTerminal(false);
+    settings.setChip(chip);
+    settings.setBaudProgram((QSerialPort::BaudRate)baud);
+    settings.setResetType(resetType);
+    settings.setHexFile(QUrl::fromLocalFile(QFileInfo(hexPath).absoluteFilePath()));
+    settings.setPortName(portName);
+
+    // Unbuffered, so each line reaches a pipe as soon as it's written.
+    QFile stdoutFile;
+    stdoutFile.open(1, QIODevice::WriteOnly | QIODevice::Unbuffered);
+
+    Programmer programmer;
+    JobReporter reporter(&programmer);
+    reporter.setExitWhenDone(true);
+    reporter.start(&stdoutFile);
+
+    Trace::setEnabled(!tracePath.isEmpty());
+
+    // The GUI does this from QML as programming starts.
+    settings.setProgrammerActive(true);
+    programmer.programMicro(&settings);
+    if (!programmer.isProgramming()) {
+        QVariantMap data;
+        data["success"] = false;
+        data["text"] = QString("Port %1 could not be opened").arg(portName);
+        reporter.emitEvent("result", data);
+        return EXIT_FAILED;
+    }
+
+    const int code = app.exec();
+
+    QString error;
+    if (!tracePath.isEmpty() && !Trace::save(tracePath, &error)) {
+        err << "Unable to write " << tracePath << ": " << error << "\n";
+        return EXIT_FAILED;
+    }
+    return code;
+}
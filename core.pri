@@ -0,0 +1,24 @@
+# The programming core: hex images, the bootloader protocol, board resets,
+# asynchronous flashing, link statistics and tracing. Plain Qt Core and
+# Serial Port only, no QML, Settings or GUI, so it can be linked on its own
+# (see core/core.pro).
+
+QT += serialport
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/heximage.cpp \
+    $$PWD/bootloader.cpp \
+    $$PWD/resetprofile.cpp \
+    $$PWD/flasher.cpp \
+    $$PWD/linkstats.cpp \
+    $$PWD/trace.cpp
+
+HEADERS += \
+    $$PWD/heximage.h \
+    $$PWD/bootloader.h \
+    $$PWD/resetprofile.h \
+    $$PWD/flasher.h \
+    $$PWD/linkstats.h \
+    $$PWD/trace.h
@@ -0,0 +1,13 @@
+# Static library of Screamer's programming core, for test rigs and tools
+# that want to flash boards without the application.
+# Build: qmake && make, then link libscreamer-core and add the repository
+# root to the include path. Start with flasher.h.
+
+QT += core
+QT -= gui
+
+TARGET = screamer-core
+TEMPLATE = lib
+CONFIG += staticlib
+
+include(../core.pri)
@@ -0,0 +1,361 @@
+#include "flasher.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QSet>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSerialPort>
+#include <QElapsedTimer>
+#include "heximage.h"
+#include "trace.h"
+
+FlashJob::FlashJob() :
+    baudRate(QSerialPort::Baud57600),
+    memorySize(32768),
+    pageSize(128),
+    resetType(Bootloader::RTS),
+    logTraffic(true)
+{
+}
+
+QVariantMap FlashJob::toVariant() const
+{
+    QVariantMap map;
+    map["portName"] = portName;
+    map["baudRate"] = baudRate;
+    map["hexFile"] = hexFile;
+    map["memorySize"] = memorySize;
+    map["pageSize"] = pageSize;
+    map["resetType"] = (int)resetType;
+    map["resetProfile"] = resetProfile.toVariant();
+    map["logTraffic"] = logTraffic;
+    return map;
+}
+
+FlashJob FlashJob::fromVariant(const QVariantMap &map)
+{
+    FlashJob job;
+    job.portName = map.value("portName").toString();
+    job.baudRate = map.value("baudRate", job.baudRate).toInt();
+    job.hexFile = map.value("hexFile").toString();
+    job.memorySize = map.value("memorySize", job.memorySize).toInt();
+    job.pageSize = map.value("pageSize", job.pageSize).toInt();
+    job.resetType = (Bootloader::ResetType)map.value("resetType", (int)job.resetType).toInt();
+    job.resetProfile = ResetProfile::fromVariant(map.value("resetProfile").toMap());
+    job.logTraffic = map.value("logTraffic", job.logTraffic).toBool();
+    return job;
+}
+
+class FlasherThread : public QThread
+{
+public:
+    struct Entry {
+        int id;
+        FlashJob job;
+        Flasher::Listener *listener;
+        QSerialPort *port;
+    };
+
+    // Passes everything through, and adds the flasher's own cancellation.
+    class Forward : public Flasher::Listener
+    {
+    public:
+        Forward(FlasherThread *thread, const Entry &entry) :
+            m_thread(thread), m_id(entry.id), m_listener(entry.listener),
+            m_logTraffic(entry.job.logTraffic) {}
+
+        void stateChanged(Bootloader::State state, const QString &text) { m_listener->stateChanged(state, text); }
+        void progress(int address, int endAddress, qreal fraction) { m_listener->progress(address, endAddress, fraction); }
+        void blockResent(int address) { m_listener->blockResent(address); }
+        void blockAnswered(int address, int length, bool success, qint64 nsecs) { m_listener->blockAnswered(address, length, success, nsecs); }
+        void transmitted(const char *data, int length) { m_listener->transmitted(data, length); }
+        void received(const char *data, int length) { m_listener->received(data, length); }
+        void lineChanged(Bootloader::Line line, bool set) { m_listener->lineChanged(line, set); }
+        void imageLoaded(int startAddress, int endAddress) { m_listener->imageLoaded(startAddress, endAddress); }
+        void resetLatency(qreal msecs) { m_listener->resetLatency(msecs); }
+        void message(Bootloader::MessageLevel level, const QString &text)
+        {
+            if (level > Bootloader::DebugMessage || m_logTraffic)
+                m_listener->message(level, text);
+        }
+        bool cancelled() { return m_thread->isCancelled(m_id) || m_listener->cancelled(); }
+        void finished(int, bool, const QString &) {}
+
+    private:
+        FlasherThread *m_thread;
+        int m_id;
+        Flasher::Listener *m_listener;
+        bool m_logTraffic;
+    };
+
+    FlasherThread() : m_nextId(1), m_current(-1), m_stop(false), m_imageSize(-1) { setObjectName("Flasher"); }
+
+    int submit(const FlashJob &job, Flasher::Listener *listener, QSerialPort *port)
+    {
+        QMutexLocker lock(&m_mutex);
+        Entry entry;
+        entry.id = m_nextId++;
+        entry.job = job;
+        entry.listener = listener;
+        entry.port = port;
+        m_queue.enqueue(entry);
+        m_wake.wakeAll();
+        return entry.id;
+    }
+
+    // Only jobs still to finish are marked; run() unmarks each as it ends.
+    void cancel(int id)
+    {
+        QMutexLocker lock(&m_mutex);
+        if (id == m_current) {
+            m_cancelled.insert(id);
+            return;
+        }
+        foreach (const Entry &entry, m_queue) {
+            if (entry.id == id) {
+                m_cancelled.insert(id);
+                return;
+            }
+        }
+    }
+
+    void cancelAll()
+    {
+        QMutexLocker lock(&m_mutex);
+        foreach (const Entry &entry, m_queue)
+            m_cancelled.insert(entry.id);
+        if (m_current >= 0)
+            m_cancelled.insert(m_current);
+    }
+
+    void stop()
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_wake.wakeAll();
+    }
+
+    bool isCancelled(int id)
+    {
+        QMutexLocker lock(&m_mutex);
+        return m_cancelled.contains(id);
+    }
+
+    bool waitForDone(int msecs)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QMutexLocker lock(&m_mutex);
+        while (!m_queue.isEmpty() || m_current >= 0) {
+            if (msecs < 0) {
+                m_done.wait(&m_mutex);
+            } else {
+                const qint64 left = msecs - timer.elapsed();
+                if (left <= 0 || !m_done.wait(&m_mutex, left))
+                    return m_queue.isEmpty() && m_current < 0;
+            }
+        }
+        return true;
+    }
+
+    int pending()
+    {
+        QMutexLocker lock(&m_mutex);
+        return m_queue.size() + (m_current >= 0 ? 1 : 0);
+    }
+
+protected:
+    void run();
+
+private:
+    bool runJob(const Entry &entry, QString *error);
+    bool loadImage(const FlashJob &job, Bootloader::Listener *listener, QString *error);
+
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    QWaitCondition m_done;
+    QQueue<Entry> m_queue;
+    QSet<int> m_cancelled;
+    int m_nextId;
+    int m_current;
+    bool m_stop;
+
+    // Only touched on this thread.
+    HexImage m_image;
+    QString m_imageFile;
+    QDateTime m_imageModified;
+    qint64 m_imageSize;
+};
+
+void FlasherThread::run()
+{
+    forever {
+        Entry entry;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (m_queue.isEmpty() && !m_stop)
+                m_wake.wait(&m_mutex);
+            if (m_queue.isEmpty()) return;
+            entry = m_queue.dequeue();
+            m_current = entry.id;
+        }
+
+        QString error;
+        bool success = false;
+        if (isCancelled(entry.id))
+            error = "Cancelled";
+        else
+            success = runJob(entry, &error);
+
+        entry.listener->finished(entry.id, success, error);
+
+        QMutexLocker lock(&m_mutex);
+        m_cancelled.remove(entry.id);
+        m_current = -1;
+        m_done.wakeAll();
+    }
+}
+
+bool FlasherThread::loadImage(const FlashJob &job, Bootloader::Listener *listener, QString *error)
+{
+    QFileInfo info(job.hexFile);
+    if (info.absoluteFilePath() == m_imageFile && info.lastModified() == m_imageModified
+            && info.size() == m_imageSize && job.memorySize == m_image.capacity())
+        return true;
+
+    m_imageFile.clear();
+    if (m_image.capacity() != job.memorySize)
+        m_image.setCapacity(job.memorySize);
+
+    if (!m_image.load(job.hexFile)) {
+        *error = "Unable to load hex file. " + m_image.errorString();
+        return false;
+    }
+    foreach (const QString &warning, m_image.warnings())
+        listener->message(Bootloader::WarningMessage, warning);
+
+    m_imageFile = info.absoluteFilePath();
+    m_imageModified = info.lastModified();
+    m_imageSize = info.size();
+    return true;
+}
+
+// Reports a failure of the flasher's own the way Bootloader reports its.
+static bool fail(Bootloader::Listener *listener, const QString &error)
+{
+    listener->message(Bootloader::ErrorMessage, error);
+    listener->stateChanged(Bootloader::Error, error);
+    return false;
+}
+
+bool FlasherThread::runJob(const Entry &entry, QString *error)
+{
+    Trace::Scope scope("Flasher::job");
+    scope.setArg("id", entry.id);
+    const FlashJob &job = entry.job;
+    Forward listener(this, entry);
+
+    if (!loadImage(job, &listener, error))
+        return fail(&listener, *error);
+    listener.imageLoaded(m_image.startAddress(), m_image.endAddress());
+
+    QSerialPort ownPort;
+    QSerialPort *port = entry.port;
+    if (!port) {
+        ownPort.setPortName(job.portName);
+        if (!ownPort.open(QIODevice::ReadWrite)) {
+            *error = QString("Could not open %1: %2").arg(job.portName).arg(ownPort.errorString());
+            return fail(&listener, *error);
+        }
+        ownPort.setBaudRate(job.baudRate);
+        ownPort.setDataBits(QSerialPort::Data8);
+        ownPort.setParity(QSerialPort::NoParity);
+        ownPort.setStopBits(QSerialPort::OneStop);
+        ownPort.setFlowControl(QSerialPort::NoFlowControl);
+        port = &ownPort;
+    }
+    port->clear();
+
+    // Idle the reset line before pulsing it.
+    if (job.resetType == Bootloader::RTS) {
+        port->setRequestToSend(false);
+        listener.lineChanged(Bootloader::RequestToSend, false);
+    } else if (job.resetType == Bootloader::DTR) {
+        port->setDataTerminalReady(false);
+        listener.lineChanged(Bootloader::DataTerminalReady, false);
+    }
+
+    listener.message(Bootloader::InfoMessage, "Sending chip into program mode...");
+    listener.stateChanged(Bootloader::Connecting, "Waiting for target chip to broadcast boot.");
+
+    // The reset returns as soon as the broadcast arrives, within a deadline
+    // learnt from previous resets on this port.
+    QElapsedTimer resetTimer;
+    resetTimer.start();
+    qreal latency;
+    const bool ready = Bootloader::reset(port, job.resetType, job.resetProfile,
+                                         QByteArray(1, Bootloader::SlaveReady), 0, &listener, &latency);
+
+    Bootloader bootloader(port, &listener);
+    if (!bootloader.enterProgramMode(ready)) {
+        *error = bootloader.errorString();
+        return false;
+    }
+    // A broadcast later than the reset waited for is only seen now.
+    listener.resetLatency(ready ? latency : resetTimer.nsecsElapsed() / 1000000.0);
+
+    if (!bootloader.send(m_image, job.pageSize)) {
+        *error = bootloader.errorString();
+        return false;
+    }
+
+    // Let the new program start.
+    Bootloader::reset(port, job.resetType, job.resetProfile, QByteArray(), 0, &listener, &latency);
+    if (latency >= 0)
+        listener.resetLatency(latency);
+    listener.stateChanged(Bootloader::Idle, "Idle");
+    return true;
+}
+
+
+Flasher::Flasher() :
+    m_thread(new FlasherThread())
+{
+    m_thread->start();
+}
+
+Flasher::~Flasher()
+{
+    m_thread->cancelAll();
+    m_thread->stop();
+    m_thread->wait();
+    delete m_thread;
+}
+
+int Flasher::submit(const FlashJob &job, Listener *listener, QSerialPort *port)
+{
+    return m_thread->submit(job, listener, port);
+}
+
+void Flasher::cancel(int job)
+{
+    m_thread->cancel(job);
+}
+
+void Flasher::cancelAll()
+{
+    m_thread->cancelAll();
+}
+
+bool Flasher::waitForDone(int msecs)
+{
+    return m_thread->waitForDone(msecs);
+}
+
+int Flasher::pending() const
+{
+    return m_thread->pending();
+}
@@ -0,0 +1,87 @@
+#ifndef FLASHER_H
+#define FLASHER_H
+
+#include <QString>
+#include <QVariantMap>
+#include <QMetaType>
+#include "bootloader.h"
+#include "resetprofile.h"
+
+class QSerialPort;
+class FlasherThread;
+
+/*
+ * Everything a job needs to know, fixed when it is submitted. Copies are
+ * cheap, and a job can be logged with toVariant() and run again exactly as
+ * it was from fromVariant().
+ */
+struct FlashJob
+{
+    FlashJob();
+
+    QString portName;
+    qint32 baudRate;
+    QString hexFile;
+    int memorySize;     // bytes of flash on the chip
+    int pageSize;       // bytes per block
+    Bootloader::ResetType resetType;
+    ResetProfile resetProfile;
+    bool logTraffic;    // pass the per-frame debug messages on
+
+    QVariantMap toVariant() const;
+    static FlashJob fromVariant(const QVariantMap &map);
+};
+
+Q_DECLARE_METATYPE(FlashJob)
+
+/*
+ * Asynchronous flashing: the one pipeline every job goes through, from the
+ * GUI's Programmer to test rigs linking the core library.
+ *
+ * submit() returns straight away; jobs run one after another on the
+ * flasher's own thread, which opens the port, loads the image (reusing the
+ * last one while the file is unchanged), resets the board, sends the image
+ * and resets it again. Everything about a job is reported to its listener,
+ * on the flasher's thread, ending with exactly one finished() call.
+ *
+ * For several ports at once, use one Flasher per port.
+ */
+class Flasher
+{
+public:
+    class Listener : public Bootloader::Listener
+    {
+    public:
+        // The image's written range, once it is loaded or found unchanged.
+        virtual void imageLoaded(int /*startAddress*/, int /*endAddress*/) {}
+        // ms from a reset to the board answering, for the port's profile.
+        virtual void resetLatency(qreal /*msecs*/) {}
+        // The last callback for a job. error is empty on success.
+        virtual void finished(int job, bool success, const QString &error) = 0;
+    };
+
+    Flasher();
+    // Cancels whatever is left and waits for the thread.
+    ~Flasher();
+
+    // Returns the job's id. The listener must outlive the job. port, if
+    // given, is flashed through as it is instead of opening job.portName;
+    // it must be open, and left alone until the job finishes.
+    int submit(const FlashJob &job, Listener *listener, QSerialPort *port = 0);
+
+    // A queued job finishes unsuccessfully without running; a running one
+    // stops at the next block. Unknown and finished jobs are ignored.
+    void cancel(int job);
+    void cancelAll();
+
+    // False if msecs passed first. Negative waits for as long as it takes.
+    bool waitForDone(int msecs = -1);
+    int pending() const;
+
+private:
+    Q_DISABLE_COPY(Flasher)
+
+    FlasherThread *m_thread;
+};
+
+#endif // FLASHER_H
@@ -0,0 +1,276 @@
+#include "framedecoder.h"
+
+#include <string.h>
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+FrameDecoder *FrameDecoder::create(Type type, int maxFrameSize)
+{
+    switch (type) {
+    case Slip: return new SlipDecoder(maxFrameSize);
+    case Cobs: return new CobsDecoder(maxFrameSize);
+    case LengthPrefixed: return new LengthPrefixedDecoder(maxFrameSize);
+    default: return 0;
+    }
+}
+
+FrameDecoder::FrameDecoder(int maxFrameSize) :
+    m_buffer(qMax(1, maxFrameSize), 0),
+    m_length(0),
+    m_maxLength(qMax(1, maxFrameSize)),
+    m_discard(false),
+    m_listener(0),
+    m_frames(0),
+    m_errors(0)
+{
+    m_data = m_buffer.data();
+}
+
+FrameDecoder::~FrameDecoder()
+{
+}
+
+void FrameDecoder::reset()
+{
+    m_length = 0;
+    m_discard = false;
+}
+
+void FrameDecoder::setListener(Listener *listener)
+{
+    m_listener = listener;
+}
+
+int FrameDecoder::frames() const
+{
+    return m_frames;
+}
+
+int FrameDecoder::errors() const
+{
+    return m_errors;
+}
+
+void FrameDecoder::emitFrame()
+{
+    ++m_frames;
+    if (m_listener)
+        m_listener->frameDecoded(m_data, m_length);
+    m_length = 0;
+}
+
+void FrameDecoder::error()
+{
+    // Throw away the rest of this frame; the next delimiter resynchronises.
+    ++m_errors;
+    m_length = 0;
+    m_discard = true;
+}
+
+
+SlipDecoder::SlipDecoder(int maxFrameSize) :
+    FrameDecoder(maxFrameSize),
+    m_escape(false)
+{
+}
+
+void SlipDecoder::reset()
+{
+    FrameDecoder::reset();
+    m_escape = false;
+}
+
+void SlipDecoder::decode(const char *data, int length)
+{
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(data);
+    for (int i = 0; i < length; ++i) {
+        unsigned char b = src[i];
+
+        if (b == SLIP_END) {
+            if (!m_discard && !m_escape && m_length > 0)
+                emitFrame();
+            else if (m_escape)
+                error();
+            m_length = 0;
+            m_discard = false;
+            m_escape = false;
+            continue;
+        }
+
+        if (m_discard) continue;
+
+        if (m_escape) {
+            m_escape = false;
+            if (b == SLIP_ESC_END) b = SLIP_END;
+            else if (b == SLIP_ESC_ESC) b = SLIP_ESC;
+            else { error(); continue; }
+        } else if (b == SLIP_ESC) {
+            m_escape = true;
+            continue;
+        }
+
+        push((char)b);
+    }
+}
+
+
+CobsDecoder::CobsDecoder(int maxFrameSize) :
+    FrameDecoder(maxFrameSize),
+    m_code(0),
+    m_remaining(0),
+    m_pendingZero(false)
+{
+}
+
+void CobsDecoder::reset()
+{
+    FrameDecoder::reset();
+    m_code = 0;
+    m_remaining = 0;
+    m_pendingZero = false;
+}
+
+void CobsDecoder::decode(const char *data, int length)
+{
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(data);
+    for (int i = 0; i < length; ++i) {
+        const unsigned char b = src[i];
+
+        if (b == 0) {
+            // Delimiter. The zero implied by the last block isn't part of the frame.
+            if (!m_discard && m_code != 0) {
+                if (m_remaining == 0)
+                    emitFrame();
+                else
+                    error();
+            }
+            m_length = 0;
+            m_discard = false;
+            m_code = 0;
+            m_remaining = 0;
+            m_pendingZero = false;
+            continue;
+        }
+
+        if (m_discard) continue;
+
+        if (m_remaining == 0) {
+            // Code byte: the previous block ended with an implied zero.
+            if (m_pendingZero && !push(0)) continue;
+            m_code = b;
+            m_remaining = b - 1;
+            m_pendingZero = (m_remaining == 0 && m_code < 0xFF);
+            continue;
+        }
+
+        if (!push((char)b)) continue;
+        if (--m_remaining == 0)
+            m_pendingZero = (m_code < 0xFF);
+    }
+}
+
+
+static quint16 s_crcTable[256];
+
+static bool initCrcTable()
+{
+    for (int i = 0; i < 256; ++i) {
+        quint16 crc = quint16(i << 8);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x8000) ? quint16((crc << 1) ^ 0x1021) : quint16(crc << 1);
+        s_crcTable[i] = crc;
+    }
+    return true;
+}
+
+static const bool s_crcTableReady = initCrcTable();
+
+LengthPrefixedDecoder::LengthPrefixedDecoder(int maxFrameSize) :
+    FrameDecoder(maxFrameSize),
+    m_state(Hunt),
+    m_expected(0),
+    m_crc(0xFFFF),
+    m_received(0)
+{
+    Q_UNUSED(s_crcTableReady);
+}
+
+void LengthPrefixedDecoder::reset()
+{
+    FrameDecoder::reset();
+    m_state = Hunt;
+    m_expected = 0;
+}
+
+quint16 LengthPrefixedDecoder::crc16(quint16 crc, const char *data, int length)
+{
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(data);
+    for (int i = 0; i < length; ++i)
+        crc = quint16((crc << 8) ^ s_crcTable[((crc >> 8) ^ src[i]) & 0xFF]);
+    return crc;
+}
+
+void LengthPrefixedDecoder::decode(const char *data, int length)
+{
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(data);
+    for (int i = 0; i < length; ++i) {
+        const unsigned char b = src[i];
+
+        switch (m_state) {
+        case Hunt:
+            if (b == Sync) {
+                m_length = 0;
+                m_discard = false;
+                m_crc = 0xFFFF;
+                m_state = LengthLow;
+            }
+            break;
+
+        case LengthLow:
+            m_expected = b;
+            m_crc = quint16((m_crc << 8) ^ s_crcTable[((m_crc >> 8) ^ b) & 0xFF]);
+            m_state = LengthHigh;
+            break;
+
+        case LengthHigh:
+            m_expected |= b << 8;
+            m_crc = quint16((m_crc << 8) ^ s_crcTable[((m_crc >> 8) ^ b) & 0xFF]);
+            if (m_expected > m_maxLength) {
+                error();
+                m_state = Hunt;
+            } else {
+                m_state = m_expected > 0 ? Payload : CrcLow;
+            }
+            break;
+
+        case Payload: {
+            // Copy as much of the payload as this chunk holds in one go.
+            int count = qMin(m_expected - m_length, length - i);
+            memcpy(m_data + m_length, src + i, count);
+            m_crc = crc16(m_crc, reinterpret_cast<const char *>(src + i), count);
+            m_length += count;
+            i += count - 1;
+            if (m_length == m_expected)
+                m_state = CrcLow;
+            break;
+        }
+
+        case CrcLow:
+            m_received = b;
+            m_state = CrcHigh;
+            break;
+
+        case CrcHigh:
+            m_received |= quint16(b << 8);
+            if (m_received == m_crc)
+                emitFrame();
+            else
+                error();
+            m_state = Hunt;
+            break;
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <QByteArray>
+
+/*
+ * Incremental decoders for framed binary streams.
+ *
+ * Bytes are fed in whatever chunks the port hands us; a frame may be split
+ * across any number of calls. Frames are decoded into a buffer allocated once
+ * at construction and passed to the listener as a pointer and length, so the
+ * steady state does no heap allocation at all. The listener must copy the
+ * bytes if it wants to keep them.
+ */
+class FrameDecoder
+{
+public:
+    enum Type { None=0, Slip=1, Cobs=2, LengthPrefixed=3 };
+
+    class Listener
+    {
+    public:
+        virtual ~Listener() {}
+        virtual void frameDecoded(const char *data, int length) = 0;
+    };
+
+    // Returns 0 for None.
+    static FrameDecoder *create(Type type, int maxFrameSize = 4096);
+
+    explicit FrameDecoder(int maxFrameSize);
+    virtual ~FrameDecoder();
+
+    virtual Type type() const = 0;
+    virtual void decode(const char *data, int length) = 0;
+    virtual void reset();
+
+    void setListener(Listener *listener);
+
+    int frames() const;
+    int errors() const;
+
+protected:
+    inline bool push(char b);
+    void emitFrame();
+    void error();
+
+    QByteArray m_buffer;
+    char *m_data;
+    int m_length;
+    int m_maxLength;
+    bool m_discard;
+
+private:
+    Listener *m_listener;
+    int m_frames;
+    int m_errors;
+};
+
+bool FrameDecoder::push(char b)
+{
+    if (m_length >= m_maxLength) {
+        error();
+        return false;
+    }
+    m_data[m_length++] = b;
+    return true;
+}
+
+/*
+ * SLIP (RFC 1055). 0xC0 ends a frame, 0xDB escapes 0xC0/0xDB as 0xDB 0xDC and
+ * 0xDB 0xDD.
+ */
+class SlipDecoder : public FrameDecoder
+{
+public:
+    explicit SlipDecoder(int maxFrameSize);
+
+    Type type() const { return Slip; }
+    void decode(const char *data, int length);
+    void reset();
+
+private:
+    bool m_escape;
+};
+
+/*
+ * Consistent Overhead Byte Stuffing, 0x00 delimited.
+ */
+class CobsDecoder : public FrameDecoder
+{
+public:
+    explicit CobsDecoder(int maxFrameSize);
+
+    Type type() const { return Cobs; }
+    void decode(const char *data, int length);
+    void reset();
+
+private:
+    int m_code;
+    int m_remaining;
+    bool m_pendingZero;
+};
+
+/*
+ * 0xA5, quint16 little endian payload length, payload, then a little endian
+ * CRC-16/CCITT-FALSE over the length and payload bytes. After a bad length
+ * or CRC the decoder hunts for the next sync byte.
+ */
+class LengthPrefixedDecoder : public FrameDecoder
+{
+public:
+    explicit LengthPrefixedDecoder(int maxFrameSize);
+
+    Type type() const { return LengthPrefixed; }
+    void decode(const char *data, int length);
+    void reset();
+
+    static const unsigned char Sync = 0xA5;
+    static quint16 crc16(quint16 crc, const char *data, int length);
+
+private:
+    enum State { Hunt, LengthLow, LengthHigh, Payload, CrcLow, CrcHigh };
+
+    State m_state;
+    int m_expected;
+    quint16 m_crc;
+    quint16 m_received;
+};
+
+#endif // FRAMEDECODER_H
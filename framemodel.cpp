@@ -0,0 +1,126 @@
+#include "framemodel.h"
+
+#include <string.h>
+#include "hexformatter.h"
+
+FrameModel::FrameModel(int capacity, QObject *parent) :
+    QAbstractListModel(parent),
+    m_frames(capacity),
+    m_staged(capacity),
+    m_total(0)
+{
+}
+
+void FrameModel::store(Frame &frame, const char *data, int length)
+{
+    // Shrinking an unshared QByteArray keeps its allocation.
+    frame.data.resize(length);
+    if (length > 0)
+        memcpy(frame.data.data(), data, length);
+}
+
+void FrameModel::append(const char *data, int length, qint64 timestamp)
+{
+    Frame &frame = m_staged.append();
+    frame.index = m_total++;
+    frame.timestamp = timestamp;
+    store(frame, data, length);
+}
+
+void FrameModel::commit()
+{
+    const int added = m_staged.size();
+    if (added == 0) return;
+
+    const int overflow = m_frames.size() + added - m_frames.capacity();
+    if (overflow > 0) {
+        const int removed = qMin(overflow, m_frames.size());
+        beginRemoveRows(QModelIndex(), 0, removed - 1);
+        m_frames.removeFirst(removed);
+        endRemoveRows();
+    }
+
+    const int first = m_frames.size();
+    beginInsertRows(QModelIndex(), first, first + added - 1);
+    for (int i = 0; i < added; ++i) {
+        Frame &staged = m_staged[i];
+        Frame &frame = m_frames.append();
+        frame.index = staged.index;
+        frame.timestamp = staged.timestamp;
+        // Moved, not copied: the staged slot gets the recycled buffer.
+        frame.data.swap(staged.data);
+    }
+    endInsertRows();
+
+    m_staged.removeFirst(added);
+    emit countChanged();
+}
+
+void FrameModel::clear()
+{
+    beginResetModel();
+    m_frames.removeFirst(m_frames.size());
+    m_staged.removeFirst(m_staged.size());
+    endResetModel();
+    emit countChanged();
+}
+
+int FrameModel::count() const
+{
+    return m_frames.size();
+}
+
+int FrameModel::total() const
+{
+    return m_total;
+}
+
+int FrameModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) return 0;
+    return m_frames.size();
+}
+
+QVariant FrameModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_frames.size())
+        return QVariant();
+
+    const Frame &frame = m_frames.at(index.row());
+    switch (role) {
+    case IndexRole:
+        return frame.index;
+    case TimestampRole:
+        return frame.timestamp;
+    case LengthRole:
+        return frame.data.size();
+    case HexRole: {
+        QByteArray hex;
+        HexFormatter formatter(HexFormatter::Hex, frame.data.size());
+        formatter.format(frame.data, &hex);
+        // Just the bytes: drop the gutter and trailing newline.
+        return QString::fromLatin1(hex.mid(10).trimmed());
+    }
+    case Qt::DisplayRole:
+    case TextRole: {
+        QByteArray text = frame.data;
+        for (int i = 0; i < text.size(); ++i) {
+            if ((unsigned char)text[i] < 0x20 || (unsigned char)text[i] > 0x7E)
+                text[i] = '.';
+        }
+        return QString::fromLatin1(text);
+    }
+    }
+    return QVariant();
+}
+
+QHash<int, QByteArray> FrameModel::roleNames() const
+{
+    QHash<int, QByteArray> roles;
+    roles[IndexRole] = "frameIndex";
+    roles[TimestampRole] = "timestamp";
+    roles[LengthRole] = "length";
+    roles[HexRole] = "hex";
+    roles[TextRole] = "text";
+    return roles;
+}
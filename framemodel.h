@@ -0,0 +1,65 @@
+#ifndef FRAMEMODEL_H
+#define FRAMEMODEL_H
+
+#include <QAbstractListModel>
+#include <QByteArray>
+#include "ringbuffer.h"
+
+/*
+ * The most recent decoded frames, for display in QML.
+ *
+ * Frames are staged with append() as they are decoded and handed to views in
+ * one batch by commit(), which moves their buffers across rather than copying
+ * them. Slots are recycled once the model is full, so the frame buffers stop
+ * allocating once they've grown to the typical frame size.
+ */
+class FrameModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(int total READ total NOTIFY countChanged)
+
+public:
+    enum Roles {
+        IndexRole = Qt::UserRole + 1,
+        TimestampRole,
+        LengthRole,
+        HexRole,
+        TextRole
+    };
+
+    explicit FrameModel(int capacity = 1000, QObject *parent = 0);
+
+    void append(const char *data, int length, qint64 timestamp);
+    void commit();
+
+    Q_INVOKABLE void clear();
+
+    int count() const;
+    int total() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role) const;
+    QHash<int, QByteArray> roleNames() const;
+
+signals:
+    void countChanged();
+
+private:
+    struct Frame {
+        Frame() : index(0), timestamp(0) {}
+
+        int index;
+        qint64 timestamp;
+        QByteArray data;
+    };
+
+    static void store(Frame &frame, const char *data, int length);
+
+    RingBuffer<Frame> m_frames;
+    RingBuffer<Frame> m_staged;
+    int m_total;
+};
+
+#endif // FRAMEMODEL_H
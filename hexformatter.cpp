@@ -0,0 +1,153 @@
+#include "hexformatter.h"
+
+#define GUTTER_WIDTH 10 // 8 digits + 2 spaces
+
+static const char s_hexTable[] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static const char s_decTable[] =
+    "  0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19 20 21 22 23"
+    " 24 25 26 27 28 29 30 31 32 33 34 35 36 37 38 39 40 41 42 43 44 45 46 47"
+    " 48 49 50 51 52 53 54 55 56 57 58 59 60 61 62 63 64 65 66 67 68 69 70 71"
+    " 72 73 74 75 76 77 78 79 80 81 82 83 84 85 86 87 88 89 90 91 92 93 94 95"
+    " 96 97 98 99100101102103104105106107108109110111112113114115116117118119"
+    "120121122123124125126127128129130131132133134135136137138139140141142143"
+    "144145146147148149150151152153154155156157158159160161162163164165166167"
+    "168169170171172173174175176177178179180181182183184185186187188189190191"
+    "192193194195196197198199200201202203204205206207208209210211212213214215"
+    "216217218219220221222223224225226227228229230231232233234235236237238239"
+    "240241242243244245246247248249250251252253254255";
+
+HexFormatter::HexFormatter(Mode mode, int bytesPerRow) :
+    m_mode(mode),
+    m_bytesPerRow(qMax(1, bytesPerRow)),
+    m_column(0),
+    m_offset(0)
+{
+}
+
+HexFormatter::Mode HexFormatter::mode() const
+{
+    return m_mode;
+}
+
+void HexFormatter::setMode(Mode mode)
+{
+    m_mode = mode;
+}
+
+int HexFormatter::bytesPerRow() const
+{
+    return m_bytesPerRow;
+}
+
+void HexFormatter::setBytesPerRow(int bytesPerRow)
+{
+    m_bytesPerRow = qMax(1, bytesPerRow);
+    m_column = 0;
+}
+
+qint64 HexFormatter::offset() const
+{
+    return m_offset;
+}
+
+void HexFormatter::format(const QByteArray &data, QByteArray *out)
+{
+    format(data.constData(), data.size(), out);
+}
+
+void HexFormatter::format(const char *data, int length, QByteArray *out)
+{
+    if (length <= 0) return;
+
+    const int start = out->size();
+    out->resize(start + maxFormattedSize(length));
+
+    char *begin = out->data();
+    char *dst = begin + start;
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *end = src + length;
+    const int split = m_bytesPerRow / 2;
+
+    while (src != end) {
+        if (m_column == 0)
+            dst = writeGutter(dst);
+        else if (m_column == split)
+            *dst++ = ' ';
+
+        const unsigned char b = *src++;
+        if (m_mode == Hex) {
+            const char *digits = s_hexTable + 2*b;
+            dst[0] = digits[0];
+            dst[1] = digits[1];
+            dst[2] = ' ';
+            dst += 3;
+        } else {
+            const char *digits = s_decTable + 3*b;
+            dst[0] = digits[0];
+            dst[1] = digits[1];
+            dst[2] = digits[2];
+            dst[3] = ' ';
+            dst += 4;
+        }
+
+        ++m_offset;
+        if (++m_column == m_bytesPerRow) {
+            *dst++ = '\n';
+            m_column = 0;
+        }
+    }
+
+    out->resize(dst - begin);
+}
+
+void HexFormatter::finishRow(QByteArray *out)
+{
+    if (m_column == 0) return;
+    out->append('\n');
+    m_column = 0;
+}
+
+void HexFormatter::reset()
+{
+    m_column = 0;
+    m_offset = 0;
+}
+
+int HexFormatter::maxFormattedSize(int length) const
+{
+    const int cellWidth = (m_mode == Hex) ? 3 : 4;
+    const int rows = length / m_bytesPerRow + 2;
+    return length * cellWidth + rows * (GUTTER_WIDTH + 2);
+}
+
+const char *HexFormatter::hexDigits(unsigned char b)
+{
+    return s_hexTable + 2*b;
+}
+
+const char *HexFormatter::decDigits(unsigned char b)
+{
+    return s_decTable + 3*b;
+}
+
+char *HexFormatter::writeGutter(char *dst) const
+{
+    const quint32 offset = (quint32)m_offset;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        const char *digits = s_hexTable + 2*((offset >> shift) & 0xFF);
+        *dst++ = digits[0];
+        *dst++ = digits[1];
+    }
+    *dst++ = ' ';
+    *dst++ = ' ';
+    return dst;
+}
@@ -0,0 +1,58 @@
+#ifndef HEXFORMATTER_H
+#define HEXFORMATTER_H
+
+#include <QByteArray>
+
+/*
+ * Streaming formatter for the terminal's Hex and Dec display modes.
+ *
+ * Bytes are laid out in fixed-width rows, each prefixed by an offset gutter:
+ *   00000010  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 0d 0a 00 ff
+ * A row may be split across several calls to format(), so incoming chunks can
+ * be appended to the display as they arrive. Every byte is converted through a
+ * lookup table and written straight into the caller's buffer, which only grows
+ * when its existing capacity is too small.
+ */
+class HexFormatter
+{
+public:
+    enum Mode { Hex, Dec };
+
+    explicit HexFormatter(Mode mode = Hex, int bytesPerRow = 16);
+
+    Mode mode() const;
+    void setMode(Mode mode);
+
+    int bytesPerRow() const;
+    void setBytesPerRow(int bytesPerRow);
+
+    qint64 offset() const;
+
+    // Append the formatted bytes to the end of out.
+    void format(const char *data, int length, QByteArray *out);
+    void format(const QByteArray &data, QByteArray *out);
+
+    // Terminate a partially filled row so the next byte starts a new one.
+    void finishRow(QByteArray *out);
+
+    // Start again from offset 0 on a fresh row.
+    void reset();
+
+    // Upper bound of the bytes format() appends for length input bytes.
+    int maxFormattedSize(int length) const;
+
+    // Two lowercase hex digits for b.
+    static const char *hexDigits(unsigned char b);
+    // Three decimal digits for b, right aligned and padded with spaces.
+    static const char *decDigits(unsigned char b);
+
+private:
+    char *writeGutter(char *dst) const;
+
+    Mode m_mode;
+    int m_bytesPerRow;
+    int m_column;
+    qint64 m_offset;
+};
+
+#endif // HEXFORMATTER_H
@@ -0,0 +1,211 @@
+#include "heximage.h"
+
+#include <QFile>
+#include <string.h>
+#include "trace.h"
+
+#define RECORD_DATA 0x00
+#define RECORD_EOF 0x01
+#define RECORD_SEGMENT 0x02
+#define RECORD_START_SEGMENT 0x03
+#define RECORD_LINEAR 0x04
+#define RECORD_START_LINEAR 0x05
+
+// Longest record: byte count, two address bytes, type, 255 data bytes and
+// the checksum.
+#define MAX_RECORD_BYTES (4 + 255 + 1)
+
+// Value of each hex digit, or -1.
+static signed char s_digits[256];
+
+static bool initDigits()
+{
+    memset(s_digits, -1, sizeof(s_digits));
+    for (int i = 0; i < 10; ++i) s_digits['0' + i] = (signed char)i;
+    for (int i = 0; i < 6; ++i) {
+        s_digits['a' + i] = (signed char)(10 + i);
+        s_digits['A' + i] = (signed char)(10 + i);
+    }
+    return true;
+}
+
+static const bool s_digitsReady = initDigits();
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+HexImage::HexImage(int capacity) :
+    m_data(qMax(0, capacity), (char)0xFF),
+    m_start(-1),
+    m_end(-1)
+{
+    Q_UNUSED(s_digitsReady);
+}
+
+int HexImage::capacity() const
+{
+    return m_data.size();
+}
+
+void HexImage::setCapacity(int capacity)
+{
+    m_data = QByteArray(qMax(0, capacity), (char)0xFF);
+    clear();
+}
+
+void HexImage::clear()
+{
+    m_data.fill((char)0xFF);
+    m_start = -1;
+    m_end = -1;
+    m_error.clear();
+    m_warnings.clear();
+}
+
+bool HexImage::load(const QString &path)
+{
+    TRACE_SCOPE("HexImage::load");
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        clear();
+        m_error = QString("Could not open %1: %2").arg(path).arg(file.errorString());
+        return false;
+    }
+    return parse(file.readAll());
+}
+
+bool HexImage::parse(const QByteArray &text)
+{
+    return parse(text.constData(), text.size());
+}
+
+bool HexImage::fail(int lineNumber, const QString &message)
+{
+    m_error = QString("Line %1: %2").arg(lineNumber).arg(message);
+    m_start = -1;
+    m_end = -1;
+    return false;
+}
+
+bool HexImage::parse(const char *text, int length)
+{
+    clear();
+
+    unsigned char record[MAX_RECORD_BYTES];
+    char *image = m_data.data();
+    const int capacity = m_data.size();
+    quint32 base = 0;
+
+    const char *p = text;
+    const char *end = text + length;
+    int lineNumber = 0;
+
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        const char *line = p;
+        const char *lineEnd = eol;
+        p = eol + 1;
+        ++lineNumber;
+
+        while (line < lineEnd && isSpace(*line)) ++line;
+        while (lineEnd > line && isSpace(lineEnd[-1])) --lineEnd;
+        if (line == lineEnd) continue;
+
+        if (*line == 'S')
+            return fail(lineNumber, "Motorola S format not supported.");
+        if (*line != ':') continue;
+        ++line;
+
+        const int digits = int(lineEnd - line);
+        if (digits % 2 != 0 || digits < 10 || digits / 2 > MAX_RECORD_BYTES)
+            return fail(lineNumber, "Malformed record.");
+
+        const int count = digits / 2;
+        unsigned int sum = 0;
+        for (int i = 0; i < count; ++i) {
+            const int high = s_digits[(unsigned char)line[2*i]];
+            const int low = s_digits[(unsigned char)line[2*i + 1]];
+            if (high < 0 || low < 0)
+                return fail(lineNumber, "Malformed record.");
+            record[i] = (unsigned char)((high << 4) | low);
+            sum += record[i];
+        }
+
+        const int byteCount = record[0];
+        if (count != byteCount + 5)
+            return fail(lineNumber, "Record length doesn't match its byte count.");
+        if ((sum & 0xFF) != 0)
+            return fail(lineNumber, "Checksum mismatch.");
+
+        const quint32 address = base + ((quint32)record[1] << 8) + record[2];
+        const unsigned char *payload = record + 4;
+
+        switch (record[3]) {
+        case RECORD_DATA:
+            if (byteCount == 0) break;
+            // Not address + byteCount, which wraps under a 04 record near 4 GB.
+            if (address >= (quint32)capacity || (quint32)byteCount > (quint32)capacity - address)
+                return fail(lineNumber, QString("Address 0x%1 is out of memory (size %2).")
+                            .arg(qint64(address) + byteCount - 1, 0, 16).arg(capacity));
+            memcpy(image + address, payload, byteCount);
+            if (m_start < 0 || int(address) < m_start) m_start = int(address);
+            if (int(address) + byteCount - 1 > m_end) m_end = int(address) + byteCount - 1;
+            break;
+
+        case RECORD_EOF:
+            return true;
+
+        case RECORD_SEGMENT:
+        case RECORD_LINEAR:
+            if (byteCount != 2)
+                return fail(lineNumber, "Malformed address record.");
+            base = ((quint32)payload[0] << 8) | payload[1];
+            base <<= (record[3] == RECORD_SEGMENT) ? 4 : 16;
+            break;
+
+        case RECORD_START_SEGMENT:
+        case RECORD_START_LINEAR:
+            // The bootloader always starts at the reset vector.
+            break;
+
+        default:
+            m_warnings << QString("Line %1: Unknown record type %2, skipped.").arg(lineNumber).arg(record[3]);
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool HexImage::isEmpty() const
+{
+    return m_end < 0;
+}
+
+const QByteArray &HexImage::data() const
+{
+    return m_data;
+}
+
+int HexImage::startAddress() const
+{
+    return m_start;
+}
+
+int HexImage::endAddress() const
+{
+    return m_end;
+}
+
+QString HexImage::errorString() const
+{
+    return m_error;
+}
+
+QStringList HexImage::warnings() const
+{
+    return m_warnings;
+}
@@ -0,0 +1,55 @@
+#ifndef HEXIMAGE_H
+#define HEXIMAGE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+/*
+ * A program image read from an Intel hex file.
+ *
+ * The image is a flat buffer the size of the chip's flash, erased to 0xFF,
+ * with the records written in at their addresses. Extended segment (02) and
+ * extended linear (04) address records move the base for the records after
+ * them. Every record's checksum is checked; a bad record, an address past
+ * the end of the buffer or a Motorola S file fails the whole parse.
+ *
+ * Records are decoded straight from the bytes with a lookup table, so a
+ * parse costs about one pass over the file and no allocation besides the
+ * buffer itself.
+ */
+class HexImage
+{
+public:
+    explicit HexImage(int capacity = 32768);
+
+    int capacity() const;
+    // Also clears the image.
+    void setCapacity(int capacity);
+
+    bool load(const QString &path);
+    bool parse(const QByteArray &text);
+    bool parse(const char *text, int length);
+    void clear();
+
+    bool isEmpty() const;
+    const QByteArray &data() const;
+    // First and last address written, inclusive. -1 when empty.
+    int startAddress() const;
+    int endAddress() const;
+
+    QString errorString() const;
+    // Things worth mentioning that didn't stop the parse.
+    QStringList warnings() const;
+
+private:
+    bool fail(int lineNumber, const QString &message);
+
+    QByteArray m_data;
+    int m_start;
+    int m_end;
+    QString m_error;
+    QStringList m_warnings;
+};
+
+#endif // HEXIMAGE_H
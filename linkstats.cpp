@@ -0,0 +1,123 @@
+#include "linkstats.h"
+
+LinkStats::LinkStats()
+{
+    clear();
+}
+
+void LinkStats::clear(int total)
+{
+    for (int i = 0; i < Buckets; ++i)
+        m_buckets[i].store(0);
+    m_blocks.store(0);
+    m_failures.store(0);
+    m_bytes.store(0);
+    m_elapsed.store(0);
+    m_total.store(total);
+}
+
+void LinkStats::record(int bytes, qint64 nsecs, bool success)
+{
+    m_buckets[bucket(nsecs)].fetchAndAddRelaxed(1);
+    m_blocks.fetchAndAddRelaxed(1);
+    m_elapsed.fetchAndAddRelaxed(qMax(Q_INT64_C(1), nsecs / 1000));
+    if (success)
+        m_bytes.fetchAndAddRelaxed(bytes);
+    else
+        m_failures.fetchAndAddRelaxed(1);
+}
+
+int LinkStats::blocks() const
+{
+    return m_blocks.load();
+}
+
+int LinkStats::failures() const
+{
+    return m_failures.load();
+}
+
+int LinkStats::bytes() const
+{
+    return m_bytes.load();
+}
+
+int LinkStats::total() const
+{
+    return m_total.load();
+}
+
+qreal LinkStats::throughput() const
+{
+    const qint64 elapsed = m_elapsed.load();
+    return elapsed > 0 ? m_bytes.load() * 1e6 / elapsed : 0;
+}
+
+qreal LinkStats::percentile(qreal fraction) const
+{
+    int counts[Buckets];
+    qint64 count = 0;
+    for (int i = 0; i < Buckets; ++i) {
+        counts[i] = m_buckets[i].load();
+        count += counts[i];
+    }
+    if (count == 0) return 0;
+
+    const qint64 rank = qMax(Q_INT64_C(1), qint64(fraction * count + 0.5));
+    qint64 seen = 0;
+    for (int i = 0; i < Buckets; ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+            return bucketLimit(i) / 1000.0;
+    }
+    return bucketLimit(Buckets - 1) / 1000.0;
+}
+
+qreal LinkStats::resendRate() const
+{
+    const int blocks = m_blocks.load();
+    return blocks > 0 ? qreal(m_failures.load()) / blocks : 0;
+}
+
+qreal LinkStats::eta() const
+{
+    const qreal rate = throughput();
+    const int left = m_total.load() - m_bytes.load();
+    if (rate <= 0 || m_total.load() <= 0) return -1;
+    return qMax(0, left) / rate;
+}
+
+QVariantMap LinkStats::summary() const
+{
+    QVariantMap map;
+    map["bytes"] = bytes();
+    map["blocks"] = blocks();
+    map["resends"] = failures();
+    map["resendRate"] = resendRate();
+    map["throughput"] = throughput();
+    map["rttP50"] = percentile(0.5);
+    map["rttP99"] = percentile(0.99);
+    map["sendSeconds"] = m_elapsed.load() / 1e6;
+    return map;
+}
+
+int LinkStats::bucket(qint64 nsecs)
+{
+    const qint64 us = qMax(Q_INT64_C(1), nsecs / 1000);
+    if (us < 4) return int(us);
+
+    // Four buckets per power of two, from the two bits below the top one.
+    int top = 2;
+    while (top < 62 && (us >> (top + 1)) != 0)
+        ++top;
+    const int sub = int(us >> (top - 2)) & 3;
+    return qMin(int(Buckets) - 1, top * 4 + sub);
+}
+
+qint64 LinkStats::bucketLimit(int bucket)
+{
+    if (bucket < 4) return (bucket + 1) * Q_INT64_C(1000);
+    const int top = bucket / 4;
+    const int sub = bucket % 4;
+    return ((Q_INT64_C(5) + sub) << (top - 2)) * 1000;
+}
@@ -0,0 +1,59 @@
+#ifndef LINKSTATS_H
+#define LINKSTATS_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QVariantMap>
+
+/*
+ * Block round trip statistics for one programming job.
+ *
+ * One thread (the one sending) records each block's write to ack time;
+ * any other thread may read at any moment. Everything is a plain atomic
+ * counter, so neither side ever waits on the other. Round trips go into a
+ * log scaled histogram with four buckets per power of two microseconds,
+ * so percentiles are within 25% whatever the range, and each comes back
+ * as the upper bound of its bucket.
+ */
+class LinkStats
+{
+public:
+    LinkStats();
+
+    // Writer only, before the job's first block. total is the bytes the
+    // job will send, for eta().
+    void clear(int total = 0);
+    void record(int bytes, qint64 nsecs, bool success);
+
+    int blocks() const;     // answered, either way
+    int failures() const;
+    int bytes() const;      // acknowledged
+    int total() const;
+
+    // Bytes acknowledged per second of round trip time; the send loop is
+    // lock step, so that is the send rate.
+    qreal throughput() const;
+    // ms, 0 before the first block.
+    qreal percentile(qreal fraction) const;
+    qreal resendRate() const;
+    // Seconds to send what's left at the current rate, -1 if unknown.
+    qreal eta() const;
+
+    QVariantMap summary() const;
+
+private:
+    enum { Buckets = 112 };
+
+    static int bucket(qint64 nsecs);
+    static qint64 bucketLimit(int bucket);
+
+    QAtomicInt m_buckets[Buckets];
+    QAtomicInt m_blocks;
+    QAtomicInt m_failures;
+    QAtomicInt m_bytes;
+    QAtomicInt m_total;
+    // us of round trips, summed; 32 bits would only last 35 minutes.
+    QAtomicInteger<qint64> m_elapsed;
+};
+
+#endif // LINKSTATS_H
@@ -0,0 +1,129 @@
+#include "log.h"
+
+#define LOG_QUEUE_SIZE 4096
+#define LOG_CAPACITY 5000
+#define LOG_FLUSH_INTERVAL 100
+
+Log::Log(QObject *parent) :
+    QObject(parent),
+    m_queue(LOG_QUEUE_SIZE),
+    m_entries(LOG_CAPACITY),
+    m_level(Debug),
+    m_dirty(false)
+{
+    m_clock.start();
+
+    m_timer.setInterval(LOG_FLUSH_INTERVAL);
+    m_timer.setSingleShot(false);
+    m_timer.start();
+    connect(&m_timer, &QTimer::timeout, this, &Log::flush);
+}
+
+void Log::write(Level level, const QString &text)
+{
+    LogEntry entry;
+    entry.level = level;
+    entry.timestamp = m_clock.elapsed();
+    entry.text = text;
+
+    if (!m_queue.tryPush(entry))
+        m_dropped.fetchAndAddRelaxed(1);
+}
+
+void Log::flush()
+{
+    bool added = false;
+
+    int dropped = m_dropped.fetchAndStoreRelaxed(0);
+    LogEntry entry;
+    while (m_queue.tryPop(&entry)) {
+        m_entries.append(entry);
+        added = true;
+    }
+
+    if (dropped > 0) {
+        entry.level = Warning;
+        entry.timestamp = m_clock.elapsed();
+        entry.text = QString("\n[%1 log messages dropped]\n").arg(dropped);
+        m_entries.append(entry);
+        added = true;
+    }
+
+    if (!added) return;
+
+    m_dirty = true;
+    emit changed();
+}
+
+void Log::clear()
+{
+    LogEntry entry;
+    while (m_queue.tryPop(&entry)) {}
+
+    m_entries.clear();
+    m_text.clear();
+    m_dirty = false;
+    emit changed();
+}
+
+QString Log::text() const
+{
+    if (m_dirty) render();
+    return m_text;
+}
+
+void Log::render() const
+{
+    int length = 0;
+    for (int i = 0; i < m_entries.size(); ++i) {
+        if (m_entries.at(i).level >= m_level)
+            length += m_entries.at(i).text.length();
+    }
+
+    m_text.clear();
+    m_text.reserve(length);
+    for (int i = 0; i < m_entries.size(); ++i) {
+        const LogEntry &entry = m_entries.at(i);
+        if (entry.level >= m_level)
+            m_text.append(entry.text);
+    }
+    m_dirty = false;
+}
+
+Log::Level Log::level() const
+{
+    return m_level;
+}
+
+void Log::setLevel(Log::Level arg)
+{
+    if (m_level == arg) return;
+    m_level = arg;
+    m_dirty = true;
+    emit levelChanged(arg);
+    emit changed();
+}
+
+int Log::capacity() const
+{
+    return m_entries.capacity();
+}
+
+void Log::setCapacity(int arg)
+{
+    if (m_entries.capacity() == arg) return;
+    m_entries.setCapacity(arg);
+    m_dirty = true;
+    emit capacityChanged(m_entries.capacity());
+    emit changed();
+}
+
+int Log::flushInterval() const
+{
+    return m_timer.interval();
+}
+
+void Log::setFlushInterval(int msec)
+{
+    m_timer.setInterval(msec);
+}
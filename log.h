@@ -0,0 +1,85 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include "ringbuffer.h"
+#include "boundedqueue.h"
+
+struct LogEntry
+{
+    LogEntry() : level(0), timestamp(0) {}
+
+    int level;
+    qint64 timestamp; // ms since the log was created
+    QString text;
+};
+
+/*
+ * Bounded, batched log.
+ *
+ * write() may be called from any thread and never blocks: entries go onto a
+ * lock-free queue and are dropped (and counted) if it is full. The owning
+ * thread drains the queue on a timer into a fixed capacity ring buffer, so at
+ * most one changed() notification is emitted per flush interval no matter how
+ * many lines are written, and memory stays bounded however long the session.
+ */
+class Log : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QString text READ text NOTIFY changed)
+    Q_PROPERTY(Level level READ level WRITE setLevel NOTIFY levelChanged)
+    Q_PROPERTY(int capacity READ capacity WRITE setCapacity NOTIFY capacityChanged)
+
+    Q_ENUMS(Level)
+
+public:
+    enum Level { Debug=0, Info=1, Warning=2, Error=3 };
+
+    explicit Log(QObject *parent = 0);
+
+    // Thread safe.
+    void write(Level level, const QString &text);
+
+    Q_INVOKABLE void clear();
+
+    QString text() const;
+
+    Level level() const;
+    void setLevel(Level arg);
+
+    int capacity() const;
+    void setCapacity(int arg);
+
+    int flushInterval() const;
+    void setFlushInterval(int msec);
+
+signals:
+    void changed();
+    void levelChanged(Level arg);
+    void capacityChanged(int arg);
+
+public slots:
+    void flush();
+
+private:
+    void render() const;
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+
+    BoundedQueue<LogEntry> m_queue;
+    QAtomicInt m_dropped;
+
+    RingBuffer<LogEntry> m_entries;
+    Level m_level;
+
+    mutable QString m_text;
+    mutable bool m_dirty;
+};
+
+#endif // LOG_H
@@ -6,17 +6,42 @@
 #include "settings.h"
 #include "programmer.h"
 #include "terminal.h"
+#include "log.h"
+#include "triggerengine.h"
+#include "framemodel.h"
+#include "telemetry.h"
+#include "transmitqueue.h"
+#include "testscript.h"
+#include "multiterminal.h"
+#include "scrollbackindex.h"
+#include "portdiscovery.h"
+#include "productionline.h"
+#include "trace.h"
 #include <QSerialPort>
 
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
+    // SCREAMER_TRACE=file.json records a timeline of every job, written on exit.
+    const QString tracePath = QString::fromLocal8Bit(qgetenv("SCREAMER_TRACE"));
+    Trace::setEnabled(!tracePath.isEmpty());
+
     qRegisterMetaType<Programmer::Status>("Status");
     qmlRegisterType<Programmer>("Screamer", 1,0, "Programmer");
     qmlRegisterType<Terminal>("Screamer", 1,0, "Terminal");
+    qmlRegisterType<MultiTerminal>("Screamer", 1,0, "MultiTerminal");
+    qmlRegisterType<PortDiscovery>("Screamer", 1,0, "PortDiscovery");
+    qmlRegisterType<ProductionLine>("Screamer", 1,0, "ProductionLine");
     qmlRegisterType<Settings>("Screamer", 1,0, "Settings");
     qmlRegisterType<QSerialPort>("Screamer", 1,0, "Serial");
+    qmlRegisterUncreatableType<Log>("Screamer", 1,0, "Log", "Log is owned by Settings");
+    qmlRegisterUncreatableType<TriggerEngine>("Screamer", 1,0, "TriggerEngine", "Use Terminal.triggers");
+    qmlRegisterUncreatableType<FrameModel>("Screamer", 1,0, "FrameModel", "Use Terminal.frames");
+    qmlRegisterUncreatableType<Telemetry>("Screamer", 1,0, "Telemetry", "Use Terminal.telemetry");
+    qmlRegisterUncreatableType<TransmitQueue>("Screamer", 1,0, "TransmitQueue", "Use Terminal.transmit");
+    qmlRegisterUncreatableType<TestScript>("Screamer", 1,0, "TestScript", "Use Terminal.script");
+    qmlRegisterUncreatableType<ScrollbackIndex>("Screamer", 1,0, "ScrollbackIndex", "Use Terminal.scrollback");
 
     QQmlEngine engine;
     QQmlComponent component(&engine);
@@ -33,5 +58,10 @@ int main(int argc, char *argv[])
     }
     QObject::connect(&engine, SIGNAL(quit()), &app, SLOT(quit()));
     window->show();
-    return app.exec();
+    const int code = app.exec();
+
+    QString error;
+    if (!tracePath.isEmpty() && !Trace::save(tracePath, &error))
+        qWarning("Unable to write %s: %s", qPrintable(tracePath), qPrintable(error));
+    return code;
 }
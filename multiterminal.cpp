@@ -0,0 +1,321 @@
+#include "multiterminal.h"
+
+#include <QSerialPort>
+#include <QDebug>
+#include <algorithm>
+#include <string.h>
+
+#define MULTI_POLL_INTERVAL 50
+// How long a line waits before being merged, in ns.
+#define MULTI_HOLDBACK 20000000LL
+// A partial line is shown anyway once it is this old (ns) or this long.
+#define MULTI_PARTIAL_TIMEOUT 200000000LL
+#define MULTI_MAX_LINE 1024
+#define MULTI_QUEUE_SIZE 256
+#define MULTI_READ_SIZE 4096
+#define MULTI_SESSION_LINES 2000
+#define MULTI_MERGED_LINES 5000
+
+SessionReader::SessionReader(const QString &portName, int baudRate, const QElapsedTimer &clock) :
+    m_portName(portName),
+    m_baudRate(baudRate),
+    m_clock(clock),
+    m_queue(MULTI_QUEUE_SIZE)
+{
+}
+
+void SessionReader::stop()
+{
+    m_stop.storeRelease(1);
+    wait();
+}
+
+void SessionReader::run()
+{
+    QSerialPort port(m_portName);
+    if (!port.open(QIODevice::ReadWrite)) {
+        setError(port.errorString());
+        return;
+    }
+    port.setBaudRate(m_baudRate);
+    port.setDataBits(QSerialPort::Data8);
+    port.setParity(QSerialPort::NoParity);
+    port.setStopBits(QSerialPort::OneStop);
+    port.setFlowControl(QSerialPort::NoFlowControl);
+
+    while (!m_stop.loadAcquire()) {
+        if (!port.waitForReadyRead(MULTI_POLL_INTERVAL)) {
+            if (port.error() != QSerialPort::NoError && port.error() != QSerialPort::TimeoutError) {
+                setError(port.errorString());
+                break;
+            }
+            continue;
+        }
+
+        // Stamp before reading so the time is as close to arrival as we can get.
+        const qint64 now = m_clock.nsecsElapsed();
+        while (port.bytesAvailable() > 0) {
+            MultiTerminal::Chunk chunk;
+            chunk.timestamp = now;
+            chunk.data = port.read(MULTI_READ_SIZE);
+            if (!m_queue.tryPush(chunk))
+                m_dropped.fetchAndAddRelaxed(chunk.data.size());
+        }
+    }
+
+    port.close();
+}
+
+QString SessionReader::errorString() const
+{
+    QMutexLocker lock(&m_errorMutex);
+    return m_errorString;
+}
+
+void SessionReader::setError(const QString &message)
+{
+    QMutexLocker lock(&m_errorMutex);
+    m_errorString = message;
+}
+
+
+MultiTerminal::Session::Session() :
+    reader(0),
+    partialTimestamp(0),
+    lines(MULTI_SESSION_LINES)
+{
+}
+
+MultiTerminal::MultiTerminal(QObject *parent) :
+    QObject(parent),
+    m_lines(MULTI_MERGED_LINES),
+    m_dirty(false)
+{
+    m_clock.start();
+
+    m_timer.setInterval(MULTI_POLL_INTERVAL);
+    m_timer.setSingleShot(false);
+    connect(&m_timer, &QTimer::timeout, this, &MultiTerminal::poll);
+}
+
+MultiTerminal::~MultiTerminal()
+{
+    removeAll();
+}
+
+bool MultiTerminal::addPort(QString portName, int baudRate)
+{
+    if (portName.isEmpty() || indexOf(portName) >= 0) return false;
+
+    Session *session = new Session();
+    session->portName = portName;
+    session->reader = new SessionReader(portName, baudRate, m_clock);
+    session->reader->start();
+    m_sessions.append(session);
+
+    if (!m_timer.isActive())
+        m_timer.start();
+
+    emit portsChanged();
+    return true;
+}
+
+void MultiTerminal::removePort(QString portName)
+{
+    const int index = indexOf(portName);
+    if (index < 0) return;
+
+    // Pick up whatever it had already read before letting it go.
+    poll();
+
+    Session *session = m_sessions.at(index);
+    session->reader->stop();
+    delete session->reader;
+    delete session;
+    m_sessions.remove(index);
+
+    // Pending lines refer to sessions by index.
+    for (int i = m_pending.size() - 1; i >= 0; --i) {
+        if (m_pending.at(i).session == index)
+            m_pending.remove(i);
+        else if (m_pending.at(i).session > index)
+            --m_pending[i].session;
+    }
+
+    if (m_sessions.isEmpty())
+        m_timer.stop();
+
+    emit portsChanged();
+}
+
+void MultiTerminal::removeAll()
+{
+    while (!m_sessions.isEmpty())
+        removePort(m_sessions.last()->portName);
+}
+
+bool MultiTerminal::lineBefore(const Line &a, const Line &b)
+{
+    return a.timestamp < b.timestamp;
+}
+
+void MultiTerminal::takeLine(int session, qint64 timestamp, const QByteArray &data)
+{
+    int length = data.size();
+    if (length > 0 && data.at(length - 1) == '\r') --length;
+
+    Line line;
+    line.timestamp = timestamp;
+    line.session = session;
+    line.text = QString::fromLocal8Bit(data.constData(), length);
+    m_pending.append(line);
+}
+
+void MultiTerminal::poll()
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    bool errorsChanged = false;
+
+    for (int s = 0; s < m_sessions.size(); ++s) {
+        Session *session = m_sessions.at(s);
+
+        Chunk chunk;
+        while (session->reader->queue().tryPop(&chunk)) {
+            const char *p = chunk.data.constData();
+            const char *end = p + chunk.data.size();
+            while (p < end) {
+                if (session->partial.isEmpty())
+                    session->partialTimestamp = chunk.timestamp;
+
+                const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+                const char *stop = newline ? newline : end;
+                const int room = MULTI_MAX_LINE - session->partial.size();
+                session->partial.append(p, qMin(int(stop - p), room));
+                p = newline ? newline + 1 : end;
+
+                if (newline || session->partial.size() >= MULTI_MAX_LINE) {
+                    takeLine(s, session->partialTimestamp, session->partial);
+                    session->partial.resize(0);
+                }
+            }
+        }
+
+        // Don't sit on a prompt or a line without an ending forever.
+        if (!session->partial.isEmpty() && now - session->partialTimestamp > MULTI_PARTIAL_TIMEOUT) {
+            takeLine(s, session->partialTimestamp, session->partial);
+            session->partial.resize(0);
+        }
+
+        const QString error = session->reader->errorString();
+        if (error != session->error) {
+            session->error = error;
+            errorsChanged = true;
+        }
+
+        const int dropped = session->reader->takeDropped();
+        if (dropped > 0) {
+            Line line;
+            line.timestamp = now;
+            line.session = s;
+            line.text = QString("[%1 bytes dropped]").arg(dropped);
+            m_pending.append(line);
+        }
+    }
+
+    if (errorsChanged)
+        emit portsChanged();
+
+    if (m_pending.isEmpty()) return;
+
+    // Each session's lines are already in order; only the interleaving
+    // needs sorting, and the pending list is short.
+    std::stable_sort(m_pending.begin(), m_pending.end(), lineBefore);
+
+    int ready = 0;
+    while (ready < m_pending.size() && m_pending.at(ready).timestamp <= now - MULTI_HOLDBACK)
+        ++ready;
+    if (ready == 0) return;
+
+    for (int i = 0; i < ready; ++i) {
+        // Both histories share the one formatted string.
+        const QString text = format(m_pending.at(i));
+        m_lines.append(text);
+        m_sessions.at(m_pending.at(i).session)->lines.append(text);
+    }
+    m_pending.remove(0, ready);
+
+    m_dirty = true;
+    emit textChanged();
+}
+
+QString MultiTerminal::format(const Line &line) const
+{
+    return QString("%1 [%2] %3")
+            .arg(line.timestamp / 1e9, 0, 'f', 6)
+            .arg(m_sessions.at(line.session)->portName)
+            .arg(line.text);
+}
+
+QString MultiTerminal::text() const
+{
+    if (!m_dirty) return m_text;
+
+    m_text.clear();
+    for (int i = 0; i < m_lines.size(); ++i) {
+        m_text += m_lines.at(i);
+        m_text += '\n';
+    }
+    m_dirty = false;
+    return m_text;
+}
+
+QString MultiTerminal::portText(QString portName) const
+{
+    const int index = indexOf(portName);
+    if (index < 0) return QString();
+
+    const RingBuffer<QString> &lines = m_sessions.at(index)->lines;
+    QString text;
+    for (int i = 0; i < lines.size(); ++i) {
+        text += lines.at(i);
+        text += '\n';
+    }
+    return text;
+}
+
+QString MultiTerminal::portError(QString portName) const
+{
+    const int index = indexOf(portName);
+    if (index < 0) return QString();
+    return m_sessions.at(index)->error;
+}
+
+void MultiTerminal::clear()
+{
+    m_pending.clear();
+    m_lines.clear();
+    for (int i = 0; i < m_sessions.size(); ++i) {
+        m_sessions.at(i)->lines.clear();
+        m_sessions.at(i)->partial.resize(0);
+    }
+    m_text.clear();
+    m_dirty = false;
+    emit textChanged();
+}
+
+QStringList MultiTerminal::ports() const
+{
+    QStringList names;
+    for (int i = 0; i < m_sessions.size(); ++i)
+        names << m_sessions.at(i)->portName;
+    return names;
+}
+
+int MultiTerminal::indexOf(const QString &portName) const
+{
+    for (int i = 0; i < m_sessions.size(); ++i) {
+        if (m_sessions.at(i)->portName == portName)
+            return i;
+    }
+    return -1;
+}
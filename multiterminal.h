@@ -0,0 +1,137 @@
+#ifndef MULTITERMINAL_H
+#define MULTITERMINAL_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QThread>
+#include "ringbuffer.h"
+#include "boundedqueue.h"
+
+class SessionReader;
+
+/*
+ * Watches several serial ports at once and interleaves what they print.
+ *
+ * Each port is opened and read on its own thread, so a slow or stalled port
+ * never holds up the others. Readers stamp every chunk with a monotonic clock
+ * shared by all sessions and push it onto a fixed size lock-free queue; the
+ * GUI thread drains the queues, splits chunks into lines and merges the lines
+ * from all ports by arrival time.
+ *
+ * Lines are held back for a short moment before being merged so that a line
+ * stamped just before a poll but queued just after it still lands in order.
+ *
+ * Memory is bounded per session (queue, partial line and line history) and
+ * for the merged view; when a reader outruns the queue it drops chunks and
+ * the drop is reported inline.
+ */
+class MultiTerminal : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QStringList ports READ ports NOTIFY portsChanged)
+    Q_PROPERTY(QString text READ text NOTIFY textChanged)
+
+public:
+    explicit MultiTerminal(QObject *parent = 0);
+    ~MultiTerminal();
+
+    Q_INVOKABLE bool addPort(QString portName, int baudRate);
+    Q_INVOKABLE void removePort(QString portName);
+    Q_INVOKABLE void removeAll();
+
+    Q_INVOKABLE QString portText(QString portName) const;
+    Q_INVOKABLE QString portError(QString portName) const;
+    Q_INVOKABLE void clear();
+
+    QStringList ports() const;
+
+    // Merged view of all ports, oldest first.
+    QString text() const;
+
+    struct Chunk {
+        Chunk() : timestamp(0) {}
+        qint64 timestamp;  // ns on the shared clock
+        QByteArray data;
+    };
+
+signals:
+    void portsChanged();
+    void textChanged();
+
+private slots:
+    void poll();
+
+private:
+    struct Line {
+        Line() : timestamp(0), session(0) {}
+        qint64 timestamp;
+        int session;
+        QString text;
+    };
+
+    struct Session {
+        Session();
+        QString portName;
+        SessionReader *reader;
+        QByteArray partial;
+        qint64 partialTimestamp;
+        RingBuffer<QString> lines;
+        QString error;
+    };
+
+    static bool lineBefore(const Line &a, const Line &b);
+    void takeLine(int session, qint64 timestamp, const QByteArray &data);
+    QString format(const Line &line) const;
+    int indexOf(const QString &portName) const;
+
+    QVector<Session *> m_sessions;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+
+    QVector<Line> m_pending;
+    RingBuffer<QString> m_lines;
+
+    mutable QString m_text;
+    mutable bool m_dirty;
+};
+
+/*
+ * Owns one open port for the life of the thread. Only the queue, the drop
+ * counter and the error string are touched from outside it.
+ */
+class SessionReader : public QThread
+{
+public:
+    SessionReader(const QString &portName, int baudRate, const QElapsedTimer &clock);
+
+    void stop();
+
+    BoundedQueue<MultiTerminal::Chunk> &queue() { return m_queue; }
+    int takeDropped() { return m_dropped.fetchAndStoreRelaxed(0); }
+    QString errorString() const;
+
+protected:
+    void run();
+
+private:
+    void setError(const QString &message);
+
+    QString m_portName;
+    int m_baudRate;
+    QElapsedTimer m_clock;
+
+    BoundedQueue<MultiTerminal::Chunk> m_queue;
+    QAtomicInt m_dropped;
+    QAtomicInt m_stop;
+
+    mutable QMutex m_errorMutex;
+    QString m_errorString;
+};
+
+#endif // MULTITERMINAL_H
@@ -0,0 +1,203 @@
+#include "portdiscovery.h"
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QSerialPort>
+#include <QDebug>
+#include <algorithm>
+#include "settings.h"
+#include "util.h"
+
+#define SLAVE_READY ((char)0x05)
+#define DISCOVERY_WAIT_STEP 50
+
+class DiscoveryProbe : public QThread
+{
+public:
+    DiscoveryProbe(const QString &portName, Settings *settings, const QElapsedTimer &clock, int deadline) :
+        m_portName(portName),
+        m_settings(settings),
+        m_clock(clock),
+        m_deadline(deadline),
+        m_answered(false),
+        m_latency(0)
+    {
+    }
+
+    void cancel() { m_cancel.storeRelease(1); }
+
+    QString m_portName;
+    Settings *m_settings;
+    QElapsedTimer m_clock;
+    int m_deadline;
+
+    bool m_answered;
+    qreal m_latency;
+    QString m_error;
+
+protected:
+    void run();
+
+private:
+    QAtomicInt m_cancel;
+};
+
+void DiscoveryProbe::run()
+{
+    QSerialPort port(m_portName);
+    if (!port.open(QIODevice::ReadWrite)) {
+        m_error = port.errorString();
+        return;
+    }
+    port.setBaudRate(m_settings->baudProgram());
+    port.setDataBits(QSerialPort::Data8);
+    port.setParity(QSerialPort::NoParity);
+    port.setStopBits(QSerialPort::OneStop);
+    port.setFlowControl(QSerialPort::NoFlowControl);
+    port.clear();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // The reset returns as soon as the broadcast shows up, or once the
+    // port's own deadline passes; a slow board still gets the rest of ours.
+    QByteArray received;
+    m_answered = Util::resetMicro(&port, m_settings, QByteArray(1, SLAVE_READY), &received);
+
+    while (!m_answered && !m_cancel.loadAcquire() && m_clock.elapsed() < m_deadline) {
+        if (port.waitForReadyRead(DISCOVERY_WAIT_STEP)) {
+            received.append(port.readAll());
+            m_answered = received.indexOf(SLAVE_READY) >= 0;
+        }
+    }
+
+    if (m_answered)
+        m_latency = timer.nsecsElapsed() / 1000000.0;
+    port.close();
+}
+
+static bool resultBefore(const QVariant &a, const QVariant &b)
+{
+    const QVariantMap x = a.toMap();
+    const QVariantMap y = b.toMap();
+    if (x.value("answered").toBool() != y.value("answered").toBool())
+        return x.value("answered").toBool();
+    if (x.value("answered").toBool())
+        return x.value("latency").toReal() < y.value("latency").toReal();
+    return x.value("portName").toString() < y.value("portName").toString();
+}
+
+PortDiscovery::PortDiscovery(QObject *parent) :
+    QObject(parent)
+{
+}
+
+PortDiscovery::~PortDiscovery()
+{
+    for (int i = 0; i < m_probes.size(); ++i) {
+        m_probes.at(i)->cancel();
+        m_probes.at(i)->wait();
+        delete m_probes.at(i);
+    }
+}
+
+bool PortDiscovery::start(Settings *settings, int deadline)
+{
+    if (!settings || running()) return false;
+
+    if (settings->programmerActive()) {
+        settings->writeLogLn("Can't search for targets while programming.", Log::Warning);
+        return false;
+    }
+
+    m_results.clear();
+    m_answered.clear();
+    m_clock.start();
+
+    QStringList ports = settings->availablePorts();
+    for (int i = 0; i < ports.size(); ++i) {
+        if (settings->terminalActive() && ports.at(i) == settings->portName()) {
+            QVariantMap result;
+            result["portName"] = ports.at(i);
+            result["answered"] = false;
+            result["latency"] = 0;
+            result["error"] = QString("In use by the terminal");
+            m_results.append(result);
+            continue;
+        }
+
+        DiscoveryProbe *probe = new DiscoveryProbe(ports.at(i), settings, m_clock, deadline);
+        connect(probe, &QThread::finished, this, &PortDiscovery::probeFinished);
+        m_probes.append(probe);
+    }
+
+    settings->writeLogLn(QString("Searching %1 ports for a target...").arg(m_probes.size()));
+    emit resultsChanged();
+
+    if (m_probes.isEmpty()) {
+        emit finished(m_answered);
+        return false;
+    }
+
+    // Only start once they're all created, so none get a head start.
+    for (int i = 0; i < m_probes.size(); ++i)
+        m_probes.at(i)->start();
+    emit runningChanged(true);
+    return true;
+}
+
+void PortDiscovery::cancel()
+{
+    for (int i = 0; i < m_probes.size(); ++i)
+        m_probes.at(i)->cancel();
+}
+
+void PortDiscovery::probeFinished()
+{
+    // Collect every probe that has finished so far.
+    for (int i = m_probes.size() - 1; i >= 0; --i) {
+        DiscoveryProbe *probe = m_probes.at(i);
+        if (!probe->isFinished()) continue;
+
+        probe->wait();
+        QVariantMap result;
+        result["portName"] = probe->m_portName;
+        result["answered"] = probe->m_answered;
+        result["latency"] = probe->m_latency;
+        result["error"] = probe->m_error;
+        m_results.append(result);
+
+        delete probe;
+        m_probes.remove(i);
+    }
+
+    std::stable_sort(m_results.begin(), m_results.end(), resultBefore);
+    m_answered.clear();
+    for (int i = 0; i < m_results.size(); ++i) {
+        const QVariantMap result = m_results.at(i).toMap();
+        if (result.value("answered").toBool())
+            m_answered << result.value("portName").toString();
+    }
+    emit resultsChanged();
+
+    if (m_probes.isEmpty()) {
+        qDebug() << "Discovery finished in" << m_clock.elapsed() << "ms:" << m_answered;
+        emit runningChanged(false);
+        emit finished(m_answered);
+    }
+}
+
+bool PortDiscovery::running() const
+{
+    return !m_probes.isEmpty();
+}
+
+QVariantList PortDiscovery::results() const
+{
+    return m_results;
+}
+
+QStringList PortDiscovery::answered() const
+{
+    return m_answered;
+}
@@ -0,0 +1,65 @@
+#ifndef PORTDISCOVERY_H
+#define PORTDISCOVERY_H
+
+#include <QObject>
+#include <QVector>
+#include <QVariantList>
+#include <QStringList>
+#include <QElapsedTimer>
+
+class Settings;
+class DiscoveryProbe;
+
+/*
+ * Finds which port has a target sitting in its bootloader.
+ *
+ * Every candidate port is probed at the same time, each on its own thread:
+ * open at the programming baud rate, reset with the configured reset type
+ * and that port's reset profile, then listen for the slave_ready broadcast
+ * until the deadline. A scan takes about one reset cycle however many ports
+ * there are.
+ *
+ * The probes only reset the boards; nothing is sent once the broadcast is
+ * seen, so the bootloader times out and starts the application as usual.
+ */
+class PortDiscovery : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(QVariantList results READ results NOTIFY resultsChanged)
+    Q_PROPERTY(QStringList answered READ answered NOTIFY resultsChanged)
+
+public:
+    explicit PortDiscovery(QObject *parent = 0);
+    ~PortDiscovery();
+
+    // Probes settings->availablePorts(), skipping any port the terminal or
+    // programmer has open. deadline is in ms from the start of the scan.
+    Q_INVOKABLE bool start(Settings *settings, int deadline = 2000);
+    Q_INVOKABLE void cancel();
+
+    bool running() const;
+
+    // One map per port probed: portName, answered, latency (ms), error.
+    // Ports that answered come first, fastest first.
+    QVariantList results() const;
+    QStringList answered() const;
+
+signals:
+    void runningChanged(bool arg);
+    void resultsChanged();
+    // Emitted when a scan ends, with the ports that answered, fastest first.
+    void finished(QStringList answered);
+
+private slots:
+    void probeFinished();
+
+private:
+    QVector<DiscoveryProbe *> m_probes;
+    QVariantList m_results;
+    QStringList m_answered;
+    QElapsedTimer m_clock;
+};
+
+#endif // PORTDISCOVERY_H
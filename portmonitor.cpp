@@ -0,0 +1,270 @@
+#include "portmonitor.h"
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QDebug>
+
+#ifdef SCREAMER_HAVE_UDEV
+#include <libudev.h>
+#include <poll.h>
+#endif
+
+// Rescan interval without hotplug events, and how often the udev wait wakes
+// up to check for shutdown, in ms.
+#define MONITOR_POLL_INTERVAL 1000
+#define MONITOR_WAKE_INTERVAL 500
+
+class PortMonitorThread : public QThread
+{
+public:
+    explicit PortMonitorThread(PortMonitor *monitor) :
+        m_monitor(monitor),
+        m_hotplug(false)
+    {
+    }
+
+    void stop()
+    {
+        m_stop.storeRelease(1);
+        rescan();
+        wait();
+    }
+
+    void rescan()
+    {
+        QMutexLocker lock(&m_mutex);
+        m_rescan.storeRelease(1);
+        m_wake.wakeAll();
+    }
+
+    bool hotplug() const { return m_hotplug.loadAcquire(); }
+
+protected:
+    void run();
+
+private:
+    void scan() { m_monitor->update(QSerialPortInfo::availablePorts()); }
+#ifdef SCREAMER_HAVE_UDEV
+    bool runUdev();
+#endif
+
+    PortMonitor *m_monitor;
+    QAtomicInt m_stop;
+    QAtomicInt m_rescan;
+    QAtomicInt m_hotplug;
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+};
+
+void PortMonitorThread::run()
+{
+    scan();
+
+#ifdef SCREAMER_HAVE_UDEV
+    if (runUdev()) return;
+    qWarning() << "PortMonitor: udev unavailable, polling for ports instead";
+#endif
+
+    while (!m_stop.loadAcquire()) {
+        {
+            QMutexLocker lock(&m_mutex);
+            if (!m_rescan.loadAcquire())
+                m_wake.wait(&m_mutex, MONITOR_POLL_INTERVAL);
+        }
+        if (m_stop.loadAcquire()) break;
+        m_rescan.storeRelease(0);
+        scan();
+    }
+}
+
+#ifdef SCREAMER_HAVE_UDEV
+// Returns false if udev couldn't be set up, so the caller can fall back.
+bool PortMonitorThread::runUdev()
+{
+    struct udev *udev = udev_new();
+    if (!udev) return false;
+
+    struct udev_monitor *monitor = udev_monitor_new_from_netlink(udev, "udev");
+    if (!monitor
+            || udev_monitor_filter_add_match_subsystem_devtype(monitor, "tty", 0) < 0
+            || udev_monitor_enable_receiving(monitor) < 0) {
+        if (monitor) udev_monitor_unref(monitor);
+        udev_unref(udev);
+        return false;
+    }
+
+    // Anything plugged in between the first scan and subscribing.
+    scan();
+    m_hotplug.storeRelease(1);
+
+    struct pollfd fd;
+    fd.fd = udev_monitor_get_fd(monitor);
+    fd.events = POLLIN;
+
+    while (!m_stop.loadAcquire()) {
+        fd.revents = 0;
+        const int ready = ::poll(&fd, 1, MONITOR_WAKE_INTERVAL);
+
+        bool changed = m_rescan.fetchAndStoreAcquire(0);
+        if (ready > 0 && (fd.revents & POLLIN)) {
+            // Drain everything queued; one rescan covers a burst of events.
+            struct udev_device *device;
+            while ((device = udev_monitor_receive_device(monitor)) != 0) {
+                changed = true;
+                udev_device_unref(device);
+            }
+        }
+        if (changed && !m_stop.loadAcquire())
+            scan();
+    }
+
+    udev_monitor_unref(monitor);
+    udev_unref(udev);
+    return true;
+}
+#endif
+
+
+PortMonitor *PortMonitor::instance()
+{
+    static QBasicMutex mutex;
+    static PortMonitor *monitor = 0;
+
+    QMutexLocker lock(&mutex);
+    if (!monitor) {
+        monitor = new PortMonitor();
+        // Changes are published on the GUI thread whoever asks first.
+        if (QCoreApplication::instance()) {
+            monitor->moveToThread(QCoreApplication::instance()->thread());
+            monitor->setParent(QCoreApplication::instance());
+        }
+    }
+    return monitor;
+}
+
+PortMonitor::PortMonitor(QObject *parent) :
+    QObject(parent),
+    m_thread(0)
+{
+    // Fill the table before anyone asks, then hand enumeration off.
+    update(QSerialPortInfo::availablePorts());
+    m_published = m_names;
+
+    m_thread = new PortMonitorThread(this);
+    m_thread->start(QThread::LowPriority);
+}
+
+PortMonitor::~PortMonitor()
+{
+    m_thread->stop();
+    delete m_thread;
+}
+
+void PortMonitor::update(const QList<QSerialPortInfo> &infos)
+{
+    QHash<QString, Port> ports;
+    QStringList names;
+    foreach (const QSerialPortInfo &info, infos) {
+        Port port;
+        port.info = info;
+        port.hasIds = info.hasVendorIdentifier() && info.hasProductIdentifier();
+        port.vendorId = info.hasVendorIdentifier() ? info.vendorIdentifier() : 0;
+        port.productId = info.hasProductIdentifier() ? info.productIdentifier() : 0;
+#if QT_VERSION >= 0x050300
+        port.serialNumber = info.serialNumber();
+#endif
+        ports.insert(info.portName(), port);
+        names << info.portName();
+    }
+
+    {
+        QWriteLocker lock(&m_lock);
+        if (names == m_names) {
+            m_ports = ports;
+            return;
+        }
+        m_ports = ports;
+        m_names = names;
+    }
+
+    QMetaObject::invokeMethod(this, "publish", Qt::QueuedConnection);
+}
+
+void PortMonitor::publish()
+{
+    const QStringList names = portNames();
+
+    QStringList added, removed;
+    foreach (const QString &name, names) {
+        if (!m_published.contains(name)) added << name;
+    }
+    foreach (const QString &name, m_published) {
+        if (!names.contains(name)) removed << name;
+    }
+    m_published = names;
+
+    if (added.isEmpty() && removed.isEmpty()) return;
+    qDebug() << "Ports added:" << added << "removed:" << removed;
+    emit portsChanged(added, removed);
+}
+
+QStringList PortMonitor::portNames() const
+{
+    QReadLocker lock(&m_lock);
+    return m_names;
+}
+
+bool PortMonitor::contains(const QString &portName) const
+{
+    QReadLocker lock(&m_lock);
+    return m_ports.contains(portName);
+}
+
+QSerialPortInfo PortMonitor::find(const QString &portName) const
+{
+    QReadLocker lock(&m_lock);
+    QHash<QString, Port>::const_iterator it = m_ports.constFind(portName);
+    return it == m_ports.constEnd() ? QSerialPortInfo() : it->info;
+}
+
+QVariantMap PortMonitor::toVariant(const Port &port)
+{
+    QVariantMap map;
+    map["portName"] = port.info.portName();
+    map["systemLocation"] = port.info.systemLocation();
+    map["description"] = port.info.description();
+    map["manufacturer"] = port.info.manufacturer();
+    map["serialNumber"] = port.serialNumber;
+    map["vendorId"] = port.vendorId;
+    map["productId"] = port.productId;
+    return map;
+}
+
+QVariantMap PortMonitor::port(QString portName) const
+{
+    QReadLocker lock(&m_lock);
+    QHash<QString, Port>::const_iterator it = m_ports.constFind(portName);
+    return it == m_ports.constEnd() ? QVariantMap() : toVariant(*it);
+}
+
+QVariantList PortMonitor::ports() const
+{
+    QReadLocker lock(&m_lock);
+    QVariantList list;
+    foreach (const QString &name, m_names)
+        list << toVariant(m_ports.value(name));
+    return list;
+}
+
+void PortMonitor::rescan()
+{
+    m_thread->rescan();
+}
+
+bool PortMonitor::usingHotplug() const
+{
+    return m_thread->hotplug();
+}
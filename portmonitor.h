@@ -0,0 +1,79 @@
+#ifndef PORTMONITOR_H
+#define PORTMONITOR_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QVariantList>
+#include <QReadWriteLock>
+#include <QSerialPortInfo>
+
+class PortMonitorThread;
+
+/*
+ * Keeps an up to date table of the serial ports on the system.
+ *
+ * Enumeration (QSerialPortInfo::availablePorts(), which walks sysfs or the
+ * registry) only ever happens on the monitor's own thread. On Linux, when
+ * built with libudev, that thread sleeps on udev's tty events and rescans
+ * within milliseconds of a device being plugged or unplugged; elsewhere it
+ * rescans once a second.
+ *
+ * Lookups go to the cached table and are safe from any thread. Changes are
+ * delivered on the GUI thread as the ports added and removed.
+ */
+class PortMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Port {
+        Port() : vendorId(0), productId(0), hasIds(false) {}
+        QSerialPortInfo info;
+        quint16 vendorId;
+        quint16 productId;
+        bool hasIds;
+        QString serialNumber;
+    };
+
+    static PortMonitor *instance();
+
+    QStringList portNames() const;
+    bool contains(const QString &portName) const;
+    // An invalid QSerialPortInfo if there is no such port.
+    QSerialPortInfo find(const QString &portName) const;
+
+    // portName, systemLocation, description, manufacturer, serialNumber,
+    // vendorId and productId (0 when unknown).
+    Q_INVOKABLE QVariantMap port(QString portName) const;
+    Q_INVOKABLE QVariantList ports() const;
+
+    // Ask for a rescan now rather than waiting for an event.
+    Q_INVOKABLE void rescan();
+
+    bool usingHotplug() const;
+
+signals:
+    void portsChanged(QStringList added, QStringList removed);
+
+private slots:
+    void publish();
+
+private:
+    explicit PortMonitor(QObject *parent = 0);
+    ~PortMonitor();
+
+    void update(const QList<QSerialPortInfo> &infos);
+    static QVariantMap toVariant(const Port &port);
+
+    friend class PortMonitorThread;
+
+    mutable QReadWriteLock m_lock;
+    QHash<QString, Port> m_ports;
+    QStringList m_names;
+
+    QStringList m_published;
+    PortMonitorThread *m_thread;
+};
+
+#endif // PORTMONITOR_H
@@ -0,0 +1,357 @@
+#include "productionline.h"
+
+#include <QTimer>
+#include <QDebug>
+#include "programmer.h"
+#include "settings.h"
+#include "portmonitor.h"
+#include "verifyprobe.h"
+
+// A freshly plugged adapter may not be openable straight away.
+#define OPEN_ATTEMPTS 5
+#define OPEN_RETRY_DELAY 200
+#define MAX_RESULTS 500
+
+ProductionLine::ProductionLine(QObject *parent) :
+    QObject(parent),
+    m_programmer(0),
+    m_settings(0),
+    m_running(false),
+    m_stopping(false),
+    m_autoOpenTerminal(false),
+    m_state(Stopped),
+    m_openAttempts(0),
+    m_verify(false),
+    m_verifyTimeout(3000),
+    m_started(0),
+    m_units(0),
+    m_passed(0),
+    m_failed(0)
+{
+}
+
+ProductionLine::~ProductionLine()
+{
+    for (int i = 0; i < m_probes.size(); ++i) {
+        m_probes.at(i)->wait();
+        delete m_probes.at(i);
+    }
+}
+
+bool ProductionLine::start(Programmer *programmer, Settings *settings)
+{
+    if (!programmer || !settings || m_running) return false;
+
+    if (settings->programmerActive()) {
+        settings->writeLogLn("Can't start the production line while programming.", Log::Warning);
+        return false;
+    }
+    if (settings->terminalActive()) {
+        settings->writeLogLn("Close the terminal before starting the production line.", Log::Warning);
+        return false;
+    }
+
+    m_programmer = programmer;
+    m_settings = settings;
+    m_running = true;
+    m_stopping = false;
+
+    // Opening the terminal after each unit would hold the port the next
+    // unit needs; put the user's choice back when the line stops.
+    m_autoOpenTerminal = settings->autoOpenTerminal();
+    settings->setAutoOpenTerminal(false);
+
+    connect(settings, &Settings::availablePortsChanged, this, &ProductionLine::portsChanged);
+    connect(programmer, &Programmer::programmingFinished, this, &ProductionLine::programmingFinished);
+
+    // Only units plugged in from now on.
+    m_known = settings->availablePorts();
+    m_queue.clear();
+    resetStats();
+
+    settings->writeLogLn("Production line started. Waiting for units...");
+    emit runningChanged(true);
+    emit queueChanged();
+    setState(Waiting);
+    return true;
+}
+
+void ProductionLine::stop()
+{
+    if (!m_running || m_stopping) return;
+    m_stopping = true;
+
+    if (m_state != Flashing)
+        finishStopping();
+    else
+        m_settings->writeLogLn("Production line stopping after the current unit.");
+}
+
+void ProductionLine::finishStopping()
+{
+    disconnect(m_settings, &Settings::availablePortsChanged, this, &ProductionLine::portsChanged);
+    disconnect(m_programmer, &Programmer::programmingFinished, this, &ProductionLine::programmingFinished);
+    m_settings->setAutoOpenTerminal(m_autoOpenTerminal);
+    m_settings->writeLogLn(QString("Production line stopped. %1 passed, %2 failed.").arg(m_passed).arg(m_failed));
+
+    m_queue.clear();
+    m_running = false;
+    m_stopping = false;
+    emit queueChanged();
+    emit runningChanged(false);
+    setState(Stopped);
+}
+
+void ProductionLine::resetStats()
+{
+    m_clock.start();
+    m_started = 0;
+    m_units = 0;
+    m_passed = 0;
+    m_failed = 0;
+    m_results.clear();
+    emit statsChanged();
+}
+
+void ProductionLine::portsChanged(QStringList ports)
+{
+    bool queueUpdated = false;
+    foreach (const QString &name, m_known) {
+        if (!ports.contains(name) && m_queue.removeAll(name) > 0)
+            queueUpdated = true;
+    }
+    foreach (const QString &name, ports) {
+        if (!m_known.contains(name) && !m_queue.contains(name)) {
+            m_queue.append(name);
+            queueUpdated = true;
+        }
+    }
+    m_known = ports;
+
+    if (!queueUpdated) return;
+    emit queueChanged();
+    if (m_state == Waiting)
+        next();
+}
+
+void ProductionLine::next()
+{
+    if (m_stopping) {
+        finishStopping();
+        return;
+    }
+
+    if (m_queue.isEmpty()) {
+        setState(Waiting);
+        return;
+    }
+
+    QString portName = m_queue.takeFirst();
+    emit queueChanged();
+    flash(portName);
+}
+
+QVariantMap ProductionLine::unit(const QString &portName) const
+{
+    QVariantMap result = PortMonitor::instance()->port(portName);
+    QVariantMap unit;
+    unit["unit"] = m_started;
+    unit["portName"] = portName;
+    unit["serialNumber"] = result.value("serialNumber");
+    unit["vendorId"] = result.value("vendorId");
+    unit["productId"] = result.value("productId");
+    unit["flashed"] = false;
+    unit["verified"] = false;
+    unit["passed"] = false;
+    return unit;
+}
+
+void ProductionLine::flash(const QString &portName)
+{
+    ++m_started;
+    m_current = unit(portName);
+    m_unitTimer.start();
+    m_openAttempts = 0;
+
+    setState(Flashing, portName);
+    m_settings->writeLogLn(QString("Unit %1: flashing on %2").arg(m_started).arg(portName));
+    retryFlash();
+}
+
+void ProductionLine::retryFlash()
+{
+    if (m_state != Flashing) return;
+
+    m_settings->setPortName(m_currentPort);
+    m_programmer->programMicro(m_settings);
+    if (m_programmer->isProgramming()) return;
+
+    // The port couldn't be opened. Give a new adapter a moment, unless it
+    // has already gone again.
+    if (++m_openAttempts < OPEN_ATTEMPTS && m_known.contains(m_currentPort) && !m_stopping) {
+        QTimer::singleShot(OPEN_RETRY_DELAY, this, SLOT(retryFlash()));
+        return;
+    }
+
+    m_current["detail"] = QString("Port could not be opened");
+    m_current["duration"] = m_unitTimer.elapsed();
+    record(m_current);
+    next();
+}
+
+void ProductionLine::programmingFinished(bool success)
+{
+    if (m_state != Flashing) return;
+
+    m_current["flashed"] = success;
+    m_current["duration"] = m_unitTimer.elapsed();
+
+    if (!success) {
+        m_current["detail"] = m_programmer->statusText();
+        record(m_current);
+    } else if (m_verify) {
+        // Check this unit while the next one is flashing.
+        VerifyProbe *probe = new VerifyProbe(m_current, m_settings, m_verifyPattern.toUtf8(), m_verifyTimeout);
+        connect(probe, &QThread::finished, this, &ProductionLine::verifyFinished);
+        m_probes.append(probe);
+        probe->start();
+    } else {
+        m_current["passed"] = true;
+        record(m_current);
+    }
+
+    next();
+}
+
+void ProductionLine::verifyFinished()
+{
+    VerifyProbe *probe = static_cast<VerifyProbe *>(sender());
+    if (!m_probes.removeOne(probe)) return;
+    probe->wait();
+
+    QVariantMap result = probe->m_result;
+    result["passed"] = result.value("verified").toBool();
+    delete probe;
+
+    record(result);
+}
+
+void ProductionLine::record(QVariantMap result)
+{
+    ++m_units;
+    if (result.value("passed").toBool())
+        ++m_passed;
+    else
+        ++m_failed;
+
+    result["time"] = QDateTime::currentDateTime();
+    m_results.prepend(result);
+    while (m_results.size() > MAX_RESULTS)
+        m_results.removeLast();
+
+    QString msg = QString("Unit %1 on %2: %3 (%4 s)")
+            .arg(result.value("unit").toInt())
+            .arg(result.value("portName").toString())
+            .arg(result.value("passed").toBool() ? "PASS" : "FAIL")
+            .arg(result.value("duration").toLongLong() / 1000.0, 0, 'f', 1);
+    if (!result.value("serialNumber").toString().isEmpty())
+        msg += " [" + result.value("serialNumber").toString() + "]";
+    if (!result.value("detail").toString().isEmpty())
+        msg += " " + result.value("detail").toString();
+    if (m_settings)
+        m_settings->writeLogLn(msg, result.value("passed").toBool() ? Log::Info : Log::Error);
+
+    emit unitFinished(result);
+    emit statsChanged();
+}
+
+void ProductionLine::setState(State state, const QString &portName)
+{
+    if (m_state == state && m_currentPort == portName) return;
+    m_state = state;
+    m_currentPort = portName;
+    emit stateChanged();
+}
+
+bool ProductionLine::running() const
+{
+    return m_running;
+}
+
+ProductionLine::State ProductionLine::state() const
+{
+    return m_state;
+}
+
+QString ProductionLine::currentPort() const
+{
+    return m_currentPort;
+}
+
+QStringList ProductionLine::queue() const
+{
+    return m_queue;
+}
+
+bool ProductionLine::verify() const
+{
+    return m_verify;
+}
+
+void ProductionLine::setVerify(bool arg)
+{
+    if (m_verify == arg) return;
+    m_verify = arg;
+    emit verifyChanged(arg);
+}
+
+QString ProductionLine::verifyPattern() const
+{
+    return m_verifyPattern;
+}
+
+void ProductionLine::setVerifyPattern(QString arg)
+{
+    if (m_verifyPattern == arg) return;
+    m_verifyPattern = arg;
+    emit verifyPatternChanged(arg);
+}
+
+int ProductionLine::verifyTimeout() const
+{
+    return m_verifyTimeout;
+}
+
+void ProductionLine::setVerifyTimeout(int arg)
+{
+    if (m_verifyTimeout == arg) return;
+    m_verifyTimeout = arg;
+    emit verifyTimeoutChanged(arg);
+}
+
+int ProductionLine::passed() const
+{
+    return m_passed;
+}
+
+int ProductionLine::failed() const
+{
+    return m_failed;
+}
+
+qreal ProductionLine::unitsPerHour() const
+{
+    const qint64 elapsed = m_clock.isValid() ? m_clock.elapsed() : 0;
+    if (m_units == 0 || elapsed <= 0) return 0;
+    return m_units * 3600000.0 / elapsed;
+}
+
+qreal ProductionLine::failureRate() const
+{
+    return m_units == 0 ? 0 : qreal(m_failed) / m_units;
+}
+
+QVariantList ProductionLine::results() const
+{
+    return m_results;
+}
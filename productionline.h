@@ -0,0 +1,135 @@
+#ifndef PRODUCTIONLINE_H
+#define PRODUCTIONLINE_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVariantList>
+#include <QElapsedTimer>
+#include <QDateTime>
+
+class Programmer;
+class Settings;
+class VerifyProbe;
+
+/*
+ * Flashes every unit that turns up, one after another, without any clicks.
+ *
+ * While running, each port that appears in Settings' port list is queued as a
+ * unit. Units are flashed in arrival order through the Programmer, using the
+ * hex file and settings the panel already has. The next unit is started the
+ * moment the programmer reports back, with no timers in between.
+ *
+ * With verify on, a flashed unit's own port is reopened at the terminal baud
+ * rate and must print verifyPattern within verifyTimeout. Verification runs
+ * on its own thread and overlaps with flashing the next unit.
+ */
+class ProductionLine : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(State state READ state NOTIFY stateChanged)
+    Q_PROPERTY(QString currentPort READ currentPort NOTIFY stateChanged)
+    Q_PROPERTY(QStringList queue READ queue NOTIFY queueChanged)
+
+    Q_PROPERTY(bool verify READ verify WRITE setVerify NOTIFY verifyChanged)
+    Q_PROPERTY(QString verifyPattern READ verifyPattern WRITE setVerifyPattern NOTIFY verifyPatternChanged)
+    Q_PROPERTY(int verifyTimeout READ verifyTimeout WRITE setVerifyTimeout NOTIFY verifyTimeoutChanged)
+
+    Q_PROPERTY(int passed READ passed NOTIFY statsChanged)
+    Q_PROPERTY(int failed READ failed NOTIFY statsChanged)
+    Q_PROPERTY(qreal unitsPerHour READ unitsPerHour NOTIFY statsChanged)
+    Q_PROPERTY(qreal failureRate READ failureRate NOTIFY statsChanged)
+    Q_PROPERTY(QVariantList results READ results NOTIFY statsChanged)
+
+    Q_ENUMS(State)
+
+public:
+    enum State { Stopped, Waiting, Flashing };
+
+    explicit ProductionLine(QObject *parent = 0);
+    ~ProductionLine();
+
+    // Ports already present when the line starts are not flashed.
+    Q_INVOKABLE bool start(Programmer *programmer, Settings *settings);
+    // Finishes the unit being flashed, then stops.
+    Q_INVOKABLE void stop();
+    Q_INVOKABLE void resetStats();
+
+    bool running() const;
+    State state() const;
+    QString currentPort() const;
+    QStringList queue() const;
+
+    bool verify() const;
+    void setVerify(bool arg);
+
+    QString verifyPattern() const;
+    void setVerifyPattern(QString arg);
+
+    int verifyTimeout() const;
+    void setVerifyTimeout(int arg);
+
+    int passed() const;
+    int failed() const;
+    // Units completed per hour since the line started, idle time included.
+    qreal unitsPerHour() const;
+    // Fraction of completed units that failed, 0..1.
+    qreal failureRate() const;
+    // Newest first: unit, portName, serialNumber, vendorId, productId,
+    // flashed, verified, passed, duration (ms), detail, time.
+    QVariantList results() const;
+
+signals:
+    void runningChanged(bool arg);
+    void stateChanged();
+    void queueChanged();
+    void verifyChanged(bool arg);
+    void verifyPatternChanged(QString arg);
+    void verifyTimeoutChanged(int arg);
+    void statsChanged();
+
+    void unitFinished(QVariantMap result);
+
+private slots:
+    void portsChanged(QStringList ports);
+    void programmingFinished(bool success);
+    void verifyFinished();
+    void retryFlash();
+
+private:
+    void next();
+    void flash(const QString &portName);
+    QVariantMap unit(const QString &portName) const;
+    void record(QVariantMap result);
+    void finishStopping();
+    void setState(State state, const QString &portName = QString());
+
+    Programmer *m_programmer;
+    Settings *m_settings;
+    bool m_running;
+    bool m_stopping;
+    bool m_autoOpenTerminal;
+    State m_state;
+
+    QStringList m_known;
+    QStringList m_queue;
+    QString m_currentPort;
+    QVariantMap m_current;
+    QElapsedTimer m_unitTimer;
+    int m_openAttempts;
+
+    QList<VerifyProbe *> m_probes;
+    bool m_verify;
+    QString m_verifyPattern;
+    int m_verifyTimeout;
+
+    QElapsedTimer m_clock;
+    int m_started;
+    int m_units;
+    int m_passed;
+    int m_failed;
+    QVariantList m_results;
+};
+
+#endif // PRODUCTIONLINE_H
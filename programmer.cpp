@@ -4,17 +4,14 @@
 #include <QFile>
 #include <QThread>
 #include <QTextStream>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QtCore/qmath.h>
 #include "util.h"
+#include "trace.h"
 
-#define MAX_MEM_SIZE 32768
-#define SIZE_ATMEGA328 32768
-#define SIZE_ATMEGA168 16384
-
-char slave_ready = (char)0x05;
-char loadmode_start = (char)0x06;
-char datablock_success = (char)0x54;
-char datablock_failure = (char)0x07;
+// How often the live link metrics are refreshed, ms.
+#define LINK_STATS_INTERVAL 250
 
 Programmer::Programmer(QObject *parent) :
     QObject(parent),
@@ -24,19 +21,48 @@ Programmer::Programmer(QObject *parent) :
     m_lastAddress(0),
     m_progress(0),
     m_status(Idle),
-    m_statusText("Idle")
+    m_statusText("Idle"),
+    m_port(0),
+    m_keepPortOpen(false),
+    m_jobNumber(0),
+    m_throughput(0),
+    m_rttP50(0),
+    m_rttP99(0),
+    m_resendRate(0),
+    m_eta(-1)
 {
+    qRegisterMetaType<FlashJob>("FlashJob");
+
+    // However fast blocks are answered, the properties only change this often.
+    m_linkTimer.setInterval(LINK_STATS_INTERVAL);
+    connect(&m_linkTimer, &QTimer::timeout, this, &Programmer::updateLinkStats);
+
     m_worker = new Worker(this);
+    m_workerThread.setObjectName("Programmer");
     m_worker->moveToThread(&m_workerThread);
     connect(&m_workerThread, &QThread::finished, m_worker, &QObject::deleteLater);
     connect(this, &Programmer::startProgramming, m_worker, &Worker::kayGo);
     connect(m_worker, &Worker::closePort, this, &Programmer::closePort);
+    connect(m_worker, &Worker::done, this, &Programmer::programmingFinished);
+    connect(this, &Programmer::resetRequested, m_worker, &Worker::reset);
+    connect(m_worker, &Worker::resetDone, this, &Programmer::resetFinished);
+    connect(m_worker, &Worker::done, &m_linkTimer, &QTimer::stop);
+    connect(m_worker, &Worker::done, this, &Programmer::updateLinkStats);
 
     m_workerThread.start();
 }
 
+Programmer::~Programmer()
+{
+    m_worker->stopProgramming(m_jobNumber);
+    m_workerThread.quit();
+    m_workerThread.wait();
+}
+
 void Programmer::programMicro(Settings *settings)
 {
+    // Later changes to the settings don't touch a job that's already begun.
+    m_job = settings->flashJob();
     setIsProgramming(true);
 
     if (!openPort(settings)) {
@@ -44,7 +70,11 @@ void Programmer::programMicro(Settings *settings)
         return;
     }
 
-    emit startProgramming(settings, m_port);
+    settings->writeLogLn("Job: " + QString::fromUtf8(QJsonDocument(QJsonObject::fromVariantMap(m_job.toVariant()))
+                                                     .toJson(QJsonDocument::Compact)), Log::Debug);
+    setJobSummary(QVariantMap());
+    emit startProgramming(settings, m_port, m_job, ++m_jobNumber);
+    m_linkTimer.start();
 }
 
 void Programmer::resetMicro(Settings *settings)
@@ -52,7 +82,7 @@ void Programmer::resetMicro(Settings *settings)
     QSerialPort *port = settings->getPort();
 
     if (!port) {
-        settings->writeLogLn("Reset unsuccessful. Port could not be opened.");
+        settings->writeLogLn("Reset unsuccessful. Port could not be opened.", Log::Error);
         qDebug() << "Unable to open the port";
         return;
     }
@@ -62,331 +92,126 @@ void Programmer::resetMicro(Settings *settings)
     port->close();
 }
 
-void Worker::programMicro(Settings *settings, QSerialPort *port)
+bool Programmer::startReset(Settings *settings)
 {
-    setStatus(Programmer::Idle);
-
-    switch (settings->chip()) {
-    case Settings::Atmega168:
-        m_fileBuffer.resize(SIZE_ATMEGA168);
-        break;
-    case Settings::Atmega328:
-    case Settings::Atmega32u4:
-        m_fileBuffer.resize(SIZE_ATMEGA328);
-        break;
-    }
-
-    qDebug() << "Loading HEX file";
-    if (!loadHexFile(settings->hexFile(), &m_fileBuffer, &m_startAddress, &m_endAddress, settings)) {
-        settings->writeLogLn("Error: Unable to Load Hex File");
-        setStatus(Programmer::Error);
-        return;
-    }
-
-    qDebug() << "Loaded Hex File";
-
-    // Set the reset type...
-    switch (settings->resetType()) {
-    case Settings::RTS:
-        port->setRequestToSend(false);
-        break;
-    case Settings::DTR:
-        port->setDataTerminalReady(false);
-        break;
-    }
-
-    setStatus(Programmer::Connecting);
-
-//    port->setRequestToSend(true);
-
-    qDebug() << "Entering program mode";
-    // Enter programming mode...
-    if (!startProgramMode(port, settings)) {
-        settings->writeLogLn("Unable to Enter Programming Mode");
-        return;
-    }
-
-    qDebug() << "Start sending program";
-    // Send over the program.
-    if (!sendProgram(port, m_fileBuffer, m_startAddress, m_endAddress, settings)) {
-        settings->writeLogLn("Sending Program was unsuccessful.");
-        return;
+    if (!openPort(settings)) {
+        settings->writeLogLn("Reset unsuccessful. Port could not be opened.", Log::Error);
+        return false;
     }
 
-    setStatus(Programmer::Idle);
-    setProgress(0, 0, 0);
-    m_programmer->setResends(0);
-
-    Util::resetMicro(port, settings);
+    emit resetRequested(settings, m_port);
+    return true;
 }
 
-bool Worker::startProgramMode(QSerialPort *port, Settings *settings)
+bool Worker::programMicro(Settings *settings, QSerialPort *port, const FlashJob &job)
 {
-    settings->writeLogLn("Sending Chip into Program Mode...");
-    setStatus(Programmer::Connecting, "Waiting for target chip to broadcast boot.");
-
-    Util::resetMicro(port, settings);
+    TRACE_SCOPE("Worker::programMicro");
+    m_settings = settings;
+    m_job = job;
+    m_imageLoaded = false;
+    m_success = false;
+    setStatus(Programmer::Idle);
 
-    while(true) {
-        if (m_stopProgramming) {
-            setStatus(Programmer::Error, "Programming cancelled. Target chip did not enter programming mode.");
-            settings->writeLogLn("Programming cancelled before chip entered programming mode.");
-            return false;
-        }
-        if (port->bytesAvailable() == 0) {
-            QThread::msleep(50);
-            continue;
-        }
+    // The flasher does the work on the port the terminal shares, and this
+    // thread waits, so a job still runs one at a time per Programmer.
+    m_flasher.submit(job, this, port);
+    m_flasher.waitForDone();
 
-        settings->writeLog("Receiving data...");
-        QByteArray response = port->readAll();
-        settings->writeLog(QString(response));
-        settings->writeLogLn("<-" + Util::byte2hex(response));
-        if (response.indexOf(slave_ready) >= 0) {
-            settings->writeLogLn("Received Broadcast!");
-            break; // We have a winner!
-        }
+    if (m_success) {
+        setProgress(0, 0, 0);
+        m_programmer->setResends(0);
     }
-
-    // Now put the chip into program mode
-    port->write(&loadmode_start, 1);
-    port->flush();
-    settings->writeLogLn("->" + loadmode_start);
-
-    setStatus(Programmer::Connected, "Load Mode Command Sent");
-    return true;
+    return m_success;
 }
 
-bool Worker::sendProgram(QSerialPort *port, const QByteArray &fileBuffer, int startAddress, int endAddress, Settings *settings)
-{
-    int currentAddress = startAddress;
-    int blockSize = 0;
-    int pageSize;
-    QByteArray header(5, 0);
-
-    switch (settings->chip()) {
-    case Settings::Atmega168:
-    case Settings::Atmega328:
-        pageSize = 128;
-        break;
-    case Settings::Atmega32u4:
-        pageSize = 256;
-        break;
-    default:
-        qWarning() << "No page size for chip type.";
-        settings->writeLogLn("Error: Undefined Page size for chip type.");
-        setStatus(Programmer::Error, "No page size for chip");
-        return false;
-    }
+void Worker::stateChanged(Bootloader::State state, const QString &text)
+{
+    setStatus((Programmer::Status)state, text);
+}
 
-    while (true) {
+void Worker::progress(int address, int endAddress, qreal fraction)
+{
+    setProgress(address, endAddress, fraction);
+}
 
-        while (port->bytesAvailable() == 0) {
-            QThread::msleep(10);
-            if (m_stopProgramming) {
-                break;
-            }
-        }
+void Worker::blockResent(int address)
+{
+    Q_UNUSED(address);
+    m_programmer->resendsIncrement();
+}
 
-        if (m_stopProgramming) {
-            m_stopProgramming = false;
-            setStatus(Programmer::Error, "The target chip did not finish loading. You will likely experience unexpected program execution.");
-            break;
-        }
+void Worker::blockAnswered(int address, int length, bool success, qint64 nsecs)
+{
+    Q_UNUSED(address);
+    m_programmer->linkStats()->record(length, nsecs, success);
+}
 
-        char response;
-        port->read(&response, 1);
-        settings->writeLogLn("<-" + Util::int2hex((int)response));
-
-        if (response == slave_ready) {
-            // Hmmm a stray signal
-            port->write(&loadmode_start, 1);
-            port->flush();
-            continue;
-        } else if (response == datablock_success) {
-            setStatus(Programmer::Programming);
-            if (currentAddress > endAddress) break;
-        } else if (response == datablock_failure) {
-            if (blockSize == 0) {
-                QString msg = "Error : Incorrect initial response from target IC. Programming is incomplete and will now halt.";
-                settings->writeLogLn(msg);
-                setStatus(Programmer::Error, msg);
-                return false;
-            }
-            setStatus(Programmer::Failure);
-            currentAddress = currentAddress - blockSize;
-            m_programmer->resendsIncrement();
-        } else {
-            // TODO: THis is probably not necessarilly the best
-            QString msg = "Error : Incorrect response from target IC. Programming is incomplete and will now halt.";
-            settings->writeLogLn(msg);
-            setStatus(Programmer::Error, msg);
-            return false;
-        }
+void Worker::summarise(Settings *settings, bool success)
+{
+    const LinkStats *stats = m_programmer->linkStats();
+    if (stats->blocks() == 0) return;
 
-        // Update the progress
-        setProgress(currentAddress, endAddress, (currentAddress - startAddress)/(endAddress - startAddress + 1));
-
-        blockSize = qMin(pageSize, endAddress - currentAddress + 1);
-
-        int memAddressHigh = currentAddress / 256;
-        int memAddressLow = currentAddress % 256;
-
-        int blockSizeHigh = blockSize / 256;
-        int blockSizeLow = blockSize % 256;
-
-        unsigned int checkSum = 0;
-        checkSum += blockSizeHigh;
-        checkSum += blockSizeLow;
-        checkSum += memAddressHigh;
-        checkSum += memAddressLow;
-
-        for (int j=0; j<blockSize; ++j)
-            checkSum += fileBuffer[currentAddress + j];
-
-        // Reduce checksum to 8 bits
-//        while (checkSum < 0) checkSum += 256;
-        while (checkSum > 256) checkSum -= 256;
-        // Two's compliment
-        unsigned char checkSumChar = (unsigned char)(256 - checkSum);
-        qDebug() << "CheckSumChar" << (int)checkSumChar;
-
-        // Send Start character
-        port->write(":", 1);
-
-        // Send record header
-        if (pageSize >= 256) {
-            header[0] = (char)blockSizeLow;
-            header[1] = (char)blockSizeHigh;
-            header[2] = (char)memAddressLow;
-            header[3] = (char)memAddressHigh;
-            header[4] = (char)checkSumChar;
-            port->write(header);
-
-        } else {
-            header[0] = (char)blockSize;
-            header[1] = (char)memAddressLow;
-            header[2] = (char)memAddressHigh;
-            header[3] = (char)checkSumChar;
-            port->write(header.mid(0,4));
-        }
-//        header[3] = 0x59;
+    settings->writeLogLn(QString("Sent %1 bytes in %2 blocks, %3 bytes/s. Block round trip %4 ms median, %5 ms 99th percentile. %6 resends.")
+                         .arg(stats->bytes()).arg(stats->blocks()).arg(qRound(stats->throughput()))
+                         .arg(stats->percentile(0.5)).arg(stats->percentile(0.99)).arg(stats->failures()));
 
-        // Send the record data
-        port->write(fileBuffer.mid(currentAddress, blockSize));
-        port->flush();
+    QVariantMap summary = stats->summary();
+    summary["success"] = success;
+    // Queued, so it's in place before finished() gets to the GUI thread.
+    QMetaObject::invokeMethod(m_programmer, "setJobSummary", Qt::QueuedConnection, Q_ARG(QVariantMap, summary));
+}
 
-        QString msg;
-        QTextStream msgStream(&msg);
-        msgStream << "-> :" << Util::byte2hex(header) << "[+"
-            << blockSize << " bytes of data]";
-        settings->writeLogLn(msg);
+void Worker::transmitted(const char *data, int length)
+{
+    m_settings->capture()->tx(data, length);
+}
 
-        currentAddress += blockSize;
-    }
+void Worker::received(const char *data, int length)
+{
+    m_settings->capture()->rx(data, length);
+}
 
-    // Woo, success =)
-    // Need to tell the chip that we're done
-    if (pageSize >= 256)
-        port->write(": S");
+void Worker::lineChanged(Bootloader::Line line, bool set)
+{
+    if (line == Bootloader::RequestToSend)
+        m_settings->capture()->rts(set);
     else
-        port->write(":S");
-
-    port->flush();
-    settings->writeLogLn("-> :S");
-
-    setStatus(Programmer::Programming);
-    return true;
+        m_settings->capture()->dtr(set);
 }
 
-bool Worker::loadHexFile(QUrl fileUrl, QByteArray *data, int *startAddress, int *endAddress, Settings *settings)
+// The flasher has already left out the traffic if the job doesn't log it.
+void Worker::message(Bootloader::MessageLevel level, const QString &text)
 {
-    QFile file(fileUrl.toLocalFile());
-
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Programmer: Could not open file:" << fileUrl.toLocalFile();
-        return false;
-    }
+    m_settings->writeLogLn(text, (Log::Level)level);
+}
 
-    data->fill(0xFF);
-    QTextStream in(&file);
-
-    QString msg;
-    QTextStream msgStream(&msg);
-
-    *endAddress = -1;
-    *startAddress = MAX_MEM_SIZE;
-
-    QString line;
-    int lineNumber = 0;
-    while (!in.atEnd()) {
-        line = in.readLine().trimmed();
-        lineNumber++;
-
-        if (line.length() == 0) continue;
-
-        if (line.startsWith(":")) {
-            QString sub = line.mid(7,2);
-
-            if (sub=="02" || sub=="04") {
-                //	02 - extended segment address record
-                //	04 - extended linear address record
-                msg.clear();
-                msgStream << "Warning on line " << lineNumber << ". Unsupported record type (whatever that means...)";
-                settings->writeLog(msg);
-            } else if (sub=="01") {
-                // 01 - End of File
-                file.close();
-                return true;
-            } else if (sub=="00") {
-                // This line is dandy
-            } else {
-                msg.clear();
-                msgStream << "Warning on line " << lineNumber << ". Unknown record type (whatever that means...)";
-                settings->writeLog(msg);
-            }
-
-            bool ok;
-            int byteCount = line.mid(1,2).toUInt(&ok, 16);
-            if (!ok) {
-                settings->writeLogLn("Unable to convert hex to int:" + line.mid(1,2));
-                continue;
-            }
-
-            if (byteCount == 0) continue;
-
-            int memoryAddressHigh = line.mid(3, 2).toUInt(0, 16);
-            int memoryAddressLow = line.mid(5, 2).toUInt(0, 16);
-            int memoryAddress = (memoryAddressHigh * 256) + memoryAddressLow;
-
-            for (int idx = 0; idx < byteCount; idx++) {
-                int address = memoryAddress + idx;
-                if (address >= m_fileBuffer.length()) {
-                    msg.clear();
-                    msgStream << "Error at line " << lineNumber << ". Address " << Util::int2hex(address)
-                        << " out of buffer (max=" << Util::byte2hex(m_fileBuffer) << ").";
-                    settings->writeLogLn(msg);
-                }
-
-                if (address > *endAddress) *endAddress = address;
-                if (address < *startAddress) *startAddress = address;
-                (*data)[address] = (char)(line.mid(idx*2 + 9, 2).toUInt(0, 16));
-            }
-            continue;
-        }
+bool Worker::cancelled()
+{
+    return m_stopJob.loadAcquire() == m_jobNumber;
+}
 
-        if (line.startsWith("S")) {
-            msg.clear();
-            msgStream << "Error in line " << lineNumber << ". Motorola S format not supported.";
-            settings->writeLogLn(msg);
-            file.close();
-            return false;
-        }
-    } // End While line read
+void Worker::imageLoaded(int startAddress, int endAddress)
+{
+    m_imageLoaded = true;
+    m_programmer->linkStats()->clear(endAddress - startAddress + 1);
+}
 
-    file.close();
+void Worker::resetLatency(qreal msecs)
+{
+    m_settings->recordResetLatency(m_job.portName, msecs);
+}
 
-    return true;
+void Worker::finished(int job, bool success, const QString &error)
+{
+    Q_UNUSED(job);
+    // Before the image, the stats are still the last job's.
+    if (m_imageLoaded)
+        summarise(m_settings, success);
+    if (!success) {
+        qWarning() << "Programmer:" << error;
+        m_settings->writeLogLn("Programming was unsuccessful.", Log::Error);
+    }
+    m_success = success;
 }
 
 
@@ -456,10 +281,15 @@ int Programmer::resends() const
     return m_resends;
 }
 
-void Worker::stopProgramming()
+void Worker::stopProgramming(int job)
 {
-    qDebug() << "Stop Programming";
-    m_stopProgramming = true;
+    qDebug() << "Stop Programming" << job;
+    m_stopJob.storeRelease(job);
+}
+
+void Worker::reset(Settings *settings, QSerialPort *port)
+{
+    emit resetDone(Util::resetMicro(port, settings));
 }
 
 
@@ -501,6 +331,73 @@ int Programmer::lastAddress() const
     return m_lastAddress;
 }
 
+bool Programmer::keepPortOpen() const
+{
+    return m_keepPortOpen;
+}
+
+void Programmer::setKeepPortOpen(bool arg)
+{
+    m_keepPortOpen = arg;
+}
+
+FlashJob Programmer::job() const
+{
+    return m_job;
+}
+
+qreal Programmer::throughput() const
+{
+    return m_throughput;
+}
+
+qreal Programmer::rttP50() const
+{
+    return m_rttP50;
+}
+
+qreal Programmer::rttP99() const
+{
+    return m_rttP99;
+}
+
+qreal Programmer::resendRate() const
+{
+    return m_resendRate;
+}
+
+qreal Programmer::eta() const
+{
+    return m_eta;
+}
+
+LinkStats *Programmer::linkStats()
+{
+    return &m_linkStats;
+}
+
+void Programmer::updateLinkStats()
+{
+    m_throughput = m_linkStats.throughput();
+    m_rttP50 = m_linkStats.percentile(0.5);
+    m_rttP99 = m_linkStats.percentile(0.99);
+    m_resendRate = m_linkStats.resendRate();
+    m_eta = m_linkStats.eta();
+    emit linkStatsChanged();
+}
+
+QVariantMap Programmer::jobSummary() const
+{
+    return m_jobSummary;
+}
+
+void Programmer::setJobSummary(QVariantMap arg)
+{
+    if (m_jobSummary == arg) return;
+    m_jobSummary = arg;
+    emit jobSummaryChanged();
+}
+
 
 void Worker::setStatus(Programmer::Status status, QString statusText)
 {
@@ -526,41 +423,43 @@ void Worker::setProgress(int current, int total, qreal progress)
     m_programmer->setLastAddress(total);
 }
 
-void Worker::kayGo(Settings *settings, QSerialPort *port)
+void Worker::kayGo(Settings *settings, QSerialPort *port, FlashJob job, int number)
 {
     if (m_running) return;
 //    m_programmer->setIsProgramming(true);
     m_running = true;
+    m_jobNumber = number;
 
-    programMicro(settings, port);
+    bool success = programMicro(settings, port, job);
 
     port->clear();
 
-    m_stopProgramming = false;
     m_running = false;
     m_programmer->setIsProgramming(false, settings);
 
-    if (!settings->terminalActive())
+    if (!settings->terminalActive() && !m_programmer->keepPortOpen())
         emit closePort();
+
+    emit done(success);
 }
 
 
 Worker::Worker(QObject *parent) : QObject(parent),
     m_programmer(0),
     m_running(false),
-    m_stopProgramming(false),
-    m_fileBuffer(QByteArray(MAX_MEM_SIZE, 0xFF)), // TODO: Perhaps have this as a constant somewhere?
-    m_startAddress(-1),
-    m_endAddress(MAX_MEM_SIZE)
+    m_jobNumber(0),
+    m_settings(0),
+    m_imageLoaded(false),
+    m_success(false)
 {
 }
 
 Worker::Worker(Programmer *prog, QObject *parent): QObject(parent),
     m_running(false),
-    m_stopProgramming(false),
-    m_fileBuffer(QByteArray(MAX_MEM_SIZE, 0xFF)), // TODO: Perhaps have this as a constant somewhere?
-    m_startAddress(-1),
-    m_endAddress(MAX_MEM_SIZE)
+    m_jobNumber(0),
+    m_settings(0),
+    m_imageLoaded(false),
+    m_success(false)
 {
     m_programmer = prog;
 }
@@ -589,5 +488,5 @@ void Programmer::closePort()
 
 void Programmer::stopProgramming()
 {
-    m_worker->stopProgramming();
+    m_worker->stopProgramming(m_jobNumber);
 }
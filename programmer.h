@@ -5,7 +5,13 @@
 #include <QSerialPort>
 #include <QByteArray>
 #include <QThread>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QVariantMap>
 #include "settings.h"
+#include "bootloader.h"
+#include "flasher.h"
+#include "linkstats.h"
 
 class Worker;
 class Programmer : public QObject
@@ -20,6 +26,14 @@ class Programmer : public QObject
     Q_PROPERTY(int currentAddress READ currentAddress NOTIFY currentAddressChanged)
     Q_PROPERTY(int lastAddress READ lastAddress NOTIFY lastAddressChanged)
 
+    // Live link metrics, refreshed a few times a second while programming.
+    Q_PROPERTY(qreal throughput READ throughput NOTIFY linkStatsChanged)
+    Q_PROPERTY(qreal rttP50 READ rttP50 NOTIFY linkStatsChanged)
+    Q_PROPERTY(qreal rttP99 READ rttP99 NOTIFY linkStatsChanged)
+    Q_PROPERTY(qreal resendRate READ resendRate NOTIFY linkStatsChanged)
+    Q_PROPERTY(qreal eta READ eta NOTIFY linkStatsChanged)
+    Q_PROPERTY(QVariantMap jobSummary READ jobSummary NOTIFY jobSummaryChanged)
+
 //    Q_PROPERTY(QSerialPort *port READ port WRITE setport NOTIFY portChanged)
 
     Q_ENUMS(Status)
@@ -29,9 +43,13 @@ public:
     enum Status { Idle, Connecting, Connected, Programming, Failure, Error };
 
     explicit Programmer(QObject *parent = 0);
+    ~Programmer();
 
     Q_INVOKABLE void programMicro(Settings *settings);
     Q_INVOKABLE void resetMicro(Settings *settings);
+    // Resets on the worker thread instead, leaving the port open, and
+    // emits resetFinished(). False if the port couldn't be opened.
+    bool startReset(Settings *settings);
 
 //    bool startProgramMode(QSerialPort *port, Settings *settings);
 //    bool sendProgram(QSerialPort *port, const QByteArray &fileBuffer, int startAddress, int endAddress, Settings *settings);
@@ -62,8 +80,30 @@ public:
     int lastAddress() const;
     void setLastAddress(int arg);
 
+    // Leave the port open after programming, ready for the next job.
+    bool keepPortOpen() const;
+    void setKeepPortOpen(bool arg);
+
+    // The settings the last programMicro() ran with.
+    FlashJob job() const;
+
+    // Bytes per second, block round trip in ms, resends per block answered
+    // and seconds left (-1 when unknown).
+    qreal throughput() const;
+    qreal rttP50() const;
+    qreal rttP99() const;
+    qreal resendRate() const;
+    qreal eta() const;
+    // Written by the worker as blocks are answered.
+    LinkStats *linkStats();
+
+    // LinkStats::summary() for the last job that got as far as sending.
+    QVariantMap jobSummary() const;
+
 signals:
-    void startProgramming(Settings *settings, QSerialPort *port);
+    // number counts the jobs, so a stop can say which one it's for.
+    void startProgramming(Settings *settings, QSerialPort *port, FlashJob job, int number);
+    void resetRequested(Settings *settings, QSerialPort *port);
 
     void isProgrammingChanged(bool arg);
     void progressChanged(qreal arg);
@@ -79,10 +119,22 @@ signals:
     void portOpened(QSerialPort *port);
     void portClosed();
 
+    // Emitted once the worker is done with the port, whatever the outcome.
+    void programmingFinished(bool success);
+    // found is false if the reset's expected pattern never showed.
+    void resetFinished(bool found);
+
+    void linkStatsChanged();
+    void jobSummaryChanged();
+
 public slots:
     void stopProgramming();
     QSerialPort *openPort(Settings *settings);
     void closePort();
+    void setJobSummary(QVariantMap arg);
+
+private slots:
+    void updateLinkStats();
 
 private:
     bool m_isProgramming;
@@ -98,9 +150,28 @@ private:
     Worker *m_worker;
     QThread m_workerThread;
     QSerialPort *m_port;
+    bool m_keepPortOpen;
+    FlashJob m_job;
+    // The last job handed to the worker.
+    int m_jobNumber;
+
+    LinkStats m_linkStats;
+    QTimer m_linkTimer;
+    qreal m_throughput;
+    qreal m_rttP50;
+    qreal m_rttP99;
+    qreal m_resendRate;
+    qreal m_eta;
+    QVariantMap m_jobSummary;
 };
 
-class Worker: public QObject
+/*
+ * Runs a programming job on the programmer's thread, through a Flasher on
+ * the port the settings opened, passing its progress on to the Programmer
+ * and its traffic and messages to the settings' capture and log. What to
+ * flash and how comes from the job, never from the settings themselves.
+ */
+class Worker: public QObject, public Flasher::Listener
 {
     Q_OBJECT
 
@@ -111,27 +182,47 @@ public:
     void setStatus(Programmer::Status status, QString statusText=QString());
     void setProgress(int current, int total, qreal progress);
 
+    // Flasher::Listener
+    void stateChanged(Bootloader::State state, const QString &text);
+    void progress(int address, int endAddress, qreal fraction);
+    void blockResent(int address);
+    void blockAnswered(int address, int length, bool success, qint64 nsecs);
+    void transmitted(const char *data, int length);
+    void received(const char *data, int length);
+    void lineChanged(Bootloader::Line line, bool set);
+    void message(Bootloader::MessageLevel level, const QString &text);
+    bool cancelled();
+    void imageLoaded(int startAddress, int endAddress);
+    void resetLatency(qreal msecs);
+    void finished(int job, bool success, const QString &error);
+
 signals:
     void closePort();
+    void done(bool success);
+    void resetDone(bool found);
 
 public slots:
-    void kayGo(Settings *settings, QSerialPort *port);
-    void programMicro(Settings *settings, QSerialPort *port);
-
-    bool startProgramMode(QSerialPort *port, Settings *settings);
-    bool sendProgram(QSerialPort *port, const QByteArray &fileBuffer, int startAddress, int endAddress, Settings *settings);
-    bool loadHexFile(QUrl fileUrl, QByteArray *data, int *startAddress, int *endAddress, Settings *settings);
-    void stopProgramming();
+    void kayGo(Settings *settings, QSerialPort *port, FlashJob job, int number);
+    void reset(Settings *settings, QSerialPort *port);
+    bool programMicro(Settings *settings, QSerialPort *port, const FlashJob &job);
+    // Stops job number if it's the one running or about to; a stop that
+    // arrives after its job has ended matches nothing. Any thread.
+    void stopProgramming(int job);
 
 private:
+    void summarise(Settings *settings, bool success);
+
     Programmer *m_programmer;
     bool m_running;
-    bool m_stopProgramming;
-
-    QByteArray m_fileBuffer;
-    int m_startAddress;
-    int m_endAddress;
-
+    int m_jobNumber;
+    QAtomicInt m_stopJob;
+    Settings *m_settings;
+    FlashJob m_job;
+
+    // Keeps the last image, so the same file is only parsed once.
+    Flasher m_flasher;
+    bool m_imageLoaded;
+    bool m_success;
 };
 
 #endif // PROGRAMMER_H
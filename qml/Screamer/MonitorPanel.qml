@@ -0,0 +1,123 @@
+import QtQuick 2.1
+import QtQuick.Controls 1.0
+import QtQuick.Layouts 1.0
+
+import Screamer 1.0
+
+Tab {
+    id: tab
+    title: "Monitor"
+
+    property Settings settings: null
+
+    SplitView {
+        anchors.fill: parent
+        orientation: Qt.Horizontal
+
+        MultiTerminal {
+            id: monitor
+        }
+
+        Item {
+            id: settingsPane
+            width: 250
+            Layout.minimumWidth: 150
+            property real comboHeight: 22
+            property real comboWidth: 150
+
+            Column {
+                anchors.fill: parent
+                spacing: 5
+
+                Item { width: parent.width; height: 30 }
+
+                LabelCombo {
+                    id: comboPort
+                    labelText: "Port |"
+                    height: settingsPane.comboHeight
+                    implicitComboWidth: settingsPane.comboWidth
+                    combo.model: ListModel { id: portModel }
+
+                    property var portList: settings.availablePorts
+                    onPortListChanged: {
+                        portModel.clear()
+                        for (var i=0; i<portList.length; ++i)
+                            portModel.append({ "text": portList[i] })
+                    }
+                }
+
+                LabelCombo {
+                    id: comboBaud
+                    labelText: "Baud Rate |"
+                    height: settingsPane.comboHeight
+                    implicitComboWidth: settingsPane.comboWidth
+                    combo.model: ListModel {
+                        id: baudModel
+                        ListElement { text: "9600"; value: Serial.Baud9600 }
+                        ListElement { text: "19200"; value: Serial.Baud19200 }
+                        ListElement { text: "38400"; value: Serial.Baud38400 }
+                        ListElement { text: "57600"; value: Serial.Baud57600 }
+                        ListElement { text: "115200"; value: Serial.Baud115200 }
+                    }
+                    value: Serial.Baud115200
+                }
+
+                Row {
+                    spacing: 5
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    Button {
+                        text: "Add"
+                        enabled: portModel.count > 0
+                        onClicked: monitor.addPort(portModel.get(comboPort.combo.currentIndex).text,
+                                                   baudModel.get(comboBaud.combo.currentIndex).value)
+                    }
+                    Button {
+                        text: "Clear"
+                        onClicked: monitor.clear()
+                    }
+                }
+
+                Item { width: parent.width; height: 10 }
+
+                Repeater {
+                    model: monitor.ports
+                    delegate: Row {
+                        spacing: 5
+                        anchors.horizontalCenter: parent.horizontalCenter
+                        Label {
+                            width: 150
+                            elide: Text.ElideRight
+                            anchors.verticalCenter: parent.verticalCenter
+                            text: {
+                                var error = monitor.portError(modelData)
+                                return error.length > 0 ? modelData + ": " + error : modelData
+                            }
+                        }
+                        Button {
+                            text: "Remove"
+                            onClicked: monitor.removePort(modelData)
+                        }
+                    }
+                }
+            }
+        }
+
+        Item {
+            Layout.fillWidth: true
+
+            TextArea {
+                anchors.fill: parent
+                anchors.margins: 5
+                wrapMode: Text.NoWrap
+                font.family: "monospace"
+                readOnly: true
+
+                text: monitor.text
+
+                onTextChanged: {
+                    cursorPosition = text.length
+                }
+            }
+        }
+    }
+}
@@ -11,6 +11,8 @@ Tab {
 
     property Settings settings
 
+    signal programmingFinished(bool success)
+
     SplitView {
         anchors.fill: parent
         orientation: Qt.Horizontal
@@ -21,6 +23,7 @@ Tab {
                 if (settings == null) return
                 settings.programmerActive = programmer.isProgramming
             }
+            onProgrammingFinished: programTab.programmingFinished(success)
         }
 
         Item {
@@ -84,6 +87,17 @@ Tab {
                     }
                     combo.onCurrentIndexChanged: updatePort()
 
+                    // Follow the port when it's chosen elsewhere, e.g. the production line.
+                    property string selected: settings.portName
+                    onSelectedChanged: {
+                        for (var i=0; i<portModel.count; ++i) {
+                            if (portModel.get(i).text == selected && combo.currentIndex != i) {
+                                combo.currentIndex = i
+                                return
+                            }
+                        }
+                    }
+
                     function updatePort() {
                         if (portModel.count == 0)
                             settings.portName = "";
@@ -92,6 +106,44 @@ Tab {
                     }
                 }
 
+                PortDiscovery {
+                    id: discovery
+                    onFinished: {
+                        if (answered.length == 0) return
+                        // Fastest port that answered.
+                        for (var i=0; i<portModel.count; ++i) {
+                            if (portModel.get(i).text == answered[0]) {
+                                comboPort.combo.currentIndex = i
+                                return
+                            }
+                        }
+                    }
+                }
+
+                Row {
+                    spacing: 5
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    Button {
+                        text: discovery.running ? "Searching..." : "Find Target"
+                        enabled: !discovery.running && !programmer.isProgramming
+                        onClicked: discovery.start(settings)
+                    }
+                    Label {
+                        anchors.verticalCenter: parent.verticalCenter
+                        width: 120
+                        elide: Text.ElideRight
+                        text: {
+                            var r = discovery.results
+                            if (r.length == 0 || discovery.running) return ""
+                            if (!r[0].answered) return "No target found"
+                            var parts = []
+                            for (var i=0; i<r.length && r[i].answered; ++i)
+                                parts.push(r[i].portName + " " + r[i].latency.toFixed(0) + " ms")
+                            return parts.join(", ")
+                        }
+                    }
+                }
+
                 LabelCombo {
                     id: comboBaud
                     labelText: "Baud Rate |"
@@ -152,6 +204,151 @@ Tab {
                     }
                 }
 
+                GroupBox {
+                    id: resetProfileBox
+                    title: "Reset Profile"
+                    anchors.horizontalCenter: parent.horizontalCenter
+
+                    property var profile: {
+                        settings.resetProfiles
+                        settings.resetType
+                        return settings.portResetProfile(settings.portName)
+                    }
+
+                    function update(key, value) {
+                        var p = profile
+                        p[key] = value
+                        settings.setPortResetProfile(settings.portName, p)
+                    }
+
+                    Column {
+                        spacing: 5
+                        Row {
+                            spacing: 5
+                            Label { text: "Pulse ms |"; anchors.verticalCenter: parent.verticalCenter }
+                            SpinBox {
+                                minimumValue: 0; maximumValue: 1000
+                                value: resetProfileBox.profile.pulseWidth
+                                onValueChanged: if (value != resetProfileBox.profile.pulseWidth) resetProfileBox.update("pulseWidth", value)
+                            }
+                        }
+                        Row {
+                            spacing: 5
+                            Label { text: "Settle ms |"; anchors.verticalCenter: parent.verticalCenter }
+                            SpinBox {
+                                minimumValue: 0; maximumValue: 5000
+                                value: resetProfileBox.profile.settle
+                                onValueChanged: if (value != resetProfileBox.profile.settle) resetProfileBox.update("settle", value)
+                            }
+                        }
+                        Row {
+                            spacing: 5
+                            Label { text: "Timeout ms |"; anchors.verticalCenter: parent.verticalCenter }
+                            SpinBox {
+                                minimumValue: 10; maximumValue: 30000
+                                value: resetProfileBox.profile.timeout
+                                onValueChanged: if (value != resetProfileBox.profile.timeout) resetProfileBox.update("timeout", value)
+                            }
+                        }
+                        TextField {
+                            width: 150
+                            placeholderText: "Response (hex)"
+                            text: resetProfileBox.profile.pattern
+                            onAccepted: resetProfileBox.update("pattern", text)
+                        }
+                        Label {
+                            property var profile: resetProfileBox.profile
+                            text: profile.samples > 0
+                                  ? "Measured " + profile.latency.toFixed(1) + " ms (" + profile.samples + ")"
+                                  : "Not measured"
+                        }
+                    }
+                }
+
+                ProductionLine {
+                    id: productionLine
+                }
+
+                GroupBox {
+                    id: productionBox
+                    title: "Production Line"
+                    anchors.horizontalCenter: parent.horizontalCenter
+
+                    Column {
+                        spacing: 5
+                        Button {
+                            text: productionLine.running ? "Stop" : "Start"
+                            enabled: productionLine.running || !programmer.isProgramming
+                            onClicked: {
+                                if (productionLine.running)
+                                    productionLine.stop()
+                                else
+                                    productionLine.start(programmer, settings)
+                            }
+                        }
+                        CheckBox {
+                            text: "Verify"
+                            checked: productionLine.verify
+                            onCheckedChanged: productionLine.verify = checked
+                        }
+                        TextField {
+                            width: 150
+                            enabled: productionLine.verify
+                            placeholderText: "Expected output"
+                            text: productionLine.verifyPattern
+                            onTextChanged: productionLine.verifyPattern = text
+                        }
+                        Row {
+                            spacing: 5
+                            Label { text: "Verify ms |"; anchors.verticalCenter: parent.verticalCenter }
+                            SpinBox {
+                                enabled: productionLine.verify
+                                minimumValue: 100; maximumValue: 30000
+                                value: productionLine.verifyTimeout
+                                onValueChanged: productionLine.verifyTimeout = value
+                            }
+                        }
+                        Label {
+                            text: {
+                                switch (productionLine.state) {
+                                case ProductionLine.Waiting:
+                                    var queued = productionLine.queue.length
+                                    return queued > 0 ? queued + " units queued" : "Waiting for a unit"
+                                case ProductionLine.Flashing: return "Flashing " + productionLine.currentPort
+                                default: return "Stopped"
+                                }
+                            }
+                        }
+                        Label {
+                            text: productionLine.passed + " passed, " + productionLine.failed + " failed"
+                        }
+                        Label {
+                            text: productionLine.unitsPerHour.toFixed(0) + " units/h, "
+                                  + (productionLine.failureRate * 100).toFixed(1) + "% failed"
+                        }
+                    }
+                }
+
+                LabelCombo {
+                    id: comboLogLevel
+                    labelText: "Log Level |"
+                    height: settingsPane.comboHeight
+                    implicitComboWidth: settingsPane.comboWidth
+                    combo.model: ListModel {
+                        id: logLevelModel
+                        ListElement { text: "Debug"; value: Log.Debug }
+                        ListElement { text: "Info"; value: Log.Info }
+                        ListElement { text: "Warning"; value: Log.Warning }
+                        ListElement { text: "Error"; value: Log.Error }
+                    }
+
+                    value: settings.logLevel
+
+                    combo.onCurrentIndexChanged: {
+                        settings.logLevel = logLevelModel.get(combo.currentIndex).value
+                    }
+                }
+
                 Item { width: parent.width; height: 30 }
 
                 CheckBox {
@@ -171,6 +368,21 @@ Tab {
                     onValueChanged: checked = value
                     onCheckedChanged: settings.logDownload = checked
                 }
+
+                CheckBox {
+                    id: captureTraffic
+                    text: "Capture Traffic"
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    property bool value: settings.captureEnabled
+                    onValueChanged: checked = value
+                    onCheckedChanged: settings.captureEnabled = checked
+                }
+
+                Button {
+                    text: "Export Capture"
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    onClicked: settings.exportCapture(true)
+                }
             }
         }
 
@@ -286,6 +498,15 @@ Tab {
 
                     Text { text: "Retries: " + programmer.resends }
 
+                    Text { // Link metrics
+                        visible: programmer.throughput > 0
+                        text: Math.round(programmer.throughput) + " bytes/s, round trip "
+                              + programmer.rttP50.toFixed(1) + " ms median, "
+                              + programmer.rttP99.toFixed(1) + " ms p99"
+                              + (programmer.isProgramming && programmer.eta >= 0
+                                 ? ", " + Math.ceil(programmer.eta) + " s left" : "")
+                    }
+
                 }
             }
         }
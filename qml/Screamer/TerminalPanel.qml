@@ -1,6 +1,7 @@
 import QtQuick 2.1
 import QtQuick.Controls 1.0
 import QtQuick.Layouts 1.0
+import QtQuick.Dialogs 1.0
 
 import Screamer 1.0
 
@@ -10,6 +11,8 @@ Tab {
 
     property Settings settings: null
 
+    signal programmingFinished(bool success)
+
     SplitView {
         anchors.fill: parent
         orientation: Qt.Horizontal
@@ -159,8 +162,65 @@ Tab {
                     }
                 }
 
+                LabelCombo {
+                    id: comboFraming
+                    labelText: "Framing |"
+                    height: settingsPane.comboHeight
+                    implicitComboWidth: settingsPane.comboWidth
+                    combo.model: ListModel {
+                        id: framingModel
+                        ListElement { text: "None"; value: Settings.NoFraming }
+                        ListElement { text: "SLIP"; value: Settings.Slip }
+                        ListElement { text: "COBS"; value: Settings.Cobs }
+                        ListElement { text: "Length + CRC"; value: Settings.LengthPrefixed }
+                    }
+
+                    value: settings.framing
+
+                    combo.onCurrentIndexChanged: {
+                        settings.framing = framingModel.get(combo.currentIndex).value
+                    }
+                }
+
+                LabelCombo {
+                    id: comboLineEnding
+                    labelText: "Line Ending |"
+                    height: settingsPane.comboHeight
+                    implicitComboWidth: settingsPane.comboWidth
+                    combo.model: ListModel {
+                        id: lineEndingModel
+                        ListElement { text: "LF"; value: Settings.LF }
+                        ListElement { text: "CR"; value: Settings.CR }
+                        ListElement { text: "CR LF"; value: Settings.CRLF }
+                        ListElement { text: "None"; value: Settings.NoLineEnding }
+                    }
+
+                    value: settings.lineEnding
+
+                    combo.onCurrentIndexChanged: {
+                        settings.lineEnding = lineEndingModel.get(combo.currentIndex).value
+                    }
+                }
+
+                Row {
+                    spacing: 5
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    Label { text: "Char ms |"; anchors.verticalCenter: parent.verticalCenter }
+                    SpinBox {
+                        minimumValue: 0; maximumValue: 1000
+                        value: settings.charDelay
+                        onValueChanged: settings.charDelay = value
+                    }
+                    Label { text: "Line ms |"; anchors.verticalCenter: parent.verticalCenter }
+                    SpinBox {
+                        minimumValue: 0; maximumValue: 10000
+                        value: settings.lineDelay
+                        onValueChanged: settings.lineDelay = value
+                    }
+                }
+
                 GroupBox {
-                    title: "Display (No Effect ATM)"
+                    title: "Display"
 //                    width: displayColumn.width
                     anchors.horizontalCenter: parent.horizontalCenter
                     Column {
@@ -205,28 +265,458 @@ Tab {
                     }
                 }
 
+                GroupBox {
+                    title: "Triggers"
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    Column {
+                        spacing: 5
+                        TextField {
+                            id: triggerPattern
+                            width: 150
+                            placeholderText: "Pattern"
+                        }
+                        CheckBox {
+                            id: triggerRegex
+                            text: "Regex"
+                        }
+                        Row {
+                            spacing: 5
+                            Button {
+                                text: "Add"
+                                onClicked: {
+                                    if (triggerPattern.text.length == 0) return
+                                    if (triggerRegex.checked)
+                                        terminal.triggers.addRegex(triggerPattern.text, triggerPattern.text)
+                                    else
+                                        terminal.triggers.addLiteral(triggerPattern.text, triggerPattern.text)
+                                    triggerPattern.text = ""
+                                }
+                            }
+                            Button {
+                                text: "Clear"
+                                onClicked: {
+                                    terminal.triggers.clearPatterns()
+                                    terminal.triggers.clearEvents()
+                                }
+                            }
+                        }
+                        Label {
+                            width: 150
+                            elide: Text.ElideRight
+                            text: terminal.triggers.patterns.join(", ")
+                        }
+                        Label {
+                            width: 150
+                            elide: Text.ElideRight
+                            property var events: terminal.triggers.events
+                            text: {
+                                if (events.length == 0) return "No matches"
+                                var e = events[events.length - 1]
+                                return terminal.triggers.eventCount + " matches. Last: " + e.name + " @" + e.offset
+                            }
+                        }
+                    }
+                }
+
+                GroupBox {
+                    title: "Plot"
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    Column {
+                        spacing: 5
+                        CheckBox {
+                            text: "Enable"
+                            checked: terminal.telemetry.enabled
+                            onCheckedChanged: terminal.telemetry.enabled = checked
+                        }
+                        LabelCombo {
+                            id: comboPlotWindow
+                            labelText: "Window |"
+                            height: settingsPane.comboHeight
+                            implicitComboWidth: 80
+                            combo.model: ListModel {
+                                id: plotWindowModel
+                                ListElement { text: "1k"; value: 1000 }
+                                ListElement { text: "10k"; value: 10000 }
+                                ListElement { text: "100k"; value: 100000 }
+                                ListElement { text: "1M"; value: 1000000 }
+                            }
+                            combo.currentIndex: 1
+                            combo.onCurrentIndexChanged: plot.window = plotWindowModel.get(combo.currentIndex).value
+                        }
+                        Button {
+                            text: "Clear"
+                            onClicked: terminal.telemetry.clear()
+                        }
+                        Label {
+                            text: terminal.telemetry.channelCount + " channels, " + terminal.telemetry.sampleCount + " samples"
+                        }
+                    }
+                }
+
+                GroupBox {
+                    title: "Script"
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    Column {
+                        spacing: 5
+                        Row {
+                            spacing: 5
+                            Button {
+                                text: "Load"
+                                enabled: !terminal.script.running
+                                onClicked: scriptFileDialog.open()
+                            }
+                            Button {
+                                text: terminal.script.running ? "Stop" : "Run"
+                                enabled: terminal.active && terminal.script.stepCount > 0
+                                onClicked: {
+                                    if (terminal.script.running)
+                                        terminal.script.stop()
+                                    else
+                                        terminal.script.start()
+                                }
+                            }
+                        }
+                        CheckBox {
+                            id: scriptAfterProgramming
+                            text: "Run After Programming"
+                        }
+                        Label {
+                            width: 150
+                            elide: Text.ElideRight
+                            property var results: terminal.script.results
+                            text: {
+                                if (terminal.script.stepCount == 0) return "No script"
+                                if (terminal.script.running) return "Step " + terminal.script.currentStep + " of " + terminal.script.stepCount
+                                if (results.length == 0) return terminal.script.stepCount + " steps"
+                                var r = results[results.length - 1]
+                                return (terminal.script.passed ? "PASS" : "FAIL") + ". Last: " + r.type + " " + r.latency.toFixed(1) + " ms"
+                            }
+                        }
+                        Label {
+                            width: 150
+                            elide: Text.ElideRight
+                            visible: text.length > 0
+                            text: terminal.script.errorString
+                        }
+
+                        FileDialog {
+                            id: scriptFileDialog
+                            title: "Choose a test script..."
+                            nameFilters: ["Scripts (*.txt *.script)", "All Files (*)"]
+                            onAccepted: terminal.script.load(scriptFileDialog.fileUrl)
+                        }
+
+                        Connections {
+                            target: tab
+                            onProgrammingFinished: {
+                                if (success && scriptAfterProgramming.checked && terminal.active)
+                                    terminal.script.start()
+                            }
+                        }
+                    }
+                }
+
+                GroupBox {
+                    title: "Log to Disk"
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    Column {
+                        spacing: 5
+                        CheckBox {
+                            text: "Enable"
+                            property bool value: settings.terminalLogEnabled
+                            onValueChanged: checked = value
+                            onCheckedChanged: settings.terminalLogEnabled = checked
+                        }
+                        CheckBox {
+                            text: "Timestamp Lines"
+                            property bool value: settings.terminalLogTimestamps
+                            onValueChanged: checked = value
+                            onCheckedChanged: settings.terminalLogTimestamps = checked
+                        }
+                        CheckBox {
+                            text: "Compress"
+                            property bool value: settings.terminalLogCompress
+                            onValueChanged: checked = value
+                            onCheckedChanged: settings.terminalLogCompress = checked
+                        }
+                        Row {
+                            spacing: 5
+                            Label { text: "Rotate MB |"; anchors.verticalCenter: parent.verticalCenter }
+                            SpinBox {
+                                minimumValue: 0; maximumValue: 4096
+                                value: settings.terminalLogMaxSize
+                                onValueChanged: settings.terminalLogMaxSize = value
+                            }
+                        }
+                        Row {
+                            spacing: 5
+                            Label { text: "Rotate Min |"; anchors.verticalCenter: parent.verticalCenter }
+                            SpinBox {
+                                minimumValue: 0; maximumValue: 1440
+                                value: settings.terminalLogRotateMinutes
+                                onValueChanged: settings.terminalLogRotateMinutes = value
+                            }
+                        }
+                    }
+                }
+
                 Item { width: parent.width; height: 30 }
             }
 
 
         }
 
-        Item {
+        SplitView {
+            orientation: Qt.Vertical
             Layout.fillWidth: true
 
-            TextArea {
-                id: terminalView
-                anchors.fill: parent
-                anchors.margins: 5
-                wrapMode: wrap.checked ? Text.Wrap : Text.NoWrap
+            Item {
+                Layout.fillHeight: true
 
-                text: terminal.text
+                TextArea {
+                    id: terminalView
+                    anchors { left: parent.left; right: parent.right; top: parent.top; bottom: sendRow.top; margins: 5 }
+                    wrapMode: wrap.checked ? Text.Wrap : Text.NoWrap
 
-                onTextChanged: {
-                    cursorPosition = text.length
+                    text: terminal.text
+
+                    onTextChanged: {
+                        cursorPosition = text.length
+                    }
+                }
+
+                RowLayout {
+                    id: sendRow
+                    anchors { left: parent.left; right: parent.right; bottom: parent.bottom; margins: 5 }
+                    spacing: 5
+
+                    TextField {
+                        id: sendField
+                        Layout.fillWidth: true
+                        placeholderText: "Send..."
+                        enabled: terminal.active
+                        onAccepted: {
+                            terminal.sendText(text)
+                            text = ""
+                        }
+                    }
+                    Button {
+                        text: "Send File"
+                        enabled: terminal.active
+                        onClicked: sendFileDialog.open()
+                    }
+                    ProgressBar {
+                        visible: terminal.transmit.busy
+                        value: terminal.transmit.progress
+                    }
+                    Button {
+                        text: "Cancel"
+                        visible: terminal.transmit.busy
+                        onClicked: terminal.transmit.cancel()
+                    }
+
+                    FileDialog {
+                        id: sendFileDialog
+                        title: "Choose a file to send..."
+                        nameFilters: ["All Files (*)"]
+                        onAccepted: terminal.sendFile(sendFileDialog.fileUrl)
+                    }
+                }
+            }
+
+            Item {
+                id: framePane
+                visible: settings.framing != Settings.NoFraming
+                Layout.minimumHeight: 150
+
+                Text {
+                    id: frameCount
+                    anchors { left: parent.left; top: parent.top; margins: 5 }
+                    text: terminal.frames.total + " frames"
+                }
+
+                ListView {
+                    id: frameView
+                    anchors { left: parent.left; right: parent.right; top: frameCount.bottom; bottom: parent.bottom; margins: 5 }
+                    clip: true
+                    model: terminal.frames
+
+                    delegate: Text {
+                        width: frameView.width
+                        elide: Text.ElideRight
+                        font.family: "monospace"
+                        text: frameIndex + " [" + length + "] " + hex + "  |" + model.text + "|"
+                    }
+
+                    onCountChanged: positionViewAtEnd()
                 }
             }
 
+            Item {
+                id: searchPane
+                Layout.minimumHeight: searchRow.height + 10
+                height: 150
+
+                property var scrollback: terminal.scrollback
+
+                function runSearch() {
+                    scrollback.search(searchField.text, searchRegex.checked, searchCase.checked)
+                }
+
+                RowLayout {
+                    id: searchRow
+                    anchors { left: parent.left; right: parent.right; top: parent.top; margins: 5 }
+                    spacing: 5
+
+                    TextField {
+                        id: searchField
+                        Layout.fillWidth: true
+                        placeholderText: "Search " + searchPane.scrollback.lineCount + " lines..."
+                        onAccepted: searchPane.runSearch()
+                    }
+                    CheckBox {
+                        id: searchRegex
+                        text: "Regex"
+                        onCheckedChanged: if (searchField.text.length > 0) searchPane.runSearch()
+                    }
+                    CheckBox {
+                        id: searchCase
+                        text: "Case"
+                        onCheckedChanged: if (searchField.text.length > 0) searchPane.runSearch()
+                    }
+                    Button {
+                        text: "Prev"
+                        enabled: searchView.count > 0
+                        onClicked: searchView.currentIndex = Math.max(0, searchView.currentIndex - 1)
+                    }
+                    Button {
+                        text: "Next"
+                        enabled: searchView.count > 0
+                        onClicked: searchView.currentIndex = Math.min(searchView.count - 1, searchView.currentIndex + 1)
+                    }
+                    Label {
+                        text: {
+                            var s = searchPane.scrollback
+                            if (s.searching) return "Searching..."
+                            if (s.errorString.length > 0) return s.errorString
+                            if (searchView.count == 0) return ""
+                            return (searchView.currentIndex + 1) + "/" + searchView.count + " of "
+                                    + s.matchCount + " (" + s.searchTime.toFixed(0) + " ms)"
+                        }
+                    }
+                }
+
+                ListView {
+                    id: searchView
+                    anchors { left: parent.left; right: parent.right; top: searchRow.bottom; bottom: parent.bottom; margins: 5 }
+                    clip: true
+                    model: searchPane.scrollback.results
+                    highlightMoveDuration: 0
+                    highlight: Rectangle { color: "#ddeeff" }
+
+                    delegate: Text {
+                        width: searchView.width
+                        elide: Text.ElideRight
+                        font.family: "monospace"
+                        textFormat: Text.StyledText
+                        text: (modelData.line + 1) + ": " + modelData.html
+
+                        MouseArea {
+                            anchors.fill: parent
+                            onClicked: searchView.currentIndex = index
+                        }
+                    }
+
+                    // Newest match first.
+                    onCountChanged: currentIndex = count - 1
+                }
+            }
+
+            Item {
+                id: plotPane
+                visible: terminal.telemetry.enabled
+                Layout.minimumHeight: 150
+
+                Canvas {
+                    id: plot
+                    anchors.fill: parent
+                    anchors.margins: 5
+
+                    property int window: 10000
+                    property bool dirty: true
+                    property var colors: ["#d62728", "#1f77b4", "#2ca02c", "#ff7f0e",
+                                          "#9467bd", "#8c564b", "#e377c2", "#7f7f7f"]
+
+                    onWindowChanged: dirty = true
+                    onWidthChanged: dirty = true
+                    onHeightChanged: dirty = true
+
+                    Connections {
+                        target: terminal.telemetry
+                        onSamplesChanged: plot.dirty = true
+                    }
+
+                    // Repaint at most 30 times a second however fast lines arrive.
+                    Timer {
+                        interval: 33
+                        repeat: true
+                        running: plotPane.visible
+                        onTriggered: {
+                            if (!plot.dirty) return
+                            plot.dirty = false
+                            plot.requestPaint()
+                        }
+                    }
+
+                    onPaint: {
+                        var ctx = getContext("2d")
+                        ctx.fillStyle = "white"
+                        ctx.fillRect(0, 0, width, height)
+
+                        var telemetry = terminal.telemetry
+                        var points = Math.max(1, Math.floor(width))
+                        var data = []
+                        var lo = Infinity, hi = -Infinity
+                        var end = 0
+                        for (var ch = 0; ch < telemetry.channelCount; ++ch) {
+                            end = Math.max(end, telemetry.channelSamples(ch))
+                        }
+                        var start = Math.max(0, end - window)
+
+                        for (ch = 0; ch < telemetry.channelCount; ++ch) {
+                            var s = telemetry.series(ch, start, end, points)
+                            for (var i = 0; i < s.length; i += 3) {
+                                lo = Math.min(lo, s[i+1])
+                                hi = Math.max(hi, s[i+2])
+                            }
+                            data.push(s)
+                        }
+                        if (lo > hi) return
+                        if (lo == hi) { lo -= 1; hi += 1 }
+
+                        var sx = width / Math.max(1, end - start)
+                        var sy = (height - 2) / (hi - lo)
+
+                        ctx.lineWidth = 1
+                        for (ch = 0; ch < data.length; ++ch) {
+                            var series = data[ch]
+                            ctx.strokeStyle = colors[ch % colors.length]
+                            ctx.beginPath()
+                            // One vertical span per bucket keeps spikes visible at any zoom.
+                            for (i = 0; i < series.length; i += 3) {
+                                var x = Math.floor((series[i] - start) * sx) + 0.5
+                                ctx.moveTo(x, height - 1 - (series[i+1] - lo) * sy)
+                                ctx.lineTo(x, height - 1 - (series[i+2] - lo) * sy - 1)
+                            }
+                            ctx.stroke()
+                        }
+
+                        ctx.fillStyle = "black"
+                        ctx.fillText(hi.toPrecision(4), 2, 10)
+                        ctx.fillText(lo.toPrecision(4), 2, height - 2)
+                    }
+                }
+            }
         }
     }
 
@@ -13,7 +13,14 @@ ApplicationWindow {
     TabView {
         id: tabView
         anchors.fill: parent
-        ProgrammerPanel { settings: settings }
-        TerminalPanel { settings: settings }
+        ProgrammerPanel {
+            settings: settings
+            onProgrammingFinished: terminalPanel.programmingFinished(success)
+        }
+        TerminalPanel {
+            id: terminalPanel
+            settings: settings
+        }
+        MonitorPanel { settings: settings }
     }
 }
@@ -0,0 +1,55 @@
+#include "resetprofile.h"
+
+#include <QtCore/qmath.h>
+
+// Weight of the newest sample in the running average.
+#define RESET_LATENCY_WEIGHT 0.25
+// Measured latency is multiplied by this to give the deadline, and the
+// deadline never goes below RESET_MIN_DEADLINE ms.
+#define RESET_DEADLINE_FACTOR 4
+#define RESET_MIN_DEADLINE 50
+
+ResetProfile::ResetProfile() :
+    pulseWidth(10),
+    settle(10),
+    timeout(2000),
+    latency(0),
+    samples(0)
+{
+}
+
+int ResetProfile::deadline() const
+{
+    if (samples == 0 || latency <= 0) return timeout;
+    return qBound(RESET_MIN_DEADLINE, int(qCeil(latency * RESET_DEADLINE_FACTOR)), timeout);
+}
+
+void ResetProfile::addSample(qreal msecs)
+{
+    latency = (samples == 0) ? msecs : latency + RESET_LATENCY_WEIGHT * (msecs - latency);
+    ++samples;
+}
+
+QVariantMap ResetProfile::toVariant() const
+{
+    QVariantMap map;
+    map["pulseWidth"] = pulseWidth;
+    map["settle"] = settle;
+    map["timeout"] = timeout;
+    map["pattern"] = QString::fromLatin1(pattern.toHex());
+    map["latency"] = latency;
+    map["samples"] = samples;
+    return map;
+}
+
+ResetProfile ResetProfile::fromVariant(const QVariantMap &map)
+{
+    ResetProfile profile;
+    profile.pulseWidth = map.value("pulseWidth", profile.pulseWidth).toInt();
+    profile.settle = map.value("settle", profile.settle).toInt();
+    profile.timeout = map.value("timeout", profile.timeout).toInt();
+    profile.pattern = QByteArray::fromHex(map.value("pattern").toString().toLatin1());
+    profile.latency = map.value("latency", 0).toReal();
+    profile.samples = map.value("samples", 0).toInt();
+    return profile;
+}
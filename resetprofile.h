@@ -0,0 +1,36 @@
+#ifndef RESETPROFILE_H
+#define RESETPROFILE_H
+
+#include <QByteArray>
+#include <QVariantMap>
+
+/*
+ * How to reset the board on one particular port, and how long it has
+ * actually been taking to come back.
+ *
+ * With a pattern set, a reset finishes as soon as the pattern is read back
+ * (or timeout passes); without one it waits settle milliseconds instead.
+ * latency is a running average of the time from releasing reset to seeing
+ * the pattern, and is used to size the wait next time.
+ */
+struct ResetProfile
+{
+    ResetProfile();
+
+    int pulseWidth;     // ms the reset line is held
+    int settle;         // ms to wait when there is no pattern
+    int timeout;        // ms to wait for the pattern before giving up
+    QByteArray pattern;
+    qreal latency;      // ms, 0 until measured
+    int samples;
+
+    // The deadline for the pattern, from the measured latency when there is
+    // one. Never longer than timeout.
+    int deadline() const;
+    void addSample(qreal msecs);
+
+    QVariantMap toVariant() const;
+    static ResetProfile fromVariant(const QVariantMap &map);
+};
+
+#endif // RESETPROFILE_H
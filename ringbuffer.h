@@ -0,0 +1,89 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QVector>
+
+/*
+ * Fixed capacity circular buffer. Once full, appending overwrites the oldest
+ * element, so memory use never grows past the capacity given at construction.
+ * Index 0 is always the oldest element held.
+ */
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(int capacity = 1024) :
+        m_data(qMax(1, capacity)),
+        m_head(0),
+        m_size(0)
+    {
+    }
+
+    int capacity() const { return m_data.size(); }
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    bool isFull() const { return m_size == m_data.size(); }
+
+    void append(const T &value)
+    {
+        m_data[(m_head + m_size) % m_data.size()] = value;
+        if (m_size < m_data.size())
+            ++m_size;
+        else
+            m_head = (m_head + 1) % m_data.size();
+    }
+
+    // Returns the slot the next element goes into, for filling in place. Its
+    // previous contents are left as is so buffers it holds can be reused.
+    T &append()
+    {
+        T &slot = m_data[(m_head + m_size) % m_data.size()];
+        if (m_size < m_data.size())
+            ++m_size;
+        else
+            m_head = (m_head + 1) % m_data.size();
+        return slot;
+    }
+
+    const T &at(int i) const { return m_data.at((m_head + i) % m_data.size()); }
+    T &operator[](int i) { return m_data[(m_head + i) % m_data.size()]; }
+    const T &first() const { return at(0); }
+    const T &last() const { return at(m_size - 1); }
+
+    void removeFirst(int count = 1)
+    {
+        count = qMin(count, m_size);
+        m_head = (m_head + count) % m_data.size();
+        m_size -= count;
+    }
+
+    void clear()
+    {
+        m_data.fill(T());
+        m_head = 0;
+        m_size = 0;
+    }
+
+    // Changing the capacity drops the oldest elements that no longer fit.
+    void setCapacity(int capacity)
+    {
+        capacity = qMax(1, capacity);
+        if (capacity == m_data.size()) return;
+
+        QVector<T> data(capacity);
+        const int keep = qMin(m_size, capacity);
+        for (int i = 0; i < keep; ++i)
+            data[i] = at(m_size - keep + i);
+
+        m_data = data;
+        m_head = 0;
+        m_size = keep;
+    }
+
+private:
+    QVector<T> m_data;
+    int m_head;
+    int m_size;
+};
+
+#endif // RINGBUFFER_H
@@ -0,0 +1,405 @@
+#include "scrollbackindex.h"
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QByteArrayMatcher>
+#include <QRegularExpression>
+#include <QDebug>
+#include <algorithm>
+#include <string.h>
+#include "ringbuffer.h"
+
+#define SCROLLBACK_BLOCK_SIZE 65536
+#define SCROLLBACK_MAX_BYTES (128*1024*1024)
+#define SCROLLBACK_MAX_LINE 4096
+#define SCROLLBACK_MAX_RESULTS 1000
+// Characters of context shown either side of a match.
+#define SCROLLBACK_CONTEXT 80
+
+static uchar s_lower[256];
+
+static bool initLowerTable()
+{
+    for (int i = 0; i < 256; ++i)
+        s_lower[i] = (i >= 'A' && i <= 'Z') ? uchar(i - 'A' + 'a') : uchar(i);
+    return true;
+}
+
+static const bool s_lowerReady = initLowerTable();
+
+const uchar *ScrollbackIndex::lowerTable()
+{
+    Q_UNUSED(s_lowerReady);
+    return s_lower;
+}
+
+/*
+ * Runs one search over a snapshot of the blocks. The snapshot shares the
+ * block data, so the index can keep appending and dropping blocks while the
+ * search runs.
+ */
+class ScrollbackSearch : public QThread
+{
+public:
+    ScrollbackSearch(const QVector<QSharedPointer<const ScrollbackIndex::Block> > &blocks,
+                     const QString &pattern, bool regex, bool caseSensitive) :
+        m_blocks(blocks),
+        m_pattern(pattern),
+        m_regex(regex),
+        m_caseSensitive(caseSensitive),
+        m_results(SCROLLBACK_MAX_RESULTS),
+        m_count(0),
+        m_elapsed(0)
+    {
+    }
+
+    void cancel() { m_cancel.storeRelease(1); }
+    bool cancelled() const { return m_cancel.loadAcquire(); }
+
+    RingBuffer<ScrollbackIndex::Match> m_results;
+    qint64 m_count;
+    qreal m_elapsed;
+    QString m_error;
+
+protected:
+    void run();
+
+private:
+    void searchLiteral(const ScrollbackIndex::Block &block, const QByteArrayMatcher &matcher,
+                       const QVector<uint> &trigrams, QByteArray *lowered);
+    void searchRegex(const ScrollbackIndex::Block &block, const QRegularExpression &expression);
+    void addMatch(const ScrollbackIndex::Block &block, int position, int length);
+
+    QVector<QSharedPointer<const ScrollbackIndex::Block> > m_blocks;
+    QString m_pattern;
+    bool m_regex;
+    bool m_caseSensitive;
+    QAtomicInt m_cancel;
+};
+
+void ScrollbackSearch::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if (m_regex) {
+        QRegularExpression expression(m_pattern, m_caseSensitive
+                                      ? QRegularExpression::NoPatternOption
+                                      : QRegularExpression::CaseInsensitiveOption);
+        if (!expression.isValid()) {
+            m_error = expression.errorString();
+            return;
+        }
+        expression.optimize();
+
+        for (int i = 0; i < m_blocks.size() && !cancelled(); ++i)
+            searchRegex(*m_blocks.at(i), expression);
+    } else {
+        const uchar *lower = ScrollbackIndex::lowerTable();
+        QByteArray query = m_pattern.toUtf8();
+        QByteArray loweredQuery = query;
+        for (int i = 0; i < loweredQuery.size(); ++i)
+            loweredQuery[i] = char(lower[uchar(loweredQuery.at(i))]);
+
+        // The filter is built from lower-cased text, so it works for both.
+        QVector<uint> trigrams;
+        const uchar *q = reinterpret_cast<const uchar *>(loweredQuery.constData());
+        for (int i = 0; i + 2 < loweredQuery.size(); ++i)
+            trigrams.append(ScrollbackIndex::trigram(q[i], q[i+1], q[i+2]));
+
+        QByteArrayMatcher matcher(m_caseSensitive ? query : loweredQuery);
+        QByteArray lowered;
+        for (int i = 0; i < m_blocks.size() && !cancelled(); ++i)
+            searchLiteral(*m_blocks.at(i), matcher, trigrams, m_caseSensitive ? 0 : &lowered);
+    }
+
+    m_elapsed = timer.nsecsElapsed() / 1000000.0;
+}
+
+void ScrollbackSearch::searchLiteral(const ScrollbackIndex::Block &block, const QByteArrayMatcher &matcher,
+                                     const QVector<uint> &trigrams, QByteArray *lowered)
+{
+    for (int i = 0; i < trigrams.size(); ++i) {
+        const uint t = trigrams.at(i);
+        if (!(block.filter.at(t >> 6) & (Q_UINT64_C(1) << (t & 63))))
+            return;
+    }
+
+    const QByteArray *text = &block.text;
+    if (lowered) {
+        const uchar *lower = ScrollbackIndex::lowerTable();
+        lowered->resize(block.text.size());
+        const uchar *src = reinterpret_cast<const uchar *>(block.text.constData());
+        char *dst = lowered->data();
+        for (int i = 0; i < block.text.size(); ++i)
+            dst[i] = char(lower[src[i]]);
+        text = lowered;
+    }
+
+    const int length = matcher.pattern().size();
+    int position = matcher.indexIn(*text, 0);
+    while (position >= 0) {
+        addMatch(block, position, length);
+        position = matcher.indexIn(*text, position + qMax(1, length));
+    }
+}
+
+void ScrollbackSearch::searchRegex(const ScrollbackIndex::Block &block, const QRegularExpression &expression)
+{
+    const int lines = block.lineStarts.size();
+    for (int i = 0; i < lines; ++i) {
+        const int start = block.lineStarts.at(i);
+        const int end = (i + 1 < lines ? block.lineStarts.at(i + 1) : block.text.size()) - 1;
+        const QString line = QString::fromLatin1(block.text.constData() + start, end - start);
+
+        QRegularExpressionMatchIterator it = expression.globalMatch(line);
+        while (it.hasNext()) {
+            QRegularExpressionMatch m = it.next();
+            if (m.capturedLength() == 0) break;
+            addMatch(block, start + m.capturedStart(), m.capturedLength());
+        }
+    }
+}
+
+void ScrollbackSearch::addMatch(const ScrollbackIndex::Block &block, int position, int length)
+{
+    const QVector<int> &starts = block.lineStarts;
+    const int index = int(std::upper_bound(starts.constBegin(), starts.constEnd(), position) - starts.constBegin()) - 1;
+    const int start = starts.at(index);
+    const int end = (index + 1 < starts.size() ? starts.at(index + 1) : block.text.size()) - 1;
+
+    ++m_count;
+    ScrollbackIndex::Match &match = m_results.append();
+    match.line = block.firstLine + index;
+    match.column = position - start;
+    match.length = qMin(length, end - position);
+    match.text = block.text.mid(start, end - start);
+}
+
+
+ScrollbackIndex::ScrollbackIndex(QObject *parent) :
+    QObject(parent),
+    m_current(new Block()),
+    m_bytes(0),
+    m_lines(0),
+    m_search(0),
+    m_restart(false),
+    m_regex(false),
+    m_caseSensitive(false),
+    m_matchCount(0),
+    m_searchTime(0)
+{
+    m_current->text.reserve(SCROLLBACK_BLOCK_SIZE + SCROLLBACK_MAX_LINE);
+}
+
+ScrollbackIndex::~ScrollbackIndex()
+{
+    if (m_search) {
+        m_search->cancel();
+        m_search->wait();
+        delete m_search;
+    }
+    delete m_current;
+}
+
+void ScrollbackIndex::append(const QByteArray &data)
+{
+    append(data.constData(), data.size());
+}
+
+void ScrollbackIndex::append(const char *data, int length)
+{
+    const qint64 lines = m_lines;
+
+    const char *p = data;
+    const char *end = data + length;
+    while (p < end) {
+        const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+        const char *stop = newline ? newline : end;
+
+        if (m_partial.isEmpty() && newline) {
+            addLine(p, int(stop - p));
+        } else {
+            const int room = SCROLLBACK_MAX_LINE - m_partial.size();
+            m_partial.append(p, qMin(int(stop - p), room));
+            if (newline || m_partial.size() >= SCROLLBACK_MAX_LINE) {
+                addLine(m_partial.constData(), m_partial.size());
+                m_partial.resize(0);
+            }
+        }
+        p = newline ? newline + 1 : end;
+    }
+
+    if (m_lines != lines)
+        emit lineCountChanged();
+}
+
+void ScrollbackIndex::addLine(const char *data, int length)
+{
+    if (length > 0 && data[length - 1] == '\r') --length;
+
+    if (m_current->lineStarts.isEmpty())
+        m_current->firstLine = m_lines;
+    m_current->lineStarts.append(m_current->text.size());
+    m_current->text.append(data, length);
+    m_current->text.append('\n');
+
+    const uchar *src = reinterpret_cast<const uchar *>(data);
+    quint64 *filter = m_current->filter.data();
+    for (int i = 0; i + 2 < length; ++i) {
+        const uint t = trigram(s_lower[src[i]], s_lower[src[i+1]], s_lower[src[i+2]]);
+        filter[t >> 6] |= Q_UINT64_C(1) << (t & 63);
+    }
+
+    ++m_lines;
+    if (m_current->text.size() >= SCROLLBACK_BLOCK_SIZE)
+        seal();
+}
+
+void ScrollbackIndex::seal()
+{
+    m_bytes += m_current->text.size();
+    m_blocks.append(QSharedPointer<const Block>(m_current));
+    m_current = new Block();
+    m_current->text.reserve(SCROLLBACK_BLOCK_SIZE + SCROLLBACK_MAX_LINE);
+
+    // A running search holds its own references to anything dropped here.
+    int drop = 0;
+    while (m_bytes > SCROLLBACK_MAX_BYTES && drop < m_blocks.size() - 1)
+        m_bytes -= m_blocks.at(drop++)->text.size();
+    if (drop > 0)
+        m_blocks.remove(0, drop);
+}
+
+void ScrollbackIndex::search(QString pattern, bool regex, bool caseSensitive)
+{
+    m_pattern = pattern;
+    m_regex = regex;
+    m_caseSensitive = caseSensitive;
+
+    if (m_search) {
+        // Start again once the old search notices it was cancelled.
+        m_search->cancel();
+        m_restart = true;
+        return;
+    }
+
+    if (pattern.isEmpty()) {
+        m_results.clear();
+        m_matchCount = 0;
+        m_searchTime = 0;
+        m_errorString.clear();
+        emit resultsChanged();
+        return;
+    }
+
+    QVector<QSharedPointer<const Block> > blocks = m_blocks;
+    if (!m_current->lineStarts.isEmpty())
+        blocks.append(QSharedPointer<const Block>(new Block(*m_current)));
+
+    m_search = new ScrollbackSearch(blocks, pattern, regex, caseSensitive);
+    connect(m_search, &QThread::finished, this, &ScrollbackIndex::searchFinished);
+    m_search->start();
+    emit searchingChanged(true);
+}
+
+void ScrollbackIndex::cancelSearch()
+{
+    m_restart = false;
+    if (m_search)
+        m_search->cancel();
+}
+
+void ScrollbackIndex::searchFinished()
+{
+    ScrollbackSearch *done = m_search;
+    m_search = 0;
+    if (!done) return;
+
+    done->wait();
+    if (!done->cancelled()) {
+        m_results.clear();
+        for (int i = 0; i < done->m_results.size(); ++i) {
+            const Match &match = done->m_results.at(i);
+
+            // Keep a window of the line around the match.
+            const int from = qMax(0, match.column - SCROLLBACK_CONTEXT);
+            const int to = qMin(match.text.size(), match.column + match.length + SCROLLBACK_CONTEXT);
+            const QString before = QString::fromUtf8(match.text.mid(from, match.column - from));
+            const QString matched = QString::fromUtf8(match.text.mid(match.column, match.length));
+            const QString after = QString::fromUtf8(match.text.mid(match.column + match.length,
+                                                                   to - match.column - match.length));
+
+            QVariantMap result;
+            result["line"] = match.line;
+            result["column"] = match.column;
+            result["length"] = match.length;
+            result["text"] = QString::fromUtf8(match.text);
+            result["html"] = QString("%1%2<b><font color=\"#d62728\">%3</font></b>%4%5")
+                    .arg(from > 0 ? "..." : "")
+                    .arg(before.toHtmlEscaped())
+                    .arg(matched.toHtmlEscaped())
+                    .arg(after.toHtmlEscaped())
+                    .arg(to < match.text.size() ? "..." : "");
+            m_results.append(result);
+        }
+        m_matchCount = done->m_count;
+        m_searchTime = done->m_elapsed;
+        m_errorString = done->m_error;
+        emit resultsChanged();
+    }
+    delete done;
+
+    if (m_restart) {
+        m_restart = false;
+        search(m_pattern, m_regex, m_caseSensitive);
+    }
+    if (!m_search)
+        emit searchingChanged(false);
+}
+
+void ScrollbackIndex::clear()
+{
+    cancelSearch();
+    m_blocks.clear();
+    delete m_current;
+    m_current = new Block();
+    m_bytes = 0;
+    m_lines = 0;
+    m_partial.resize(0);
+    m_results.clear();
+    m_matchCount = 0;
+    emit lineCountChanged();
+    emit resultsChanged();
+}
+
+qint64 ScrollbackIndex::lineCount() const
+{
+    return m_lines;
+}
+
+bool ScrollbackIndex::searching() const
+{
+    return m_search != 0;
+}
+
+QVariantList ScrollbackIndex::results() const
+{
+    return m_results;
+}
+
+qint64 ScrollbackIndex::matchCount() const
+{
+    return m_matchCount;
+}
+
+qreal ScrollbackIndex::searchTime() const
+{
+    return m_searchTime;
+}
+
+QString ScrollbackIndex::errorString() const
+{
+    return m_errorString;
+}
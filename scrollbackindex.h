@@ -0,0 +1,110 @@
+#ifndef SCROLLBACKINDEX_H
+#define SCROLLBACKINDEX_H
+
+#include <QObject>
+#include <QVector>
+#include <QVariantList>
+#include <QByteArray>
+#include <QSharedPointer>
+
+class ScrollbackSearch;
+
+/*
+ * Searchable history of everything the terminal has displayed.
+ *
+ * Lines are appended into 64 KB blocks. Each block records where its lines
+ * start and carries a 65536 bit trigram filter: one bit per hashed,
+ * lower-cased three byte sequence it contains. A literal search only scans
+ * the blocks whose filter holds every trigram of the query, which for any
+ * query of three or more characters is usually a handful out of thousands.
+ * Regular expressions are run line by line over every block.
+ *
+ * Full blocks are immutable and shared with the search thread, so searches
+ * run in the background while lines keep arriving. Only the oldest blocks
+ * are dropped once the history passes its size limit.
+ */
+class ScrollbackIndex : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(qint64 lineCount READ lineCount NOTIFY lineCountChanged)
+    Q_PROPERTY(bool searching READ searching NOTIFY searchingChanged)
+    Q_PROPERTY(QVariantList results READ results NOTIFY resultsChanged)
+    Q_PROPERTY(qint64 matchCount READ matchCount NOTIFY resultsChanged)
+    Q_PROPERTY(qreal searchTime READ searchTime NOTIFY resultsChanged)
+    Q_PROPERTY(QString errorString READ errorString NOTIFY resultsChanged)
+
+public:
+    struct Block {
+        Block() : firstLine(0), filter(1024, 0) {}
+        qint64 firstLine;
+        QByteArray text;           // Lines, each ending in '\n'
+        QVector<int> lineStarts;
+        QVector<quint64> filter;   // Trigram bits
+    };
+
+    struct Match {
+        qint64 line;
+        int column;
+        int length;
+        QByteArray text;
+    };
+
+    explicit ScrollbackIndex(QObject *parent = 0);
+    ~ScrollbackIndex();
+
+    void append(const char *data, int length);
+    void append(const QByteArray &data);
+
+    // Starts a background search, cancelling any search still running.
+    // Results hold the most recent matches, newest last.
+    Q_INVOKABLE void search(QString pattern, bool regex, bool caseSensitive);
+    Q_INVOKABLE void cancelSearch();
+    Q_INVOKABLE void clear();
+
+    qint64 lineCount() const;
+    bool searching() const;
+    QVariantList results() const;
+    qint64 matchCount() const;
+    qreal searchTime() const;
+    QString errorString() const;
+
+    static inline uint trigram(uchar a, uchar b, uchar c);
+    static const uchar *lowerTable();
+
+signals:
+    void lineCountChanged();
+    void searchingChanged(bool arg);
+    void resultsChanged();
+
+private slots:
+    void searchFinished();
+
+private:
+    void seal();
+    void addLine(const char *data, int length);
+
+    QVector<QSharedPointer<const Block> > m_blocks;
+    Block *m_current;
+    qint64 m_bytes;
+    qint64 m_lines;
+    QByteArray m_partial;
+
+    ScrollbackSearch *m_search;
+    bool m_restart;
+    QString m_pattern;
+    bool m_regex;
+    bool m_caseSensitive;
+
+    QVariantList m_results;
+    qint64 m_matchCount;
+    qreal m_searchTime;
+    QString m_errorString;
+};
+
+uint ScrollbackIndex::trigram(uchar a, uchar b, uchar c)
+{
+    return ((uint(a) << 16 | uint(b) << 8 | c) * 2654435761u) >> 16;
+}
+
+#endif // SCROLLBACKINDEX_H
@@ -0,0 +1,417 @@
+#include "serialcapture.h"
+
+#include <QDebug>
+#include <QDateTime>
+#include <QTextStream>
+#include <QThread>
+#include <QWaitCondition>
+#include <QList>
+#include <QtEndian>
+#include <string.h>
+#include "hexformatter.h"
+
+#define CAPTURE_MAGIC "SCRMCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 16
+#define CAPTURE_RECORD_HEADER_SIZE 16
+#define CAPTURE_BUFFER_SIZE 65536
+#define CAPTURE_FLUSH_INTERVAL 500
+// Full buffers waiting for the disk. Past this they're dropped rather than
+// let memory grow without bound.
+#define CAPTURE_MAX_PENDING 64
+// Written buffers kept for reuse, so recording doesn't allocate.
+#define CAPTURE_SPARE_BUFFERS 4
+
+static inline int paddedLength(quint32 length)
+{
+    return (length + 7) & ~7;
+}
+
+// Returns the size of the valid part of a capture file: the header plus every
+// complete record. Returns -1 if the header isn't one of ours.
+static qint64 validLength(const uchar *data, qint64 size)
+{
+    if (size < CAPTURE_HEADER_SIZE || memcmp(data, CAPTURE_MAGIC, 8) != 0)
+        return -1;
+    if (qFromLittleEndian<quint32>(data + 8) != CAPTURE_VERSION)
+        return -1;
+
+    qint64 pos = qFromLittleEndian<quint32>(data + 12);
+    while (pos + CAPTURE_RECORD_HEADER_SIZE <= size) {
+        quint32 length = qFromLittleEndian<quint32>(data + pos + 12);
+        qint64 next = pos + CAPTURE_RECORD_HEADER_SIZE + paddedLength(length);
+        if (next > size) break;
+        pos = next;
+    }
+    return pos;
+}
+
+static QByteArray emptyBuffer()
+{
+    QByteArray buffer;
+    buffer.reserve(CAPTURE_BUFFER_SIZE * 2);
+    return buffer;
+}
+
+// Writes one open capture file's buffers to disk, off the threads recording.
+class CaptureWriter : public QThread
+{
+public:
+    CaptureWriter(QFile *file, SerialCapture *capture) :
+        m_file(file), m_capture(capture), m_busy(false), m_stop(false), m_failed(false), m_dropped(0) {}
+
+    // Queues *buffer to be written and leaves an empty one, with its room
+    // kept, in its place.
+    void post(QByteArray *buffer)
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_pending.size() >= CAPTURE_MAX_PENDING) {
+            m_dropped += buffer->size();
+            buffer->resize(0);
+            return;
+        }
+        m_pending.append(QByteArray());
+        m_pending.last().swap(*buffer);
+        if (!m_spare.isEmpty()) {
+            buffer->swap(m_spare.last());
+            m_spare.removeLast();
+        } else {
+            *buffer = emptyBuffer();
+        }
+        m_wake.wakeOne();
+    }
+
+    // Returns once everything posted so far is on disk.
+    void waitForWritten()
+    {
+        QMutexLocker lock(&m_mutex);
+        while (!m_pending.isEmpty() || m_busy)
+            m_idle.wait(&m_mutex);
+    }
+
+    // Writes whatever is pending, then the thread exits.
+    void stop()
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_wake.wakeOne();
+    }
+
+    qint64 dropped() const { return m_dropped; }
+
+protected:
+    void run()
+    {
+        forever {
+            QList<QByteArray> batch;
+            {
+                QMutexLocker lock(&m_mutex);
+                while (m_pending.isEmpty() && !m_stop)
+                    m_wake.wait(&m_mutex);
+                if (m_pending.isEmpty()) return;
+                batch.swap(m_pending);
+                m_busy = true;
+            }
+
+            // After a failed write the rest would only leave a gap, so it's
+            // counted as dropped instead.
+            qint64 unwritten = 0;
+            for (int i = 0; i < batch.size(); ++i) {
+                if (m_failed || m_file->write(batch[i]) != batch[i].size()) {
+                    fail();
+                    unwritten += batch[i].size();
+                }
+            }
+            if (!m_failed && !m_file->flush())
+                fail();
+
+            QMutexLocker lock(&m_mutex);
+            m_dropped += unwritten;
+            for (int i = 0; i < batch.size() && m_spare.size() < CAPTURE_SPARE_BUFFERS; ++i) {
+                // Reserved, so this keeps the room.
+                batch[i].resize(0);
+                m_spare.append(batch[i]);
+            }
+            m_busy = false;
+            m_idle.wakeAll();
+        }
+    }
+
+private:
+    // Only on this thread; reports the first failure.
+    void fail()
+    {
+        if (m_failed) return;
+        m_failed = true;
+        emit m_capture->error("Unable to write capture file " + m_file->fileName() + ": " + m_file->errorString());
+    }
+
+    QFile *m_file;
+    SerialCapture *m_capture;
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    QWaitCondition m_idle;
+    QList<QByteArray> m_pending;
+    QList<QByteArray> m_spare;
+    bool m_busy;
+    bool m_stop;
+    bool m_failed;
+    qint64 m_dropped;
+};
+
+SerialCapture::SerialCapture(QObject *parent) :
+    QObject(parent),
+    m_enabled(0),
+    m_writer(0)
+{
+    m_buffer = emptyBuffer();
+
+    m_timer.setInterval(CAPTURE_FLUSH_INTERVAL);
+    m_timer.setSingleShot(false);
+    connect(&m_timer, &QTimer::timeout, this, &SerialCapture::handOff);
+}
+
+SerialCapture::~SerialCapture()
+{
+    close();
+}
+
+bool SerialCapture::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "SerialCapture: Unable to open" << fileName << m_file.errorString();
+        return false;
+    }
+
+    if (m_file.size() == 0) {
+        uchar header[CAPTURE_HEADER_SIZE];
+        memcpy(header, CAPTURE_MAGIC, 8);
+        qToLittleEndian<quint32>(CAPTURE_VERSION, header + 8);
+        qToLittleEndian<quint32>(CAPTURE_HEADER_SIZE, header + 12);
+        if (m_file.write(reinterpret_cast<const char *>(header), CAPTURE_HEADER_SIZE) != CAPTURE_HEADER_SIZE) {
+            qWarning() << "SerialCapture: Unable to write" << fileName << m_file.errorString();
+            m_file.close();
+            return false;
+        }
+    } else {
+        // Drop anything a previous crash left half written. Records only
+        // link forwards, so the last one is found by stepping over the
+        // others' headers; mapped, only those pages are read.
+        qint64 valid;
+        const uchar *mapped = m_file.map(0, m_file.size());
+        if (mapped) {
+            valid = validLength(mapped, m_file.size());
+            m_file.unmap(const_cast<uchar *>(mapped));
+        } else {
+            const QByteArray existing = m_file.readAll();
+            valid = validLength(reinterpret_cast<const uchar *>(existing.constData()), existing.size());
+        }
+        if (valid < 0) {
+            qWarning() << "SerialCapture: Not a capture file, refusing to append:" << fileName;
+            m_file.close();
+            return false;
+        }
+        if ((valid < m_file.size() && !m_file.resize(valid)) || !m_file.seek(valid)) {
+            qWarning() << "SerialCapture: Unable to truncate" << fileName << m_file.errorString();
+            m_file.close();
+            return false;
+        }
+    }
+
+    {
+        QMutexLocker lock(&m_bufferMutex);
+        m_writer = new CaptureWriter(&m_file, this);
+        m_writer->start();
+        m_clock.start();
+        m_enabled.storeRelease(1);
+    }
+
+    QByteArray wallClock(8, 0);
+    qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), reinterpret_cast<uchar *>(wallClock.data()));
+    record(Session, 0, wallClock.constData(), wallClock.size());
+
+    m_timer.start();
+    return true;
+}
+
+void SerialCapture::close()
+{
+    if (!m_enabled.testAndSetOrdered(1, 0)) return;
+
+    m_timer.stop();
+
+    // Whatever was recorded before the flag dropped belongs to this session;
+    // record() checks the flag again under the lock, so nothing else can
+    // follow it into the buffer.
+    CaptureWriter *writer;
+    {
+        QMutexLocker lock(&m_bufferMutex);
+        if (!m_buffer.isEmpty())
+            m_writer->post(&m_buffer);
+        writer = m_writer;
+        m_writer = 0;
+    }
+    writer->stop();
+    writer->wait();
+    if (writer->dropped() > 0)
+        qWarning() << "SerialCapture:" << writer->dropped() << "bytes were not captured";
+    delete writer;
+
+    m_file.close();
+}
+
+QString SerialCapture::fileName() const
+{
+    return m_file.fileName();
+}
+
+void SerialCapture::note(const QString &text)
+{
+    if (!isEnabled()) return;
+    QByteArray utf8 = text.toUtf8();
+    record(Note, 0, utf8.constData(), utf8.size());
+}
+
+void SerialCapture::record(RecordType type, int state, const char *data, int length)
+{
+    if (length < 0) length = 0;
+    const int padded = paddedLength(length);
+
+    QMutexLocker lock(&m_bufferMutex);
+    // Closed while waiting for the lock.
+    if (!isEnabled()) return;
+
+    const int pos = m_buffer.size();
+    m_buffer.resize(pos + CAPTURE_RECORD_HEADER_SIZE + padded);
+
+    uchar *p = reinterpret_cast<uchar *>(m_buffer.data()) + pos;
+    qToLittleEndian<qint64>(m_clock.nsecsElapsed(), p);
+    p[8] = (uchar)type;
+    p[9] = (uchar)state;
+    p[10] = 0;
+    p[11] = 0;
+    qToLittleEndian<quint32>(length, p + 12);
+
+    if (length > 0)
+        memcpy(p + CAPTURE_RECORD_HEADER_SIZE, data, length);
+    if (padded > length)
+        memset(p + CAPTURE_RECORD_HEADER_SIZE + length, 0, padded - length);
+
+    if (m_buffer.size() >= CAPTURE_BUFFER_SIZE)
+        m_writer->post(&m_buffer);
+}
+
+void SerialCapture::handOff()
+{
+    QMutexLocker lock(&m_bufferMutex);
+    if (m_writer && !m_buffer.isEmpty())
+        m_writer->post(&m_buffer);
+}
+
+void SerialCapture::flush()
+{
+    CaptureWriter *writer;
+    {
+        QMutexLocker lock(&m_bufferMutex);
+        if (!m_writer) return;
+        if (!m_buffer.isEmpty())
+            m_writer->post(&m_buffer);
+        writer = m_writer;
+    }
+    // Only close(), on this same thread, deletes the writer.
+    writer->waitForWritten();
+}
+
+bool SerialCapture::exportFile(const QString &captureFile, const QString &outFile, ExportFormat format)
+{
+    QFile in(captureFile);
+    if (!in.open(QIODevice::ReadOnly)) {
+        qWarning() << "SerialCapture: Unable to open" << captureFile;
+        return false;
+    }
+
+    QByteArray contents;
+    const uchar *data = in.map(0, in.size());
+    if (!data) {
+        contents = in.readAll();
+        data = reinterpret_cast<const uchar *>(contents.constData());
+    }
+
+    const qint64 end = validLength(data, in.size());
+    if (end < 0) {
+        qWarning() << "SerialCapture: Not a capture file:" << captureFile;
+        return false;
+    }
+
+    QFile out(outFile);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qWarning() << "SerialCapture: Unable to write" << outFile;
+        return false;
+    }
+    QTextStream stream(&out);
+
+    static const char *typeNames[] = { "SESSION", "TX", "RX", "RTS", "DTR", "NOTE" };
+
+    if (format == Csv)
+        stream << "session,time_ns,type,state,length,data\n";
+
+    int session = -1;
+    QByteArray hex;
+    qint64 pos = qFromLittleEndian<quint32>(data + 12);
+    while (pos < end) {
+        const uchar *p = data + pos;
+        const qint64 timestamp = qFromLittleEndian<qint64>(p);
+        const int type = p[8];
+        const int state = p[9];
+        const quint32 length = qFromLittleEndian<quint32>(p + 12);
+        const char *payload = reinterpret_cast<const char *>(p + CAPTURE_RECORD_HEADER_SIZE);
+        pos += CAPTURE_RECORD_HEADER_SIZE + paddedLength(length);
+
+        const char *typeName = (type <= Note) ? typeNames[type] : "UNKNOWN";
+
+        hex.resize(0);
+        if (type == Tx || type == Rx) {
+            hex.reserve(3*length);
+            for (quint32 i = 0; i < length; ++i) {
+                if (i) hex.append(' ');
+                hex.append(HexFormatter::hexDigits(payload[i]), 2);
+            }
+        } else if (type == Note) {
+            hex = QByteArray(payload, length);
+        }
+
+        if (type == Session) {
+            ++session;
+            qint64 started = (length >= 8) ? qFromLittleEndian<qint64>(p + CAPTURE_RECORD_HEADER_SIZE) : 0;
+            if (format == Csv) {
+                stream << session << "," << timestamp << "," << typeName << ",0,0,"
+                       << QDateTime::fromMSecsSinceEpoch(started).toString(Qt::ISODate) << "\n";
+            } else {
+                stream << "== Session " << session << " started "
+                       << QDateTime::fromMSecsSinceEpoch(started).toString(Qt::ISODate) << " ==\n";
+            }
+            continue;
+        }
+
+        if (format == Csv) {
+            stream << session << "," << timestamp << "," << typeName << "," << state << ","
+                   << length << ",\"" << hex.replace('"', "\"\"") << "\"\n";
+        } else {
+            QString time = QString("%1.%2").arg(timestamp / 1000000000)
+                    .arg(timestamp % 1000000000, 9, 10, QChar('0'));
+            stream << time << "  " << QString(typeName).leftJustified(4);
+            if (type == Rts || type == Dtr)
+                stream << (state ? " set" : " clear");
+            else
+                stream << " [" << length << "] " << hex;
+            stream << "\n";
+        }
+    }
+
+    stream.flush();
+    out.close();
+    return true;
+}
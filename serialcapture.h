@@ -0,0 +1,90 @@
+#ifndef SERIALCAPTURE_H
+#define SERIALCAPTURE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QAtomicInt>
+
+class CaptureWriter;
+
+/*
+ * Append-only binary capture of serial traffic.
+ *
+ * The file starts with a 16 byte header ("SCRMCAP" 0x00, quint32 version,
+ * quint32 header size) followed by records, all little endian and 8 byte
+ * aligned so the file can be mapped and walked in place:
+ *
+ *   qint64  timestamp   ns since the session record (monotonic clock)
+ *   quint8  type        RecordType
+ *   quint8  state       line state for Rts/Dtr records
+ *   quint16 reserved
+ *   quint32 length      payload length, padded to 8 bytes on disk
+ *
+ * Each open() appends a Session record whose payload is the wall clock start
+ * time in ms since the epoch, so captures from several runs can share a file.
+ * Recording is a short lock plus a memcpy into a memory buffer. The buffer is
+ * swapped for an empty one whenever it fills or the flush timer fires, and a
+ * writer thread of the capture's own puts the full one on disk, so neither
+ * the lock nor the threads recording ever wait on file I/O. If a write
+ * fails, nothing more goes to the file and error() is emitted once.
+ */
+class SerialCapture : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum RecordType { Session=0, Tx=1, Rx=2, Rts=3, Dtr=4, Note=5 };
+    enum ExportFormat { Text, Csv };
+
+    explicit SerialCapture(QObject *parent = 0);
+    ~SerialCapture();
+
+    bool open(const QString &fileName);
+    void close();
+
+    bool isEnabled() const { return m_enabled.loadAcquire(); }
+    QString fileName() const;
+
+    // All of these are thread safe and return immediately when not enabled.
+    void tx(const QByteArray &data) { if (isEnabled()) record(Tx, 0, data.constData(), data.size()); }
+    void tx(const char *data, int length) { if (isEnabled()) record(Tx, 0, data, length); }
+    void rx(const QByteArray &data) { if (isEnabled()) record(Rx, 0, data.constData(), data.size()); }
+    void rx(const char *data, int length) { if (isEnabled()) record(Rx, 0, data, length); }
+    void rts(bool set) { if (isEnabled()) record(Rts, set, 0, 0); }
+    void dtr(bool set) { if (isEnabled()) record(Dtr, set, 0, 0); }
+    void note(const QString &text);
+
+    static bool exportFile(const QString &captureFile, const QString &outFile, ExportFormat format);
+
+signals:
+    // From the writer thread. The file ends at the last complete write.
+    void error(QString message);
+
+public slots:
+    // Writes everything recorded so far, returning once it's on disk.
+    void flush();
+
+private slots:
+    void handOff();
+
+private:
+    void record(RecordType type, int state, const char *data, int length);
+
+    QAtomicInt m_enabled;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+
+    // Guards the buffer and the writer. Held only to copy a record in or to
+    // swap the buffer out.
+    QMutex m_bufferMutex;
+    QByteArray m_buffer;
+    CaptureWriter *m_writer;
+
+    QFile m_file;
+};
+
+#endif // SERIALCAPTURE_H
@@ -2,24 +2,135 @@
 
 #include <QVariant>
 #include "util.h"
+#include "portmonitor.h"
 #include <QDebug>
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QThread>
+#include <QSaveFile>
+#include <QMetaProperty>
+#include <QWaitCondition>
+
+#define SIZE_ATMEGA328 32768
+#define SIZE_ATMEGA168 16384
+#define SIZE_ATMEGA32U4 32768
+
+// A save waits for changes to stop for SAVE_DELAY ms, but never lets them
+// hold it off for more than about SAVE_MAX_DELAY.
+#define SAVE_DELAY 500
+#define SAVE_MAX_DELAY 2000
+
+/*
+ * Writes the settings file off the GUI thread. Only the latest map handed
+ * over is written; any it replaces before the thread gets to it is skipped.
+ * Each write goes to a temporary file that is renamed over the old one, so
+ * a crash mid-write never leaves a truncated settings file.
+ */
+class SettingsWriter : public QThread
+{
+public:
+    SettingsWriter() : m_pending(false), m_stop(false) {}
+
+    void write(const QString &path, const QVariantMap &map)
+    {
+        QMutexLocker lock(&m_mutex);
+        m_path = path;
+        m_map = map;
+        m_pending = true;
+        m_wake.wakeOne();
+    }
+
+    // Finishes whatever is pending, then the thread exits.
+    void stop()
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_wake.wakeOne();
+    }
+
+protected:
+    void run()
+    {
+        forever {
+            QString path;
+            QVariantMap map;
+            {
+                QMutexLocker lock(&m_mutex);
+                while (!m_pending && !m_stop)
+                    m_wake.wait(&m_mutex);
+                if (!m_pending) return;
+                path = m_path;
+                map = m_map;
+                m_pending = false;
+            }
+
+            QSaveFile file(path);
+            if (!file.open(QIODevice::WriteOnly)) {
+                qWarning() << "Unable to Save to file:" << path << file.errorString();
+                continue;
+            }
+            file.write(QJsonDocument(QJsonObject::fromVariantMap(map)).toJson());
+            if (!file.commit())
+                qWarning() << "Unable to Save to file:" << path << file.errorString();
+        }
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    QString m_path;
+    QVariantMap m_map;
+    bool m_pending;
+    bool m_stop;
+};
+
+// What goes in the settings file. Read-only properties (the log, the port
+// list) couldn't be loaded back, and the rest here are per session.
+static bool isPersisted(const QMetaProperty &property)
+{
+    static const QStringList ignore = QStringList() << "objectName" << "selectedPort"
+                                                    << "programmerActive" << "terminalActive";
+    return property.isReadable() && property.isWritable()
+            && !ignore.contains(QLatin1String(property.name()));
+}
 
-Settings::Settings(QObject *parent) :
+
+Settings::Settings(QObject *parent, bool persistent) :
     QObject(parent),
-    m_saving(false),
+    m_persistent(persistent),
+    m_writer(0),
     m_settingsFile("settings.txt"),
-    m_log(QString()),
+    m_log(new Log(this)),
+    m_loaded(false),
+    m_framing(NoFraming),
+    m_lineEnding(LF),
+    m_charDelay(0),
+    m_lineDelay(0),
+    m_captureEnabled(false),
+    m_captureFile("capture.scap"),
+    m_capture(new SerialCapture(this)),
+    m_terminalLogEnabled(false),
+    m_terminalLogDirectory(QUrl("logs")),
+    m_terminalLogTimestamps(true),
+    m_terminalLogCompress(false),
+    m_terminalLogMaxSize(0),
+    m_terminalLogRotateMinutes(0),
     m_programmerActive(false),
     m_terminalActive(false)
 {
+    connect(m_log, &Log::changed, this, &Settings::logChanged);
+    connect(m_log, &Log::levelChanged, this, &Settings::logLevelChanged);
+    connect(m_capture, &SerialCapture::error, this, &Settings::captureError);
+
     m_port = new QSerialPort();
-    updatePorts();
+    if (m_persistent) {
+        m_writer = new SettingsWriter();
+        m_writer->start(QThread::LowPriority);
+        updatePorts();
+    }
 
-    if(!load()) {
+    if(!m_persistent || !load()) {
         m_portName = QString();
         m_baudProgram = QSerialPort::Baud9600;
         m_frequency = 8000000;
@@ -39,14 +150,16 @@ Settings::Settings(QObject *parent) :
 
         updatePort();
 
-        save();
+        if (m_persistent)
+            save();
     }
 
-    // Set up timer to poll for available ports
-    m_timer.setInterval(2000);
-    m_timer.setSingleShot(false);
-    m_timer.start();
-    connect(&m_timer, &QTimer::timeout, this, &Settings::updatePorts);
+    m_loaded = true;
+    updateCapture();
+
+    // The port monitor enumerates off this thread and tells us what changed
+    if (m_persistent)
+        connect(PortMonitor::instance(), &PortMonitor::portsChanged, this, &Settings::updatePorts);
 
     connect(this, &Settings::programmerActiveChanged, this, &Settings::updatePort);
 
@@ -60,7 +173,12 @@ Settings::Settings(QObject *parent) :
     connect(this, &Settings::parityChanged, this, &Settings::changed);
     connect(this, &Settings::stopBitsChanged, this, &Settings::changed);
     connect(this, &Settings::resetTypeChanged, this, &Settings::changed);
+    connect(this, &Settings::resetProfilesChanged, this, &Settings::changed);
     connect(this, &Settings::terminalCharactersChanged, this, &Settings::changed);
+    connect(this, &Settings::framingChanged, this, &Settings::changed);
+    connect(this, &Settings::lineEndingChanged, this, &Settings::changed);
+    connect(this, &Settings::charDelayChanged, this, &Settings::changed);
+    connect(this, &Settings::lineDelayChanged, this, &Settings::changed);
     connect(this, &Settings::echoChanged, this, &Settings::changed);
     connect(this, &Settings::autoOpenTerminalChanged, this, &Settings::changed);
     connect(this, &Settings::logDownloadChanged, this, &Settings::changed);
@@ -68,9 +186,43 @@ Settings::Settings(QObject *parent) :
 
     connect(this, &Settings::hexFileChanged, this, &Settings::changed);
     connect(this, &Settings::hexFilesChanged, this, &Settings::changed);
+    connect(this, &Settings::logLevelChanged, this, &Settings::changed);
+    connect(this, &Settings::captureEnabledChanged, this, &Settings::changed);
+    connect(this, &Settings::captureFileChanged, this, &Settings::changed);
+    connect(this, &Settings::terminalLogEnabledChanged, this, &Settings::changed);
+    connect(this, &Settings::terminalLogDirectoryChanged, this, &Settings::changed);
+    connect(this, &Settings::terminalLogTimestampsChanged, this, &Settings::changed);
+    connect(this, &Settings::terminalLogCompressChanged, this, &Settings::changed);
+    connect(this, &Settings::terminalLogMaxSizeChanged, this, &Settings::changed);
+    connect(this, &Settings::terminalLogRotateMinutesChanged, this, &Settings::changed);
+
+
+    if (m_persistent) {
+        // Saving is driven by the properties themselves rather than by
+        // changed(), so a save only has to read back what actually changed.
+        const QMetaObject *meta = metaObject();
+        const int markDirty = meta->indexOfSlot("markDirty()");
+        for (int i = 0; i < meta->propertyCount(); ++i) {
+            QMetaProperty property = meta->property(i);
+            if (!isPersisted(property) || !property.hasNotifySignal()) continue;
+            m_notifyProperties.insert(property.notifySignalIndex(), i);
+            QMetaObject::connect(this, property.notifySignalIndex(), this, markDirty);
+        }
 
+        m_saveTimer.setSingleShot(true);
+        connect(&m_saveTimer, &QTimer::timeout, this, &Settings::save);
+    }
+}
+
+Settings::~Settings()
+{
+    if (!m_writer) return;
 
-    connect(this, &Settings::changed, this, &Settings::save);
+    if (!m_dirty.isEmpty())
+        save();
+    m_writer->stop();
+    m_writer->wait();
+    delete m_writer;
 }
 
 bool Settings::load()
@@ -98,38 +250,42 @@ bool Settings::load()
 
 void Settings::save()
 {
-    if (m_saving) return;
-    m_saving = true;
-
-    QStringList ignore;
-    ignore << "objectName" << "selectedPort"
-           << "programmerActive" << "terminalActive";
-    QVariantMap map = Util::qobject2qvariant(this, ignore);
-
-    QJsonObject json = QJsonObject::fromVariantMap(map);
-    QJsonDocument doc = QJsonDocument(json);
+    if (!m_persistent) return;
+    m_saveTimer.stop();
 
-    QFile file(settingsFile().path());
-    if (!file.open(QIODevice::WriteOnly)) {
-        qWarning() << "Unable to Save to file:" << settingsFile();
-        return;
+    const QMetaObject *meta = metaObject();
+    if (m_saved.isEmpty()) {
+        for (int i = 0; i < meta->propertyCount(); ++i) {
+            QMetaProperty property = meta->property(i);
+            if (isPersisted(property))
+                m_saved[QLatin1String(property.name())] = property.read(this);
+        }
+    } else {
+        foreach (int i, m_dirty) {
+            QMetaProperty property = meta->property(i);
+            m_saved[QLatin1String(property.name())] = property.read(this);
+        }
     }
+    m_dirty.clear();
 
-    QTextStream out(&file);
-    out << doc.toJson();
-    out.flush();
+    // The writer gets its own (shared) copy of the map and does the JSON.
+    m_writer->write(settingsFile().path(), m_saved);
+}
 
-    file.close();
+void Settings::markDirty()
+{
+    foreach (int i, m_notifyProperties.values(senderSignalIndex()))
+        m_dirty.insert(i);
 
-    m_saving = false;
+    if (!m_saveTimer.isActive())
+        m_dirtySince.start();
+    if (m_dirtySince.elapsed() < SAVE_MAX_DELAY)
+        m_saveTimer.start(SAVE_DELAY);
 }
 
 void Settings::updatePorts()
 {
-    QStringList portNames;
-    foreach (const QSerialPortInfo &info, QSerialPortInfo::availablePorts()) {
-        portNames << info.portName();
-    }
+    QStringList portNames = PortMonitor::instance()->portNames();
 
     if (portNames == m_availablePorts) return;
 
@@ -137,16 +293,14 @@ void Settings::updatePorts()
     emit availablePortsChanged(m_availablePorts);
 }
 
-void Settings::writeLog(QString log)
+void Settings::writeLog(QString log, Log::Level level)
 {
-    m_log.append(log + " ");
-    emit logChanged();
+    m_log->write(level, log + " ");
 }
 
-void Settings::writeLogLn(QString log)
+void Settings::writeLogLn(QString log, Log::Level level)
 {
-    m_log.append(log + "\n");
-    emit logChanged();
+    m_log->write(level, log + "\n");
 }
 
 void Settings::setSettingsFile(QUrl arg)
@@ -316,6 +470,54 @@ void Settings::setTerminalCharacters(Settings::TerminalCharacters arg)
     emit terminalCharactersChanged(arg);
 }
 
+Settings::Framing Settings::framing() const
+{
+    return m_framing;
+}
+
+void Settings::setFraming(Settings::Framing arg)
+{
+    if (m_framing == arg) return;
+    m_framing = arg;
+    emit framingChanged(arg);
+}
+
+Settings::LineEnding Settings::lineEnding() const
+{
+    return m_lineEnding;
+}
+
+void Settings::setLineEnding(Settings::LineEnding arg)
+{
+    if (m_lineEnding == arg) return;
+    m_lineEnding = arg;
+    emit lineEndingChanged(arg);
+}
+
+int Settings::charDelay() const
+{
+    return m_charDelay;
+}
+
+void Settings::setCharDelay(int arg)
+{
+    if (m_charDelay == arg) return;
+    m_charDelay = arg;
+    emit charDelayChanged(arg);
+}
+
+int Settings::lineDelay() const
+{
+    return m_lineDelay;
+}
+
+void Settings::setLineDelay(int arg)
+{
+    if (m_lineDelay == arg) return;
+    m_lineDelay = arg;
+    emit lineDelayChanged(arg);
+}
+
 bool Settings::echo() const
 {
     return m_echo;
@@ -407,6 +609,259 @@ void Settings::setResetType(Settings::ResetType arg)
     emit resetTypeChanged(arg);
 }
 
+static QString resetProfileKey(const QString &portName, Settings::ResetType type)
+{
+    switch (type) {
+    case Settings::DTR: return portName + "/DTR";
+    case Settings::Software: return portName + "/Software";
+    default: return portName + "/RTS";
+    }
+}
+
+QVariantMap Settings::resetProfiles() const
+{
+    QMutexLocker lock(&m_resetProfilesMutex);
+    return m_resetProfiles;
+}
+
+void Settings::setResetProfiles(QVariantMap arg)
+{
+    {
+        QMutexLocker lock(&m_resetProfilesMutex);
+        if (m_resetProfiles == arg) return;
+        m_resetProfiles = arg;
+    }
+    emit resetProfilesChanged();
+}
+
+ResetProfile Settings::resetProfile(const QString &portName) const
+{
+    const ResetType type = m_resetType;
+    QVariantMap stored;
+    {
+        QMutexLocker lock(&m_resetProfilesMutex);
+        stored = m_resetProfiles.value(resetProfileKey(portName, type)).toMap();
+    }
+    if (!stored.isEmpty())
+        return ResetProfile::fromVariant(stored);
+
+    // What resetMicro used to do before profiles.
+    ResetProfile profile;
+    if (type == Software)
+        profile.settle = 200;
+    return profile;
+}
+
+FlashJob Settings::flashJob(QString portName) const
+{
+    if (portName.isEmpty()) portName = m_portName;
+
+    FlashJob job;
+    job.portName = portName;
+    job.baudRate = m_baudProgram;
+    job.hexFile = m_hexFile.toLocalFile();
+    switch (m_chip) {
+    case Atmega168:
+        job.memorySize = SIZE_ATMEGA168;
+        job.pageSize = 128;
+        break;
+    case Atmega328:
+        job.memorySize = SIZE_ATMEGA328;
+        job.pageSize = 128;
+        break;
+    case Atmega32u4:
+        job.memorySize = SIZE_ATMEGA32U4;
+        job.pageSize = 256;
+        break;
+    }
+    job.resetType = (Bootloader::ResetType)m_resetType;
+    job.resetProfile = resetProfile(portName);
+    job.logTraffic = m_logDownload;
+    return job;
+}
+
+QVariantMap Settings::portResetProfile(QString portName) const
+{
+    return resetProfile(portName).toVariant();
+}
+
+void Settings::setPortResetProfile(QString portName, QVariantMap profile)
+{
+    const ResetProfile current = resetProfile(portName);
+    if (!profile.contains("latency")) profile["latency"] = current.latency;
+    if (!profile.contains("samples")) profile["samples"] = current.samples;
+
+    {
+        QMutexLocker lock(&m_resetProfilesMutex);
+        m_resetProfiles[resetProfileKey(portName, m_resetType)] = ResetProfile::fromVariant(profile).toVariant();
+    }
+    emit resetProfilesChanged();
+}
+
+void Settings::recordResetLatency(QString portName, qreal msecs)
+{
+    // Called from the worker thread too; do the update on ours so the
+    // change signal and save happen here.
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "recordResetLatency", Qt::QueuedConnection,
+                                  Q_ARG(QString, portName), Q_ARG(qreal, msecs));
+        return;
+    }
+
+    ResetProfile profile = resetProfile(portName);
+    profile.addSample(msecs);
+    {
+        QMutexLocker lock(&m_resetProfilesMutex);
+        m_resetProfiles[resetProfileKey(portName, m_resetType)] = profile.toVariant();
+    }
+    emit resetProfilesChanged();
+}
+
+bool Settings::captureEnabled() const
+{
+    return m_captureEnabled;
+}
+
+void Settings::setCaptureEnabled(bool arg)
+{
+    if (m_captureEnabled == arg) return;
+    m_captureEnabled = arg;
+    updateCapture();
+    emit captureEnabledChanged(arg);
+}
+
+QUrl Settings::captureFile() const
+{
+    return m_captureFile;
+}
+
+void Settings::setCaptureFile(QUrl arg)
+{
+    if (m_captureFile == arg) return;
+    m_captureFile = arg;
+    if (m_capture->isEnabled())
+        m_capture->close();
+    updateCapture();
+    emit captureFileChanged(arg);
+}
+
+bool Settings::terminalLogEnabled() const
+{
+    return m_terminalLogEnabled;
+}
+
+void Settings::setTerminalLogEnabled(bool arg)
+{
+    if (m_terminalLogEnabled == arg) return;
+    m_terminalLogEnabled = arg;
+    emit terminalLogEnabledChanged(arg);
+}
+
+QUrl Settings::terminalLogDirectory() const
+{
+    return m_terminalLogDirectory;
+}
+
+void Settings::setTerminalLogDirectory(QUrl arg)
+{
+    if (m_terminalLogDirectory == arg) return;
+    m_terminalLogDirectory = arg;
+    emit terminalLogDirectoryChanged(arg);
+}
+
+bool Settings::terminalLogTimestamps() const
+{
+    return m_terminalLogTimestamps;
+}
+
+void Settings::setTerminalLogTimestamps(bool arg)
+{
+    if (m_terminalLogTimestamps == arg) return;
+    m_terminalLogTimestamps = arg;
+    emit terminalLogTimestampsChanged(arg);
+}
+
+bool Settings::terminalLogCompress() const
+{
+    return m_terminalLogCompress;
+}
+
+void Settings::setTerminalLogCompress(bool arg)
+{
+    if (m_terminalLogCompress == arg) return;
+    m_terminalLogCompress = arg;
+    emit terminalLogCompressChanged(arg);
+}
+
+int Settings::terminalLogMaxSize() const
+{
+    return m_terminalLogMaxSize;
+}
+
+void Settings::setTerminalLogMaxSize(int arg)
+{
+    if (m_terminalLogMaxSize == arg) return;
+    m_terminalLogMaxSize = arg;
+    emit terminalLogMaxSizeChanged(arg);
+}
+
+int Settings::terminalLogRotateMinutes() const
+{
+    return m_terminalLogRotateMinutes;
+}
+
+void Settings::setTerminalLogRotateMinutes(int arg)
+{
+    if (m_terminalLogRotateMinutes == arg) return;
+    m_terminalLogRotateMinutes = arg;
+    emit terminalLogRotateMinutesChanged(arg);
+}
+
+SerialCapture *Settings::capture() const
+{
+    return m_capture;
+}
+
+void Settings::updateCapture()
+{
+    // Wait for load() so we don't open the default file on the way through.
+    if (!m_loaded) return;
+
+    if (!m_captureEnabled) {
+        m_capture->close();
+        return;
+    }
+
+    if (m_capture->isEnabled()) return;
+
+    QString fileName = m_captureFile.isLocalFile() ? m_captureFile.toLocalFile() : m_captureFile.path();
+    if (!m_capture->open(fileName))
+        writeLogLn("Unable to open capture file: " + fileName, Log::Error);
+}
+
+// The capture has stopped writing; say so and show it as off, rather than
+// leave a file that looks complete.
+void Settings::captureError(QString message)
+{
+    writeLogLn(message, Log::Error);
+    setCaptureEnabled(false);
+}
+
+QString Settings::exportCapture(bool csv)
+{
+    QString fileName = m_captureFile.isLocalFile() ? m_captureFile.toLocalFile() : m_captureFile.path();
+    QString outFile = fileName + (csv ? ".csv" : ".txt");
+
+    m_capture->flush();
+    if (!SerialCapture::exportFile(fileName, outFile, csv ? SerialCapture::Csv : SerialCapture::Text)) {
+        writeLogLn("Unable to export capture file: " + fileName, Log::Error);
+        return QString();
+    }
+
+    writeLogLn("Exported capture to " + outFile);
+    return outFile;
+}
+
 QSerialPort *Settings::getPort()
 {
     if (!m_port) return 0;
@@ -476,13 +931,22 @@ QStringList Settings::availablePorts() const
 
 QString Settings::log() const
 {
-    return m_log;
+    return m_log->text();
 }
 
 void Settings::clearLog()
 {
-    m_log.clear();
-    emit logChanged();
+    m_log->clear();
+}
+
+Log::Level Settings::logLevel() const
+{
+    return m_log->level();
+}
+
+void Settings::setLogLevel(Log::Level arg)
+{
+    m_log->setLevel(arg);
 }
 
 bool Settings::programmerActive() const
@@ -6,8 +6,17 @@
 #include <QSerialPort>
 #include <QTimer>
 #include <QUrl>
+#include <QMutex>
+#include <QSet>
+#include <QMultiHash>
+#include <QElapsedTimer>
 #include "serial.h"
+#include "log.h"
+#include "serialcapture.h"
+#include "resetprofile.h"
+#include "flasher.h"
 
+class SettingsWriter;
 class Settings : public QObject
 {
     Q_OBJECT
@@ -15,6 +24,7 @@ class Settings : public QObject
     Q_PROPERTY(QUrl settingsFile READ settingsFile WRITE setSettingsFile NOTIFY settingsFileChanged)
 
     Q_PROPERTY(QString log READ log NOTIFY logChanged)
+    Q_PROPERTY(Log::Level logLevel READ logLevel WRITE setLogLevel NOTIFY logLevelChanged)
 
     Q_PROPERTY(QString portName READ portName WRITE setPortName NOTIFY portNameChanged)
     Q_PROPERTY(QStringList availablePorts READ availablePorts NOTIFY availablePortsChanged)
@@ -29,33 +39,56 @@ class Settings : public QObject
     Q_PROPERTY(QSerialPort::Parity parity READ parity WRITE setParity NOTIFY parityChanged)
     Q_PROPERTY(QSerialPort::StopBits stopBits READ stopBits WRITE setStopBits NOTIFY stopBitsChanged)
     Q_PROPERTY(ResetType resetType READ resetType WRITE setResetType NOTIFY resetTypeChanged)
+    Q_PROPERTY(QVariantMap resetProfiles READ resetProfiles WRITE setResetProfiles NOTIFY resetProfilesChanged)
 
     Q_PROPERTY(TerminalCharacters terminalCharacters READ terminalCharacters WRITE setTerminalCharacters NOTIFY terminalCharactersChanged)
+    Q_PROPERTY(Framing framing READ framing WRITE setFraming NOTIFY framingChanged)
+    Q_PROPERTY(LineEnding lineEnding READ lineEnding WRITE setLineEnding NOTIFY lineEndingChanged)
+    Q_PROPERTY(int charDelay READ charDelay WRITE setCharDelay NOTIFY charDelayChanged)
+    Q_PROPERTY(int lineDelay READ lineDelay WRITE setLineDelay NOTIFY lineDelayChanged)
     Q_PROPERTY(bool echo READ echo WRITE setEcho NOTIFY echoChanged)
     Q_PROPERTY(bool autoOpenTerminal READ autoOpenTerminal WRITE setAutoOpenTerminal NOTIFY autoOpenTerminalChanged)
     Q_PROPERTY(bool logDownload READ logDownload WRITE setLogDownload NOTIFY logDownloadChanged)
     Q_PROPERTY(bool wrapTerminal READ wrapTerminal WRITE setWrapTerminal NOTIFY wrapTerminalChanged)
 
+    Q_PROPERTY(bool captureEnabled READ captureEnabled WRITE setCaptureEnabled NOTIFY captureEnabledChanged)
+    Q_PROPERTY(QUrl captureFile READ captureFile WRITE setCaptureFile NOTIFY captureFileChanged)
+
+    Q_PROPERTY(bool terminalLogEnabled READ terminalLogEnabled WRITE setTerminalLogEnabled NOTIFY terminalLogEnabledChanged)
+    Q_PROPERTY(QUrl terminalLogDirectory READ terminalLogDirectory WRITE setTerminalLogDirectory NOTIFY terminalLogDirectoryChanged)
+    Q_PROPERTY(bool terminalLogTimestamps READ terminalLogTimestamps WRITE setTerminalLogTimestamps NOTIFY terminalLogTimestampsChanged)
+    Q_PROPERTY(bool terminalLogCompress READ terminalLogCompress WRITE setTerminalLogCompress NOTIFY terminalLogCompressChanged)
+    Q_PROPERTY(int terminalLogMaxSize READ terminalLogMaxSize WRITE setTerminalLogMaxSize NOTIFY terminalLogMaxSizeChanged)
+    Q_PROPERTY(int terminalLogRotateMinutes READ terminalLogRotateMinutes WRITE setTerminalLogRotateMinutes NOTIFY terminalLogRotateMinutesChanged)
+
     Q_PROPERTY(QUrl hexFile READ hexFile WRITE setHexFile NOTIFY hexFileChanged)
     Q_PROPERTY(QStringList hexFiles READ hexFiles WRITE setHexFiles NOTIFY hexFilesChanged)
 
     Q_PROPERTY(bool programmerActive READ programmerActive WRITE setProgrammerActive NOTIFY programmerActiveChanged)
     Q_PROPERTY(bool terminalActive READ terminalActive WRITE setTerminalActive NOTIFY terminalActiveChanged)
 
-    Q_ENUMS(Chip TerminalCharacters ResetType)
+    Q_ENUMS(Chip TerminalCharacters ResetType Framing LineEnding)
 
 public:
     enum Chip { Atmega168=0, Atmega328=1, Atmega32u4=2 };
     enum TerminalCharacters { Ascii=0, Hex=1, Dec=2 };
+    // Matches FrameDecoder::Type
+    enum Framing { NoFraming=0, Slip=1, Cobs=2, LengthPrefixed=3 };
     enum ResetType { RTS=0, DTR=1, Software=2 };
+    enum LineEnding { LF=0, CR=1, CRLF=2, NoLineEnding=3 };
 
-    explicit Settings(QObject *parent = 0);
+    // A settings object that isn't persistent starts from the defaults and
+    // never touches the settings file or watches the port list.
+    explicit Settings(QObject *parent = 0, bool persistent = true);
+    // Writes out anything still waiting to be saved.
+    ~Settings();
 
     Q_INVOKABLE bool load();
 
 
-    Q_INVOKABLE void writeLog(QString log);
-    Q_INVOKABLE void writeLogLn(QString log);
+    // Safe to call from any thread.
+    Q_INVOKABLE void writeLog(QString log, Log::Level level = Log::Info);
+    Q_INVOKABLE void writeLogLn(QString log, Log::Level level = Log::Info);
     
     QUrl settingsFile() const;
     void setSettingsFile(QUrl arg);
@@ -87,6 +120,19 @@ public:
     Settings::TerminalCharacters terminalCharacters() const;
     void setTerminalCharacters(Settings::TerminalCharacters arg);
 
+    Framing framing() const;
+    void setFraming(Framing arg);
+
+    LineEnding lineEnding() const;
+    void setLineEnding(LineEnding arg);
+
+    // Transmit pacing, in milliseconds. 0 sends as fast as the port takes it.
+    int charDelay() const;
+    void setCharDelay(int arg);
+
+    int lineDelay() const;
+    void setLineDelay(int arg);
+
     bool echo() const;
     void setEcho(bool arg);
 
@@ -108,6 +154,49 @@ public:
     ResetType resetType() const;
     void setResetType(ResetType arg);
 
+    // Reset profiles are kept per port and reset type. All of these are
+    // safe to call from any thread.
+    QVariantMap resetProfiles() const;
+    void setResetProfiles(QVariantMap arg);
+    ResetProfile resetProfile(const QString &portName) const;
+    Q_INVOKABLE QVariantMap portResetProfile(QString portName) const;
+    // Measured latency and sample count are kept unless given.
+    Q_INVOKABLE void setPortResetProfile(QString portName, QVariantMap profile);
+    Q_INVOKABLE void recordResetLatency(QString portName, qreal msecs);
+
+    // A snapshot of everything a programming job reads, for portName (the
+    // selected port when empty). Take it on the settings' thread; the job
+    // then never has to look back at the settings while it runs.
+    FlashJob flashJob(QString portName = QString()) const;
+
+    bool captureEnabled() const;
+    void setCaptureEnabled(bool arg);
+
+    QUrl captureFile() const;
+    void setCaptureFile(QUrl arg);
+
+    bool terminalLogEnabled() const;
+    void setTerminalLogEnabled(bool arg);
+
+    QUrl terminalLogDirectory() const;
+    void setTerminalLogDirectory(QUrl arg);
+
+    bool terminalLogTimestamps() const;
+    void setTerminalLogTimestamps(bool arg);
+
+    bool terminalLogCompress() const;
+    void setTerminalLogCompress(bool arg);
+
+    int terminalLogMaxSize() const;
+    void setTerminalLogMaxSize(int arg);
+
+    int terminalLogRotateMinutes() const;
+    void setTerminalLogRotateMinutes(int arg);
+
+    // Never null. Recording is a no-op while captureEnabled is false.
+    SerialCapture *capture() const;
+    Q_INVOKABLE QString exportCapture(bool csv);
+
     QSerialPort *getPort();
 //    void setSelectedPort(QSerialPort *arg);
 
@@ -117,6 +206,9 @@ public:
     QStringList availablePorts() const;
     QString log() const;
     Q_INVOKABLE void clearLog();
+    Log::Level logLevel() const;
+    void setLogLevel(Log::Level arg);
+
     bool programmerActive() const;
     void setProgrammerActive(bool arg);
 
@@ -138,6 +230,10 @@ signals:
     void stopBitsChanged(QSerialPort::StopBits arg);
 
     void terminalCharactersChanged(Settings::TerminalCharacters arg);
+    void framingChanged(Framing arg);
+    void lineEndingChanged(LineEnding arg);
+    void charDelayChanged(int arg);
+    void lineDelayChanged(int arg);
     void echoChanged(bool arg);
     void autoOpenTerminalChanged(bool arg);
     void logDownloadChanged(bool arg);
@@ -145,27 +241,51 @@ signals:
     void hexFilesChanged(QStringList arg);
     void hexFileChanged(QUrl arg);
     void resetTypeChanged(ResetType arg);
+    void resetProfilesChanged();
+    void captureEnabledChanged(bool arg);
+    void captureFileChanged(QUrl arg);
+    void terminalLogEnabledChanged(bool arg);
+    void terminalLogDirectoryChanged(QUrl arg);
+    void terminalLogTimestampsChanged(bool arg);
+    void terminalLogCompressChanged(bool arg);
+    void terminalLogMaxSizeChanged(int arg);
+    void terminalLogRotateMinutesChanged(int arg);
 
     void selectedPortChanged(QSerialPort *arg);
 
     void availablePortsChanged(QStringList arg);
 
     void logChanged();
+    void logLevelChanged(Log::Level arg);
 
     void programmerActiveChanged(bool arg);
 
     void terminalActiveChanged(bool arg);
 
 public slots:
+    // Changes are saved by themselves once they settle; this saves now. The
+    // file is written on a background thread and replaced atomically.
     Q_INVOKABLE void save();
     Q_INVOKABLE void updatePorts();
     bool updatePort();
 
+private slots:
+    void markDirty();
+    void captureError(QString message);
+
 private:
-    bool m_saving;
-    QTimer m_timer;
+    void updateCapture();
+
+    bool m_persistent;
+    SettingsWriter *m_writer;
+    QTimer m_saveTimer;
+    QElapsedTimer m_dirtySince;
+    QMultiHash<int, int> m_notifyProperties; // notify signal -> property
+    QSet<int> m_dirty;                       // properties changed since the last save
+    QVariantMap m_saved;                     // what was last handed to the writer
     QUrl m_settingsFile;
-    QString m_log;
+    Log *m_log;
+    bool m_loaded;
     
     QString m_portName;
     QSerialPort::BaudRate m_baudProgram;
@@ -176,6 +296,10 @@ private:
     QSerialPort::Parity m_parity;
     QSerialPort::StopBits m_stopBits;
     Settings::TerminalCharacters m_terminalCharacters;
+    Framing m_framing;
+    LineEnding m_lineEnding;
+    int m_charDelay;
+    int m_lineDelay;
     bool m_echo;
     bool m_autoOpenTerminal;
     bool m_logDownload;
@@ -183,6 +307,17 @@ private:
     QStringList m_hexFiles;
     QUrl m_hexFile;
     ResetType m_resetType;
+    QVariantMap m_resetProfiles;
+    mutable QMutex m_resetProfilesMutex;
+    bool m_captureEnabled;
+    QUrl m_captureFile;
+    SerialCapture *m_capture;
+    bool m_terminalLogEnabled;
+    QUrl m_terminalLogDirectory;
+    bool m_terminalLogTimestamps;
+    bool m_terminalLogCompress;
+    int m_terminalLogMaxSize;
+    int m_terminalLogRotateMinutes;
     QSerialPort * m_port;
     QStringList m_availablePorts;
     bool m_programmerActive;
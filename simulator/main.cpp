@@ -0,0 +1,155 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QFile>
+#include <signal.h>
+#include <unistd.h>
+
+#include "bootsimulator.h"
+
+// Exit codes
+#define EXIT_OK 0
+#define EXIT_FAILED 1
+#define EXIT_USAGE 2
+
+static BootSimulator *s_simulator = 0;
+
+static void interrupted(int)
+{
+    if (s_simulator) s_simulator->stop();
+}
+
+static void usage(QTextStream &out)
+{
+    out << "Usage: screamer-sim [options]\n"
+        << "\n"
+        << "Pretends to be a board running the Screamer bootloader, on a pseudo-terminal.\n"
+        << "Prints the port to program, then runs until interrupted.\n"
+        << "\n"
+        << "  -p, --page-size N       Bytes per block, 256 and up for 5 byte headers (default 128)\n"
+        << "  -m, --memory N          Flash size in bytes (default 32768)\n"
+        << "  -b, --baud RATE         Pace replies as if on a line this fast, 0 for no pacing (default 57600)\n"
+        << "  -l, --latency MS        Extra delay before every reply (default 0)\n"
+        << "  -w, --write-time MS     Time to write each page (default 0)\n"
+        << "  -e, --bit-errors RATE   Chance of each received bit being flipped (default 0)\n"
+        << "  -d, --drops RATE        Chance of each received byte being lost (default 0)\n"
+        << "  -r, --ready-interval MS Time between SlaveReady broadcasts (default 20)\n"
+        << "  -t, --frame-timeout MS  Silence that fails a partial block (default 50)\n"
+        << "  -B, --banner TEXT       Printed when the loaded program starts\n"
+        << "  -s, --seed N            Seed for the injected faults (default 1)\n"
+        << "  -L, --link PATH         Also make PATH a symlink to the port\n"
+        << "  -o, --dump FILE         Write the flash contents to FILE on exit\n"
+        << "  -v, --verbose           Log what the board does\n"
+        << "  -h, --help              Show this help\n";
+    out.flush();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    BootSimulator::Options options;
+    QString link;
+    QString dump;
+    bool verbose = false;
+
+    QStringList args = app.arguments().mid(1);
+    while (!args.isEmpty()) {
+        const QString arg = args.takeFirst();
+        const bool hasValue = !args.isEmpty();
+        bool ok = true;
+
+        if (arg == "-h" || arg == "--help") {
+            usage(out);
+            return EXIT_OK;
+        } else if (arg == "-v" || arg == "--verbose") {
+            verbose = true;
+        } else if ((arg == "-p" || arg == "--page-size") && hasValue) {
+            options.pageSize = args.takeFirst().toInt(&ok);
+            ok = ok && options.pageSize > 0;
+        } else if ((arg == "-m" || arg == "--memory") && hasValue) {
+            options.memorySize = args.takeFirst().toInt(&ok);
+            ok = ok && options.memorySize > 0 && options.memorySize <= 65536;
+        } else if ((arg == "-b" || arg == "--baud") && hasValue) {
+            options.baudRate = args.takeFirst().toInt(&ok);
+            ok = ok && options.baudRate >= 0;
+        } else if ((arg == "-l" || arg == "--latency") && hasValue) {
+            options.latency = args.takeFirst().toDouble(&ok);
+        } else if ((arg == "-w" || arg == "--write-time") && hasValue) {
+            options.writeTime = args.takeFirst().toDouble(&ok);
+        } else if ((arg == "-e" || arg == "--bit-errors") && hasValue) {
+            options.bitErrorRate = args.takeFirst().toDouble(&ok);
+            ok = ok && options.bitErrorRate >= 0 && options.bitErrorRate <= 1;
+        } else if ((arg == "-d" || arg == "--drops") && hasValue) {
+            options.dropRate = args.takeFirst().toDouble(&ok);
+            ok = ok && options.dropRate >= 0 && options.dropRate <= 1;
+        } else if ((arg == "-r" || arg == "--ready-interval") && hasValue) {
+            options.readyInterval = args.takeFirst().toInt(&ok);
+        } else if ((arg == "-t" || arg == "--frame-timeout") && hasValue) {
+            options.frameTimeout = args.takeFirst().toInt(&ok);
+        } else if ((arg == "-B" || arg == "--banner") && hasValue) {
+            options.banner = args.takeFirst().toLocal8Bit();
+        } else if ((arg == "-s" || arg == "--seed") && hasValue) {
+            options.seed = args.takeFirst().toUInt(&ok);
+        } else if ((arg == "-L" || arg == "--link") && hasValue) {
+            link = args.takeFirst();
+        } else if ((arg == "-o" || arg == "--dump") && hasValue) {
+            dump = args.takeFirst();
+        } else {
+            err << "Unexpected argument: " << arg << "\n";
+            usage(err);
+            return EXIT_USAGE;
+        }
+
+        if (!ok) {
+            err << "Bad value for " << arg << "\n";
+            return EXIT_USAGE;
+        }
+    }
+
+    BootSimulator simulator(options);
+    simulator.setVerbose(verbose);
+    if (!simulator.open()) {
+        err << simulator.errorString() << "\n";
+        return EXIT_FAILED;
+    }
+
+    if (!link.isEmpty()) {
+        QFile::remove(link);
+        if (!QFile::link(simulator.slaveName(), link)) {
+            err << "Unable to link " << link << " to " << simulator.slaveName() << "\n";
+            return EXIT_FAILED;
+        }
+    }
+
+    out << simulator.slaveName() << "\n";
+    out.flush();
+
+    s_simulator = &simulator;
+    signal(SIGINT, interrupted);
+    signal(SIGTERM, interrupted);
+    simulator.run();
+    s_simulator = 0;
+
+    if (!link.isEmpty())
+        QFile::remove(link);
+
+    const BootSimulator::Stats stats = simulator.stats();
+    err << "boots " << stats.boots << ", programs " << stats.programs
+        << ", blocks " << stats.blocks << ", failures " << stats.failures
+        << ", bytes " << stats.bytesReceived << ", bits flipped " << stats.bitsFlipped
+        << ", bytes dropped " << stats.bytesDropped << "\n";
+    err.flush();
+
+    if (!dump.isEmpty()) {
+        QFile file(dump);
+        if (!file.open(QIODevice::WriteOnly) || file.write(simulator.flash()) != simulator.flash().size()) {
+            err << "Unable to write " << dump << "\n";
+            return EXIT_FAILED;
+        }
+    }
+
+    return simulator.errorString().isEmpty() ? EXIT_OK : EXIT_FAILED;
+}
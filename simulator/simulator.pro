@@ -0,0 +1,22 @@
+# A pretend board running the Screamer bootloader, on a pseudo-terminal, for
+# driving the programmer end to end without hardware. Unix only.
+# Build: qmake && make, then ./screamer-sim and program the port it prints.
+
+QT += core
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = screamer-sim
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    ../bootsimulator.cpp
+
+HEADERS += \
+    ../bootsimulator.h
+
+include(../core.pri)
@@ -0,0 +1,315 @@
+#include "telemetry.h"
+
+#include <QtCore/qmath.h>
+#include <string.h>
+
+#define TELEMETRY_MAX_CHANNELS 16
+#define TELEMETRY_MAX_LINE 1024
+#define TELEMETRY_RAW_CAPACITY 262144
+#define TELEMETRY_LEVELS 3
+#define TELEMETRY_LEVEL_CAPACITY 65536
+#define TELEMETRY_FACTOR 16
+
+static inline bool isSeparator(char c)
+{
+    return c == ',' || c == ' ' || c == ';' || c == '\t' || c == '\r';
+}
+
+Telemetry::Channel::Channel() :
+    raw(TELEMETRY_RAW_CAPACITY),
+    count(0),
+    levels(TELEMETRY_LEVELS)
+{
+    for (int i = 0; i < levels.size(); ++i)
+        levels[i].buckets.setCapacity(TELEMETRY_LEVEL_CAPACITY);
+}
+
+void Telemetry::Channel::append(float value)
+{
+    raw.append(value);
+    ++count;
+
+    // Fold the sample up the pyramid. Each level finishes a bucket once it
+    // has TELEMETRY_FACTOR children and hands that bucket to the next.
+    float lo = value;
+    float hi = value;
+    for (int i = 0; i < levels.size(); ++i) {
+        Level &level = levels[i];
+        if (level.pending == 0) {
+            level.accumulator.min = lo;
+            level.accumulator.max = hi;
+        } else {
+            if (lo < level.accumulator.min) level.accumulator.min = lo;
+            if (hi > level.accumulator.max) level.accumulator.max = hi;
+        }
+
+        if (++level.pending < TELEMETRY_FACTOR) return;
+
+        level.buckets.append(level.accumulator);
+        ++level.completed;
+        level.pending = 0;
+        lo = level.accumulator.min;
+        hi = level.accumulator.max;
+    }
+}
+
+Telemetry::Telemetry(QObject *parent) :
+    QObject(parent),
+    m_enabled(false),
+    m_samples(0)
+{
+}
+
+Telemetry::~Telemetry()
+{
+    qDeleteAll(m_channels);
+}
+
+void Telemetry::feed(const QByteArray &data)
+{
+    feed(data.constData(), data.size());
+}
+
+void Telemetry::feed(const char *data, int length)
+{
+    if (!m_enabled || length <= 0) return;
+
+    const qint64 samples = m_samples;
+    const int channels = m_channels.size();
+
+    const char *p = data;
+    const char *end = data + length;
+    while (p < end) {
+        const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!newline) {
+            const int room = TELEMETRY_MAX_LINE - m_line.size();
+            m_line.append(p, qMin(int(end - p), room));
+            break;
+        }
+
+        if (m_line.isEmpty()) {
+            parseLine(p, newline);
+        } else {
+            const int room = TELEMETRY_MAX_LINE - m_line.size();
+            m_line.append(p, qMin(int(newline - p), room));
+            parseLine(m_line.constData(), m_line.constData() + m_line.size());
+            m_line.resize(0);
+        }
+        p = newline + 1;
+    }
+
+    if (m_channels.size() != channels)
+        emit channelCountChanged();
+    if (m_samples != samples)
+        emit samplesChanged();
+}
+
+void Telemetry::parseLine(const char *begin, const char *end)
+{
+    double values[TELEMETRY_MAX_CHANNELS];
+    bool valid[TELEMETRY_MAX_CHANNELS];
+    int fields = 0;
+    bool any = false;
+
+    const char *p = begin;
+    while (p < end && fields < TELEMETRY_MAX_CHANNELS) {
+        while (p < end && isSeparator(*p)) ++p;
+        if (p == end) break;
+
+        const char *token = p;
+        while (p < end && !isSeparator(*p)) ++p;
+
+        const char *equals = static_cast<const char *>(memchr(token, '=', p - token));
+        if (equals) token = equals + 1;
+
+        valid[fields] = parseNumber(token, p, &values[fields]);
+        any = any || valid[fields];
+        ++fields;
+    }
+
+    // Header and free text lines don't produce samples.
+    if (!any) return;
+
+    while (m_channels.size() < fields)
+        m_channels.append(new Channel());
+
+    for (int i = 0; i < fields; ++i) {
+        if (valid[i])
+            m_channels[i]->append(float(values[i]));
+    }
+    ++m_samples;
+}
+
+bool Telemetry::parseNumber(const char *p, const char *end, double *value)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    quint64 mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+    bool any = false;
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa*10 + (*p - '0');
+            if (mantissa) ++digits;
+        } else {
+            ++scale;
+        }
+        any = true;
+        ++p;
+    }
+
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa*10 + (*p - '0');
+                if (mantissa) ++digits;
+                --scale;
+            }
+            any = true;
+            ++p;
+        }
+    }
+
+    if (!any) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = (*p == '-');
+            ++p;
+        }
+        if (p == end) return false;
+
+        int exponent = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (exponent < 10000) exponent = exponent*10 + (*p - '0');
+            ++p;
+        }
+        scale += negativeExponent ? -exponent : exponent;
+    }
+
+    if (p != end) return false;
+
+    double result = double(mantissa);
+    if (scale != 0) {
+        const int magnitude = qAbs(scale);
+        const double power = (magnitude <= 22) ? powers[magnitude] : qPow(10.0, magnitude);
+        result = (scale < 0) ? result / power : result * power;
+    }
+
+    *value = negative ? -result : result;
+    return true;
+}
+
+QVariantList Telemetry::series(int channel, qint64 from, qint64 to, int maxPoints) const
+{
+    QVariantList result;
+    if (channel < 0 || channel >= m_channels.size() || maxPoints <= 0)
+        return result;
+
+    const Channel *ch = m_channels[channel];
+    from = qMax(from, qint64(0));
+    to = qMin(to, ch->count);
+    if (to <= from) return result;
+
+    // Pick the finest level that still holds the start of the range and
+    // doesn't need more than a few buckets per point.
+    int level = 0;
+    qint64 bucketSize = 1;
+    qint64 oldest = ch->count - ch->raw.size();
+    if (oldest > from || (to - from) > 4*qint64(maxPoints)) {
+        for (int i = 0; i < ch->levels.size(); ++i) {
+            const Level &lv = ch->levels[i];
+            level = i + 1;
+            bucketSize *= TELEMETRY_FACTOR;
+            oldest = (lv.completed - lv.buckets.size()) * bucketSize;
+            if (oldest <= from && (to - from) / bucketSize <= 4*qint64(maxPoints))
+                break;
+        }
+    }
+
+    qint64 first = qMax(from, oldest) / bucketSize;
+    qint64 last = (to + bucketSize - 1) / bucketSize;
+    if (level > 0) {
+        // The bucket still being filled isn't available yet.
+        const Level &lv = ch->levels[level - 1];
+        last = qMin(last, lv.completed);
+        oldest = lv.completed - lv.buckets.size();
+    }
+    if (last <= first) return result;
+
+    const qint64 group = (last - first + maxPoints - 1) / maxPoints;
+    result.reserve(int(3 * ((last - first) / group + 1)));
+
+    for (qint64 b = first; b < last; b += group) {
+        const qint64 groupEnd = qMin(b + group, last);
+        float lo = 0, hi = 0;
+        for (qint64 i = b; i < groupEnd; ++i) {
+            float bucketMin, bucketMax;
+            if (level == 0) {
+                bucketMin = bucketMax = ch->raw.at(int(i - oldest));
+            } else {
+                const Bucket &bucket = ch->levels[level - 1].buckets.at(int(i - oldest));
+                bucketMin = bucket.min;
+                bucketMax = bucket.max;
+            }
+            if (i == b || bucketMin < lo) lo = bucketMin;
+            if (i == b || bucketMax > hi) hi = bucketMax;
+        }
+        result << b * bucketSize << lo << hi;
+    }
+
+    return result;
+}
+
+qint64 Telemetry::channelSamples(int channel) const
+{
+    if (channel < 0 || channel >= m_channels.size()) return 0;
+    return m_channels[channel]->count;
+}
+
+void Telemetry::clear()
+{
+    qDeleteAll(m_channels);
+    m_channels.clear();
+    m_line.resize(0);
+    m_samples = 0;
+    emit channelCountChanged();
+    emit samplesChanged();
+}
+
+bool Telemetry::enabled() const
+{
+    return m_enabled;
+}
+
+void Telemetry::setEnabled(bool arg)
+{
+    if (m_enabled == arg) return;
+    m_enabled = arg;
+    m_line.resize(0);
+    emit enabledChanged(arg);
+}
+
+int Telemetry::channelCount() const
+{
+    return m_channels.size();
+}
+
+qint64 Telemetry::sampleCount() const
+{
+    return m_samples;
+}
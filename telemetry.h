@@ -0,0 +1,89 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <QObject>
+#include <QVector>
+#include <QVariantList>
+#include <QByteArray>
+#include "ringbuffer.h"
+
+/*
+ * Numeric telemetry pulled out of the terminal's incoming lines.
+ *
+ * Each line is split on commas, semicolons, tabs and spaces; every field is
+ * a channel, and "name=value" fields use the value. Numbers are parsed
+ * straight from the bytes, with no QString or split() in between.
+ *
+ * Each channel keeps the most recent raw samples plus a pyramid of min/max
+ * buckets (16, 256 and 4096 samples wide), all in fixed size ring buffers.
+ * series() answers from the finest level that covers the requested range
+ * within the point budget, so drawing hours of 1 kHz data costs the same as
+ * drawing a second of it.
+ */
+class Telemetry : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool enabled READ enabled WRITE setEnabled NOTIFY enabledChanged)
+    Q_PROPERTY(int channelCount READ channelCount NOTIFY channelCountChanged)
+    Q_PROPERTY(qint64 sampleCount READ sampleCount NOTIFY samplesChanged)
+
+public:
+    explicit Telemetry(QObject *parent = 0);
+    ~Telemetry();
+
+    void feed(const char *data, int length);
+    void feed(const QByteArray &data);
+
+    // Flat list of [x, min, max] triples covering samples [from, to) of the
+    // channel, at most maxPoints triples long. x is the sample index.
+    Q_INVOKABLE QVariantList series(int channel, qint64 from, qint64 to, int maxPoints) const;
+    Q_INVOKABLE qint64 channelSamples(int channel) const;
+    Q_INVOKABLE void clear();
+
+    bool enabled() const;
+    void setEnabled(bool arg);
+
+    int channelCount() const;
+    qint64 sampleCount() const;
+
+    static bool parseNumber(const char *begin, const char *end, double *value);
+
+signals:
+    void enabledChanged(bool arg);
+    void channelCountChanged();
+    void samplesChanged();
+
+private:
+    struct Bucket {
+        Bucket() : min(0), max(0) {}
+        float min;
+        float max;
+    };
+
+    struct Level {
+        Level() : completed(0), pending(0) {}
+        RingBuffer<Bucket> buckets;
+        qint64 completed;  // Buckets finished since the start
+        Bucket accumulator;
+        int pending;       // Samples or child buckets in the accumulator
+    };
+
+    struct Channel {
+        Channel();
+        void append(float value);
+
+        RingBuffer<float> raw;
+        qint64 count;
+        QVector<Level> levels;
+    };
+
+    void parseLine(const char *begin, const char *end);
+
+    bool m_enabled;
+    QVector<Channel *> m_channels;
+    QByteArray m_line;
+    qint64 m_samples;
+};
+
+#endif // TELEMETRY_H
@@ -3,19 +3,41 @@
 #include <QThread>
 #include <QKeyEvent>
 #include <QDebug>
+#include <QDateTime>
 #include "util.h"
 
 Terminal::Terminal(QObject *parent) :
     QObject(parent),
     m_port(0),
     m_active(false),
-    m_settings(0)
+    m_settings(0),
+    m_triggers(new TriggerEngine(this)),
+    m_decoder(0),
+    m_frames(new FrameModel(1000, this)),
+    m_chunkTimestamp(0),
+    m_telemetry(new Telemetry(this)),
+    m_transmit(new TransmitQueue(this)),
+    m_script(new TestScript(this)),
+    m_scrollback(new ScrollbackIndex(this))
 {
+    m_script->setTransmit(m_transmit);
+
+    m_formatted.reserve(4096);
+    // Reserved, so clearing it between reads keeps the room.
+    m_frameText.reserve(4096);
+
     m_timer.setInterval(50);
     m_timer.setSingleShot(false);
     m_timer.start();
     connect(&m_timer, &QTimer::timeout, this, &Terminal::updateInput);
 
+    connect(&m_sink, &CaptureSink::error, this, &Terminal::sinkError);
+
+}
+
+Terminal::~Terminal()
+{
+    delete m_decoder;
 }
 
 QSerialPort *Terminal::port() const
@@ -29,6 +51,7 @@ void Terminal::setPort(QSerialPort *arg)
 
     if (m_port && m_port->isOpen()) m_port->close();
     m_port = arg;
+    attachPort();
 
     emit portChanged(arg);
 }
@@ -54,11 +77,14 @@ void Terminal::setActive(bool arg)
         }
 
     } else { // Turning off
+        m_script->stop();
+        m_transmit->cancel();
         if (m_port) {
             m_port->close();
         }
         m_port = 0;
     }
+    attachPort();
 }
 
 QString Terminal::text() const
@@ -70,6 +96,8 @@ void Terminal::setText(QString arg)
 {
     if (m_text == arg) return;
     m_text = arg;
+    if (m_text.isEmpty())
+        m_formatter.reset();
     emit textChanged();
 }
 
@@ -82,8 +110,17 @@ void Terminal::sendText(QString text)
         return;
     }
 
-    m_port->write(text.toLocal8Bit());
-    m_port->write("\n");
+    m_transmit->enqueueLine(text.toLocal8Bit());
+}
+
+bool Terminal::sendFile(QUrl file)
+{
+    if (!m_port || !m_port->isOpen()) {
+        qWarning() << "Terminal: Active Port is not open.";
+        return false;
+    }
+
+    return m_transmit->enqueueFile(file.isLocalFile() ? file.toLocalFile() : file.path());
 }
 
 Settings *Terminal::settings() const
@@ -91,13 +128,127 @@ Settings *Terminal::settings() const
     return m_settings;
 }
 
+TriggerEngine *Terminal::triggers() const
+{
+    return m_triggers;
+}
+
+FrameModel *Terminal::frames() const
+{
+    return m_frames;
+}
+
+Telemetry *Terminal::telemetry() const
+{
+    return m_telemetry;
+}
+
+TransmitQueue *Terminal::transmit() const
+{
+    return m_transmit;
+}
+
+TestScript *Terminal::script() const
+{
+    return m_script;
+}
+
+ScrollbackIndex *Terminal::scrollback() const
+{
+    return m_scrollback;
+}
+
+void Terminal::attachPort()
+{
+    // Read as soon as data arrives rather than on the next poll, so script
+    // response times aren't rounded up to the timer interval.
+    disconnect(m_readyRead);
+    if (m_port)
+        m_readyRead = connect(m_port, &QSerialPort::readyRead, this, &Terminal::updateInput);
+    m_transmit->setDevice(m_port);
+}
+
+// Appends value in decimal, by way of the stack rather than a temporary
+// QByteArray.
+static void appendNumber(QByteArray *out, int value)
+{
+    char digits[12];
+    char *p = digits + sizeof(digits);
+    unsigned int n = value < 0 ? 0u - unsigned(value) : unsigned(value);
+    do {
+        *--p = char('0' + n % 10);
+        n /= 10;
+    } while (n);
+    if (value < 0) *--p = '-';
+    out->append(p, int(digits + sizeof(digits) - p));
+}
+
+void Terminal::frameDecoded(const char *data, int length)
+{
+    m_frames->append(data, length, m_chunkTimestamp);
+
+    m_frameText.append("frame ");
+    appendNumber(&m_frameText, m_frames->total() - 1);
+    m_frameText.append(" [");
+    appendNumber(&m_frameText, length);
+    m_frameText.append("]:");
+    for (int i = 0; i < length; ++i) {
+        m_frameText.append(' ');
+        m_frameText.append(HexFormatter::hexDigits(data[i]), 2);
+    }
+    m_frameText.append('\n');
+}
+
+void Terminal::changeFraming()
+{
+    delete m_decoder;
+    m_decoder = 0;
+
+    if (!m_settings) return;
+
+    m_decoder = FrameDecoder::create((FrameDecoder::Type)m_settings->framing());
+    if (m_decoder)
+        m_decoder->setListener(this);
+}
+
 void Terminal::updateInput()
 {
     if (!m_port || !m_port->isOpen() || !m_active) return;
 
     if (!m_settings->programmerActive() && m_port->bytesAvailable() > 0) {
-        // TODO: Do all the fancy hex, dec, stuff.
-        m_text.append(m_port->readAll());
+        QByteArray data = m_port->readAll();
+        m_settings->capture()->rx(data);
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        m_triggers->feed(data, now);
+        m_script->feed(data);
+
+        if (m_decoder) {
+            // Framed: the display and the capture sink get one line per frame.
+            m_chunkTimestamp = now;
+            m_frameText.resize(0);
+            m_decoder->decode(data.constData(), data.size());
+            m_frames->commit();
+            if (!m_frameText.isEmpty()) {
+                // A copy of its own for the sink's thread, so m_frameText
+                // isn't left shared and keeps its buffer for the next read.
+                m_sink.write(QByteArray(m_frameText.constData(), m_frameText.size()), now);
+                m_text.append(QString::fromLatin1(m_frameText));
+                m_scrollback->append(m_frameText);
+            }
+        } else {
+            m_sink.write(data, now);
+            m_telemetry->feed(data);
+
+            if (m_settings->terminalCharacters() == Settings::Ascii) {
+                m_text.append(data);
+                m_scrollback->append(data);
+            } else {
+                m_formatted.resize(0);
+                m_formatter.format(data, &m_formatted);
+                m_text.append(QString::fromLatin1(m_formatted));
+                m_scrollback->append(m_formatted);
+            }
+        }
 
         if (m_text.length() > 2000)
             m_text.remove(0, m_text.length()-2000);
@@ -125,6 +276,8 @@ void Terminal::changePort()
     else
         m_port = new QSerialPort(m_settings->portName());
 
+    attachPort();
+
     if (m_port->error() != QSerialPort::NoError) {
         qDebug() << "Error Changing Port:" << m_port->error();
     } else {
@@ -145,6 +298,7 @@ void Terminal::updatePort()
     m_port->setStopBits(m_settings->stopBits());
     m_port->setParity(m_settings->parity());
     m_port->setRequestToSend(true);
+    m_settings->capture()->rts(true);
 }
 
 bool Terminal::openPort()
@@ -164,6 +318,81 @@ bool Terminal::openPort()
     return true;
 }
 
+void Terminal::changeDisplay()
+{
+    if (!m_settings) return;
+
+    // Don't let the new mode continue a half filled row.
+    m_formatted.resize(0);
+    m_formatter.finishRow(&m_formatted);
+    if (!m_formatted.isEmpty()) {
+        m_text.append(QString::fromLatin1(m_formatted));
+        emit textChanged();
+    }
+
+    switch (m_settings->terminalCharacters()) {
+    case Settings::Hex:
+        m_formatter.setMode(HexFormatter::Hex);
+        break;
+    case Settings::Dec:
+        m_formatter.setMode(HexFormatter::Dec);
+        break;
+    default:
+        break;
+    }
+}
+
+void Terminal::updateSink()
+{
+    if (!m_settings || !m_settings->terminalLogEnabled()) {
+        m_sink.stop();
+        return;
+    }
+
+    QUrl directory = m_settings->terminalLogDirectory();
+
+    CaptureSink::Config config;
+    config.directory = directory.isLocalFile() ? directory.toLocalFile() : directory.path();
+    config.baseName = m_settings->portName().isEmpty() ? QString("terminal") : m_settings->portName();
+    config.mode = m_settings->terminalLogTimestamps() ? CaptureSink::Timestamped : CaptureSink::Raw;
+    config.compress = m_settings->terminalLogCompress();
+    config.maxFileSize = qint64(m_settings->terminalLogMaxSize()) * 1024 * 1024;
+    config.rotateInterval = m_settings->terminalLogRotateMinutes() * 60;
+
+    if (m_sink.isRunning())
+        m_sink.setConfig(config);
+    else
+        m_sink.start(config);
+}
+
+void Terminal::sinkError(QString message)
+{
+    qWarning() << "Terminal capture:" << message;
+    if (m_settings) {
+        m_settings->writeLogLn("Terminal capture: " + message, Log::Error);
+        // The sink has stopped; don't leave it showing as logging.
+        m_settings->setTerminalLogEnabled(false);
+    }
+}
+
+void Terminal::updateTransmit()
+{
+    if (!m_settings) {
+        m_transmit->setCapture(0);
+        return;
+    }
+
+    switch (m_settings->lineEnding()) {
+    case Settings::CR: m_transmit->setLineEnding("\r"); break;
+    case Settings::CRLF: m_transmit->setLineEnding("\r\n"); break;
+    case Settings::NoLineEnding: m_transmit->setLineEnding(QByteArray()); break;
+    default: m_transmit->setLineEnding("\n"); break;
+    }
+    m_transmit->setCharDelay(m_settings->charDelay());
+    m_transmit->setLineDelay(m_settings->lineDelay());
+    m_transmit->setCapture(m_settings->capture());
+}
+
 void Terminal::setsettings(Settings *arg)
 {
     if (m_settings == arg) return;
@@ -175,6 +404,21 @@ void Terminal::setsettings(Settings *arg)
         disconnect(m_settings, &Settings::dataBitsChanged, this, &Terminal::updatePort);
         disconnect(m_settings, &Settings::stopBitsChanged, this, &Terminal::updatePort);
         disconnect(m_settings, &Settings::parityChanged, this, &Terminal::updatePort);
+
+        disconnect(m_settings, &Settings::terminalCharactersChanged, this, &Terminal::changeDisplay);
+        disconnect(m_settings, &Settings::framingChanged, this, &Terminal::changeFraming);
+
+        disconnect(m_settings, &Settings::portNameChanged, this, &Terminal::updateSink);
+        disconnect(m_settings, &Settings::terminalLogEnabledChanged, this, &Terminal::updateSink);
+        disconnect(m_settings, &Settings::terminalLogDirectoryChanged, this, &Terminal::updateSink);
+        disconnect(m_settings, &Settings::terminalLogTimestampsChanged, this, &Terminal::updateSink);
+        disconnect(m_settings, &Settings::terminalLogCompressChanged, this, &Terminal::updateSink);
+        disconnect(m_settings, &Settings::terminalLogMaxSizeChanged, this, &Terminal::updateSink);
+        disconnect(m_settings, &Settings::terminalLogRotateMinutesChanged, this, &Terminal::updateSink);
+
+        disconnect(m_settings, &Settings::lineEndingChanged, this, &Terminal::updateTransmit);
+        disconnect(m_settings, &Settings::charDelayChanged, this, &Terminal::updateTransmit);
+        disconnect(m_settings, &Settings::lineDelayChanged, this, &Terminal::updateTransmit);
     }
 
     m_settings = arg;
@@ -186,9 +430,28 @@ void Terminal::setsettings(Settings *arg)
         connect(m_settings, &Settings::dataBitsChanged, this, &Terminal::updatePort);
         connect(m_settings, &Settings::stopBitsChanged, this, &Terminal::updatePort);
         connect(m_settings, &Settings::parityChanged, this, &Terminal::updatePort);
+
+        connect(m_settings, &Settings::terminalCharactersChanged, this, &Terminal::changeDisplay);
+        connect(m_settings, &Settings::framingChanged, this, &Terminal::changeFraming);
+
+        connect(m_settings, &Settings::portNameChanged, this, &Terminal::updateSink);
+        connect(m_settings, &Settings::terminalLogEnabledChanged, this, &Terminal::updateSink);
+        connect(m_settings, &Settings::terminalLogDirectoryChanged, this, &Terminal::updateSink);
+        connect(m_settings, &Settings::terminalLogTimestampsChanged, this, &Terminal::updateSink);
+        connect(m_settings, &Settings::terminalLogCompressChanged, this, &Terminal::updateSink);
+        connect(m_settings, &Settings::terminalLogMaxSizeChanged, this, &Terminal::updateSink);
+        connect(m_settings, &Settings::terminalLogRotateMinutesChanged, this, &Terminal::updateSink);
+
+        connect(m_settings, &Settings::lineEndingChanged, this, &Terminal::updateTransmit);
+        connect(m_settings, &Settings::charDelayChanged, this, &Terminal::updateTransmit);
+        connect(m_settings, &Settings::lineDelayChanged, this, &Terminal::updateTransmit);
     }
 
     changePort();
+    changeDisplay();
+    changeFraming();
+    updateSink();
+    updateTransmit();
 
     emit settingsChanged(arg);
 }
@@ -5,8 +5,17 @@
 #include <QTimer>
 #include <QSerialPort>
 #include "settings.h"
+#include "hexformatter.h"
+#include "capturesink.h"
+#include "triggerengine.h"
+#include "framedecoder.h"
+#include "framemodel.h"
+#include "telemetry.h"
+#include "transmitqueue.h"
+#include "testscript.h"
+#include "scrollbackindex.h"
 
-class Terminal : public QObject
+class Terminal : public QObject, public FrameDecoder::Listener
 {
     Q_OBJECT
 
@@ -14,8 +23,15 @@ class Terminal : public QObject
     Q_PROPERTY(bool active READ active WRITE setActive NOTIFY activeChanged)
     Q_PROPERTY(QString text READ text WRITE setText NOTIFY textChanged)
     Q_PROPERTY(Settings *settings READ settings WRITE setsettings NOTIFY settingsChanged)
+    Q_PROPERTY(TriggerEngine *triggers READ triggers CONSTANT)
+    Q_PROPERTY(FrameModel *frames READ frames CONSTANT)
+    Q_PROPERTY(Telemetry *telemetry READ telemetry CONSTANT)
+    Q_PROPERTY(TransmitQueue *transmit READ transmit CONSTANT)
+    Q_PROPERTY(TestScript *script READ script CONSTANT)
+    Q_PROPERTY(ScrollbackIndex *scrollback READ scrollback CONSTANT)
 public:
     explicit Terminal(QObject *parent = 0);
+    ~Terminal();
     
     QSerialPort * port() const;
     void setPort(QSerialPort * arg);
@@ -26,11 +42,22 @@ public:
     QString text() const;
     void setText(QString arg);
 
+    // Both queue the data and return immediately; see transmit() for progress.
     Q_INVOKABLE void sendText(QString text);
+    Q_INVOKABLE bool sendFile(QUrl file);
 
     Settings *settings() const;
     void setsettings(Settings *arg);
 
+    TriggerEngine *triggers() const;
+    FrameModel *frames() const;
+    Telemetry *telemetry() const;
+    TransmitQueue *transmit() const;
+    TestScript *script() const;
+    ScrollbackIndex *scrollback() const;
+
+    void frameDecoded(const char *data, int length);
+
 signals:
     void portChanged(QSerialPort * arg);
     void activeChanged(bool arg);
@@ -42,14 +69,38 @@ public slots:
     void changePort();
     void updatePort();
     bool openPort();
+    void changeDisplay();
+    void updateSink();
+    void sinkError(QString message);
+    void changeFraming();
+    void updateTransmit();
 
 private:
+    void attachPort();
+
     QTimer m_timer;
     
     QSerialPort *m_port;
     bool m_active;
     QString m_text;
     Settings *m_settings;
+
+    HexFormatter m_formatter;
+    QByteArray m_formatted;
+
+    CaptureSink m_sink;
+    TriggerEngine *m_triggers;
+
+    FrameDecoder *m_decoder;
+    FrameModel *m_frames;
+    QByteArray m_frameText;
+    qint64 m_chunkTimestamp;
+
+    Telemetry *m_telemetry;
+    TransmitQueue *m_transmit;
+    TestScript *m_script;
+    ScrollbackIndex *m_scrollback;
+    QMetaObject::Connection m_readyRead;
 };
 
 #endif // TERMINAL_H
@@ -0,0 +1,698 @@
+#include "testscript.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QDebug>
+#include <ctype.h>
+#include "transmitqueue.h"
+
+// Received bytes held for matching while an expect is waiting.
+#define SCRIPT_MAX_BUFFER 65536
+// Steps run back to back without waiting or consuming input before a script
+// is taken to be stuck in a goto loop.
+#define SCRIPT_MAX_JUMPS 10000
+
+static const char *s_stepNames[] = { "send", "write", "expect", "delay", "label", "goto", "pass", "fail" };
+
+// Splits a script line into tokens. Quoted strings and /regex/ tokens keep
+// their delimiters so the caller can tell them apart from bare words.
+static QStringList tokenize(const QString &line, bool *ok)
+{
+    QStringList tokens;
+    *ok = true;
+
+    int i = 0;
+    const int n = line.size();
+    while (i < n) {
+        while (i < n && line.at(i).isSpace()) ++i;
+        if (i == n || line.at(i) == '#') break;
+
+        const int start = i;
+        const QChar quote = line.at(i);
+        if (quote == '"' || quote == '/') {
+            ++i;
+            while (i < n && line.at(i) != quote) {
+                if (line.at(i) == '\\') ++i;
+                ++i;
+            }
+            if (i >= n) {
+                *ok = false;
+                return tokens;
+            }
+            ++i;
+        } else {
+            while (i < n && !line.at(i).isSpace()) ++i;
+        }
+        tokens << line.mid(start, i - start);
+    }
+    return tokens;
+}
+
+static bool isQuoted(const QString &token)
+{
+    return token.size() >= 2 && token.startsWith('"') && token.endsWith('"');
+}
+
+static bool isRegex(const QString &token)
+{
+    return token.size() >= 2 && token.startsWith('/') && token.endsWith('/');
+}
+
+TestScript::TestScript(QObject *parent) :
+    QObject(parent),
+    m_defaultTimeout(1000),
+    m_parseLine(0),
+    m_transmit(0),
+    m_stepStart(0),
+    m_running(false),
+    m_passed(false),
+    m_step(-1)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &TestScript::timeout);
+    m_clock.start();
+}
+
+void TestScript::setTransmit(TransmitQueue *transmit)
+{
+    m_transmit = transmit;
+}
+
+bool TestScript::load(QUrl file)
+{
+    QFile f(file.isLocalFile() ? file.toLocalFile() : file.path());
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        setError(QString("Unable to open script %1: %2").arg(f.fileName()).arg(f.errorString()));
+        return false;
+    }
+
+    QTextStream stream(&f);
+    return parse(stream.readAll());
+}
+
+bool TestScript::parse(QString source)
+{
+    stop();
+    clear();
+
+    const QStringList lines = source.split('\n');
+    for (int i = 0; i < lines.size(); ++i) {
+        m_parseLine = i + 1;
+        if (!parseLine(lines.at(i), i + 1)) {
+            m_parseLine = 0;
+            m_steps.clear();
+            emit stepsChanged();
+            return false;
+        }
+    }
+    m_parseLine = 0;
+
+    // Every jump has to land somewhere.
+    for (int i = 0; i < m_steps.size(); ++i) {
+        const Step &step = m_steps.at(i);
+        QStringList targets;
+        if (!step.target.isEmpty()) targets << step.target;
+        for (int j = 0; j < step.alternatives.size(); ++j) {
+            if (!step.alternatives.at(j).target.isEmpty())
+                targets << step.alternatives.at(j).target;
+        }
+        for (int j = 0; j < targets.size(); ++j) {
+            if (step.type != Fail && resolve(targets.at(j)) < 0) {
+                setError(QString("Line %1: unknown label \"%2\"").arg(step.line).arg(targets.at(j)));
+                m_steps.clear();
+                emit stepsChanged();
+                return false;
+            }
+        }
+    }
+
+    setError(QString());
+    return true;
+}
+
+bool TestScript::parseLine(const QString &line, int number)
+{
+    const QString trimmed = line.trimmed();
+    if (trimmed.isEmpty() || trimmed.startsWith('#')) return true;
+
+    const int space = trimmed.indexOf(QRegularExpression("\\s"));
+    const QString keyword = (space < 0 ? trimmed : trimmed.left(space)).toLower();
+    const QString rest = space < 0 ? QString() : trimmed.mid(space + 1).trimmed();
+
+    bool ok = true;
+    const QStringList args = tokenize(rest, &ok);
+    if (!ok) {
+        setError(QString("Line %1: unterminated string").arg(number));
+        return false;
+    }
+
+    if (keyword == "send" || keyword == "write") {
+        // Unquoted text runs to the end of the line, spaces included.
+        QString text = rest;
+        if (isQuoted(rest)) {
+            if (args.size() != 1) {
+                setError(QString("Line %1: unexpected text after string").arg(number));
+                return false;
+            }
+            text = rest.mid(1, rest.size() - 2);
+        }
+        if (keyword == "send") send(text);
+        else write(text);
+        return true;
+    }
+
+    if (keyword == "expect") {
+        Step step;
+        step.type = Expect;
+        step.timeout = m_defaultTimeout;
+        step.text = trimmed;
+
+        int i = 0;
+        while (i < args.size()) {
+            QString pattern = args.at(i++);
+            const bool regex = isRegex(pattern);
+            if (regex || isQuoted(pattern))
+                pattern = pattern.mid(1, pattern.size() - 2);
+
+            QString target;
+            if (i + 1 < args.size() && args.at(i) == "goto") {
+                target = args.at(i + 1);
+                i += 2;
+            }
+            if (!addAlternative(&step, pattern, regex, target)) {
+                setError(QString("Line %1: %2").arg(number).arg(m_errorString));
+                return false;
+            }
+
+            if (i < args.size() && args.at(i) == "or") {
+                ++i;
+                continue;
+            }
+            break;
+        }
+
+        while (i < args.size()) {
+            if (args.at(i) == "timeout" && i + 1 < args.size()) {
+                step.timeout = args.at(i + 1).toInt(&ok);
+                if (!ok) break;
+                i += 2;
+            } else if (args.at(i) == "else" && i + 1 < args.size()) {
+                step.target = args.at(i + 1);
+                i += 2;
+            } else {
+                ok = false;
+                break;
+            }
+        }
+        if (!ok || step.alternatives.isEmpty()) {
+            setError(QString("Line %1: expected expect PATTERN [goto LABEL] [or ...] [timeout MS] [else LABEL]").arg(number));
+            return false;
+        }
+
+        addStep(step);
+        return true;
+    }
+
+    if (keyword == "delay" || keyword == "timeout") {
+        const int msecs = args.size() == 1 ? args.at(0).toInt(&ok) : -1;
+        if (!ok || msecs < 0) {
+            setError(QString("Line %1: %2 needs a time in milliseconds").arg(number).arg(keyword));
+            return false;
+        }
+        if (keyword == "delay") delay(msecs);
+        else setDefaultTimeout(msecs);
+        return true;
+    }
+
+    if ((keyword == "label" || keyword == "goto") && args.size() == 1) {
+        if (keyword == "label") label(args.at(0));
+        else jump(args.at(0));
+        return true;
+    }
+
+    if (keyword == "pass" && args.isEmpty()) {
+        pass();
+        return true;
+    }
+
+    if (keyword == "fail" && args.size() <= 1) {
+        QString message = args.isEmpty() ? QString() : args.at(0);
+        if (isQuoted(message))
+            message = message.mid(1, message.size() - 2);
+        fail(message);
+        return true;
+    }
+
+    setError(QString("Line %1: unable to parse \"%2\"").arg(number).arg(trimmed));
+    return false;
+}
+
+void TestScript::clear()
+{
+    stop();
+    m_steps.clear();
+    m_results.clear();
+    m_defaultTimeout = 1000;
+    emit stepsChanged();
+    emit resultsChanged();
+}
+
+void TestScript::addStep(const Step &step)
+{
+    m_steps.append(step);
+    m_steps.last().line = m_parseLine;
+    emit stepsChanged();
+}
+
+bool TestScript::addAlternative(Step *step, const QString &pattern, bool regex, const QString &target)
+{
+    Alternative alternative;
+    alternative.regex = regex;
+    alternative.target = target;
+    if (regex) {
+        alternative.expression = QRegularExpression(pattern);
+        if (!alternative.expression.isValid()) {
+            m_errorString = QString("bad regular expression /%1/: %2").arg(pattern)
+                    .arg(alternative.expression.errorString());
+            return false;
+        }
+    } else {
+        alternative.literal = unescape(pattern);
+        if (alternative.literal.isEmpty()) {
+            m_errorString = "empty pattern";
+            return false;
+        }
+    }
+    step->alternatives.append(alternative);
+    return true;
+}
+
+void TestScript::send(QString text)
+{
+    Step step;
+    step.type = Send;
+    step.data = unescape(text);
+    step.text = "send " + text;
+    addStep(step);
+}
+
+void TestScript::write(QString data)
+{
+    Step step;
+    step.type = Write;
+    step.data = unescape(data);
+    step.text = "write " + data;
+    addStep(step);
+}
+
+void TestScript::expect(QString pattern, int timeout, QString onTimeout)
+{
+    Step step;
+    step.type = Expect;
+    step.timeout = timeout < 0 ? m_defaultTimeout : timeout;
+    step.target = onTimeout;
+    step.text = "expect \"" + pattern + "\"";
+    if (!addAlternative(&step, pattern, false, QString())) {
+        setError(m_errorString);
+        return;
+    }
+    addStep(step);
+}
+
+void TestScript::expectRegex(QString pattern, int timeout, QString onTimeout)
+{
+    Step step;
+    step.type = Expect;
+    step.timeout = timeout < 0 ? m_defaultTimeout : timeout;
+    step.target = onTimeout;
+    step.text = "expect /" + pattern + "/";
+    if (!addAlternative(&step, pattern, true, QString())) {
+        setError(m_errorString);
+        return;
+    }
+    addStep(step);
+}
+
+bool TestScript::branch(QString pattern, QString label, bool regex)
+{
+    if (m_steps.isEmpty() || m_steps.last().type != Expect) {
+        setError("branch() must follow an expect");
+        return false;
+    }
+    if (!addAlternative(&m_steps.last(), pattern, regex, label)) {
+        setError(m_errorString);
+        return false;
+    }
+    m_steps.last().text += QString(regex ? " or /%1/ goto %2" : " or \"%1\" goto %2").arg(pattern).arg(label);
+    return true;
+}
+
+void TestScript::delay(int msecs)
+{
+    Step step;
+    step.type = Delay;
+    step.timeout = qMax(0, msecs);
+    step.text = QString("delay %1").arg(step.timeout);
+    addStep(step);
+}
+
+void TestScript::label(QString name)
+{
+    Step step;
+    step.type = Label;
+    step.target = name;
+    step.text = "label " + name;
+    addStep(step);
+}
+
+void TestScript::jump(QString label)
+{
+    Step step;
+    step.type = Goto;
+    step.target = label;
+    step.text = "goto " + label;
+    addStep(step);
+}
+
+void TestScript::pass()
+{
+    Step step;
+    step.type = Pass;
+    step.text = "pass";
+    addStep(step);
+}
+
+void TestScript::fail(QString message)
+{
+    Step step;
+    step.type = Fail;
+    step.target = message;
+    step.text = message.isEmpty() ? QString("fail") : "fail " + message;
+    addStep(step);
+}
+
+void TestScript::setDefaultTimeout(int msecs)
+{
+    m_defaultTimeout = qMax(0, msecs);
+}
+
+bool TestScript::start()
+{
+    if (m_running) return false;
+    if (m_steps.isEmpty()) {
+        setError("Nothing to run");
+        return false;
+    }
+    if (!m_transmit) {
+        setError("No port to run the script on");
+        return false;
+    }
+
+    m_results.clear();
+    m_buffer.clear();
+    m_passed = false;
+    m_running = true;
+    emit resultsChanged();
+    emit runningChanged(m_running);
+
+    run(0);
+    return true;
+}
+
+void TestScript::stop()
+{
+    if (!m_running) return;
+    finish(false, "Stopped");
+}
+
+void TestScript::feed(const QByteArray &data)
+{
+    feed(data.constData(), data.size());
+}
+
+void TestScript::feed(const char *data, int length)
+{
+    if (!m_running || length <= 0) return;
+
+    m_buffer.append(data, length);
+    if (m_buffer.size() > SCRIPT_MAX_BUFFER)
+        m_buffer.remove(0, m_buffer.size() - SCRIPT_MAX_BUFFER);
+
+    int next;
+    if (m_step >= 0 && m_step < m_steps.size() && m_steps.at(m_step).type == Expect && match(&next))
+        run(next);
+}
+
+// Runs steps from index until one has to wait or the script ends.
+void TestScript::run(int index)
+{
+    int jumps = 0;
+    while (m_running) {
+        if (index < 0) {
+            finish(false, "Jump to an unknown label");
+            return;
+        }
+        if (index >= m_steps.size()) {
+            finish(true);
+            return;
+        }
+        if (++jumps > SCRIPT_MAX_JUMPS) {
+            finish(false, "Script looped without waiting");
+            return;
+        }
+
+        m_step = index;
+        emit currentStepChanged(m_step);
+        m_stepStart = m_clock.nsecsElapsed();
+
+        const Step &step = m_steps.at(index);
+        switch (step.type) {
+        case Label:
+            ++index;
+            break;
+
+        case Goto:
+            index = resolve(step.target);
+            break;
+
+        case Send:
+        case Write:
+            if (step.type == Send) m_transmit->enqueueLine(step.data);
+            else m_transmit->enqueue(step.data);
+            record(true, QString());
+            ++index;
+            break;
+
+        case Delay:
+            m_timer.start(step.timeout);
+            return;
+
+        case Expect:
+            m_timer.start(step.timeout);
+            // The response may already be sitting in the buffer. A match
+            // used up input, so the loop isn't stuck.
+            if (!match(&index))
+                return;
+            jumps = 0;
+            break;
+
+        case Pass:
+            record(true, QString());
+            finish(true);
+            return;
+
+        case Fail:
+            record(false, step.target);
+            finish(false, step.target);
+            return;
+        }
+    }
+}
+
+// On a match, consumes the buffer up to its end and sets next to the step
+// to go on with. Doesn't run anything itself, so a goto back to the same
+// expect is a turn of run()'s loop rather than a deeper call.
+bool TestScript::match(int *next)
+{
+    const Step &step = m_steps.at(m_step);
+
+    // Earliest match in the buffer wins.
+    int best = -1;
+    int bestStart = m_buffer.size();
+    int bestEnd = 0;
+    QString latin;
+    for (int i = 0; i < step.alternatives.size(); ++i) {
+        const Alternative &alternative = step.alternatives.at(i);
+        int start, end;
+        if (alternative.regex) {
+            if (latin.isNull()) latin = QString::fromLatin1(m_buffer);
+            // An empty match consumes nothing, so it can't count as progress.
+            start = -1;
+            QRegularExpressionMatchIterator it = alternative.expression.globalMatch(latin);
+            while (it.hasNext()) {
+                const QRegularExpressionMatch m = it.next();
+                if (m.capturedLength() > 0) {
+                    start = m.capturedStart();
+                    end = m.capturedEnd();
+                    break;
+                }
+            }
+            if (start < 0) continue;
+        } else {
+            start = m_buffer.indexOf(alternative.literal);
+            if (start < 0) continue;
+            end = start + alternative.literal.size();
+        }
+        if (start < bestStart) {
+            best = i;
+            bestStart = start;
+            bestEnd = end;
+        }
+    }
+    if (best < 0) return false;
+
+    m_timer.stop();
+    const QString matched = QString::fromLatin1(m_buffer.mid(bestStart, bestEnd - bestStart));
+    m_buffer.remove(0, bestEnd);
+    record(true, matched);
+
+    const QString &target = step.alternatives.at(best).target;
+    *next = target.isEmpty() ? m_step + 1 : resolve(target);
+    return true;
+}
+
+void TestScript::timeout()
+{
+    if (!m_running) return;
+
+    const Step &step = m_steps.at(m_step);
+    if (step.type == Delay) {
+        record(true, QString());
+        run(m_step + 1);
+        return;
+    }
+
+    record(false, "Timed out");
+    if (step.target.isEmpty())
+        finish(false, QString("Timed out at step %1 (%2)").arg(m_step).arg(step.text));
+    else
+        run(resolve(step.target));
+}
+
+int TestScript::resolve(const QString &label)
+{
+    for (int i = 0; i < m_steps.size(); ++i) {
+        if (m_steps.at(i).type == Label && m_steps.at(i).target == label)
+            return i;
+    }
+    return -1;
+}
+
+void TestScript::record(bool ok, const QString &detail)
+{
+    const Step &step = m_steps.at(m_step);
+
+    QVariantMap result;
+    result["step"] = m_step;
+    result["line"] = step.line;
+    result["type"] = QString(s_stepNames[step.type]);
+    result["text"] = step.text;
+    result["passed"] = ok;
+    result["latency"] = (m_clock.nsecsElapsed() - m_stepStart) / 1000000.0;
+    result["detail"] = detail;
+
+    m_results.append(result);
+    emit stepFinished(result);
+    emit resultsChanged();
+}
+
+void TestScript::finish(bool passed, const QString &message)
+{
+    m_timer.stop();
+    m_running = false;
+    m_passed = passed;
+    m_buffer.clear();
+    if (!message.isEmpty())
+        setError(message);
+    else if (passed)
+        setError(QString());
+
+    emit runningChanged(m_running);
+    emit finished(m_passed);
+}
+
+void TestScript::setError(const QString &message)
+{
+    if (m_errorString == message) return;
+    m_errorString = message;
+    if (!message.isEmpty())
+        qWarning() << "TestScript:" << message;
+    emit errorStringChanged(message);
+}
+
+QByteArray TestScript::unescape(const QString &text)
+{
+    const QByteArray in = text.toLocal8Bit();
+    QByteArray out;
+    out.reserve(in.size());
+
+    for (int i = 0; i < in.size(); ++i) {
+        char c = in.at(i);
+        if (c != '\\' || i + 1 == in.size()) {
+            out.append(c);
+            continue;
+        }
+
+        c = in.at(++i);
+        switch (c) {
+        case 'r': out.append('\r'); break;
+        case 'n': out.append('\n'); break;
+        case 't': out.append('\t'); break;
+        case '0': out.append('\0'); break;
+        case 'x': {
+            // Exactly two hex digits, which may end the string. toInt()
+            // alone would also take a sign or a space.
+            const QByteArray digits = in.mid(i + 1, 2);
+            if (digits.size() == 2 && isxdigit((unsigned char)digits[0]) && isxdigit((unsigned char)digits[1])) {
+                out.append(char(digits.toInt(0, 16)));
+                i += 2;
+            } else {
+                out.append("\\x");
+            }
+            break;
+        }
+        default: out.append(c); break;
+        }
+    }
+    return out;
+}
+
+bool TestScript::running() const
+{
+    return m_running;
+}
+
+bool TestScript::passed() const
+{
+    return m_passed;
+}
+
+int TestScript::stepCount() const
+{
+    return m_steps.size();
+}
+
+int TestScript::currentStep() const
+{
+    return m_step;
+}
+
+QVariantList TestScript::results() const
+{
+    return m_results;
+}
+
+QString TestScript::errorString() const
+{
+    return m_errorString;
+}
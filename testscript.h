@@ -0,0 +1,157 @@
+#ifndef TESTSCRIPT_H
+#define TESTSCRIPT_H
+
+#include <QObject>
+#include <QVector>
+#include <QVariantList>
+#include <QStringList>
+#include <QByteArray>
+#include <QRegularExpression>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QUrl>
+
+class TransmitQueue;
+
+/*
+ * Expect style test sequences over a serial link.
+ *
+ * A script is a list of steps, built either from QML with the invokable
+ * methods or parsed from a small line based format:
+ *
+ *   # Comments start with a hash.
+ *   timeout 500                 Default expect timeout (ms) for later steps
+ *   send AT+VER                 Queue a line, with the terminal's line ending
+ *   write "\x02PING\x03"        Queue bytes as is; \r \n \t \\ \" \xHH escapes
+ *   expect "OK"                 Wait for a literal...
+ *   expect /VER=\d+/            ...or a regular expression
+ *   expect "PASS" goto done or "FAIL" goto bad timeout 2000 else bad
+ *   delay 100
+ *   goto done
+ *   label bad
+ *   fail "self test failed"
+ *   label done
+ *   pass
+ *
+ * An expect that times out without an else label fails the script. Running
+ * off the end passes it. A regular expression only matches when it matches
+ * at least one byte, so /x*/ waits for an x.
+ *
+ * Nothing blocks: sends go through the TransmitQueue, received bytes arrive
+ * through feed(), and waits are timers, so any number of scripts can run on
+ * one thread. Each step's latency is measured from the moment the step
+ * started; for an expect following a send, that is the response time.
+ */
+class TestScript : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(bool passed READ passed NOTIFY finished)
+    Q_PROPERTY(int stepCount READ stepCount NOTIFY stepsChanged)
+    Q_PROPERTY(int currentStep READ currentStep NOTIFY currentStepChanged)
+    Q_PROPERTY(QVariantList results READ results NOTIFY resultsChanged)
+    Q_PROPERTY(QString errorString READ errorString NOTIFY errorStringChanged)
+
+public:
+    explicit TestScript(QObject *parent = 0);
+
+    void setTransmit(TransmitQueue *transmit);
+
+    Q_INVOKABLE bool load(QUrl file);
+    Q_INVOKABLE bool parse(QString source);
+    Q_INVOKABLE void clear();
+
+    Q_INVOKABLE void send(QString text);
+    Q_INVOKABLE void write(QString data);
+    // timeout < 0 uses the default. An empty onTimeout fails the script.
+    Q_INVOKABLE void expect(QString pattern, int timeout = -1, QString onTimeout = QString());
+    Q_INVOKABLE void expectRegex(QString pattern, int timeout = -1, QString onTimeout = QString());
+    // Adds an alternative to the last expect step, jumping to label on match.
+    Q_INVOKABLE bool branch(QString pattern, QString label, bool regex = false);
+    Q_INVOKABLE void delay(int msecs);
+    Q_INVOKABLE void label(QString name);
+    Q_INVOKABLE void jump(QString label);
+    Q_INVOKABLE void pass();
+    Q_INVOKABLE void fail(QString message = QString());
+    Q_INVOKABLE void setDefaultTimeout(int msecs);
+
+    Q_INVOKABLE bool start();
+    Q_INVOKABLE void stop();
+
+    void feed(const char *data, int length);
+    void feed(const QByteArray &data);
+
+    bool running() const;
+    bool passed() const;
+    int stepCount() const;
+    int currentStep() const;
+    QVariantList results() const;
+    QString errorString() const;
+
+signals:
+    void runningChanged(bool arg);
+    void stepsChanged();
+    void currentStepChanged(int arg);
+    void resultsChanged();
+    void errorStringChanged(QString arg);
+
+    void stepFinished(QVariantMap result);
+    void finished(bool passed);
+
+private slots:
+    void timeout();
+
+private:
+    enum StepType { Send, Write, Expect, Delay, Label, Goto, Pass, Fail };
+
+    struct Alternative {
+        Alternative() : regex(false) {}
+        bool regex;
+        QByteArray literal;
+        QRegularExpression expression;
+        QString target;
+    };
+
+    struct Step {
+        Step() : type(Pass), timeout(0), line(0) {}
+        StepType type;
+        QByteArray data;
+        QString text;
+        int timeout;
+        QString target;
+        QVector<Alternative> alternatives;
+        int line;
+    };
+
+    void addStep(const Step &step);
+    bool addAlternative(Step *step, const QString &pattern, bool regex, const QString &target);
+    bool parseLine(const QString &line, int number);
+    void setError(const QString &message);
+
+    void run(int index);
+    bool match(int *next);
+    int resolve(const QString &label);
+    void record(bool ok, const QString &detail);
+    void finish(bool passed, const QString &message = QString());
+
+    static QByteArray unescape(const QString &text);
+
+    QVector<Step> m_steps;
+    int m_defaultTimeout;
+    int m_parseLine;
+
+    TransmitQueue *m_transmit;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_stepStart;
+
+    bool m_running;
+    bool m_passed;
+    int m_step;
+    QByteArray m_buffer;
+    QVariantList m_results;
+    QString m_errorString;
+};
+
+#endif // TESTSCRIPT_H
@@ -0,0 +1,196 @@
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QHash>
+#include <QStringList>
+#include <QThread>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonArray>
+
+// Room made up front, so the first events don't wait on reallocations.
+#define INITIAL_EVENTS 4096
+// Instants have no length.
+#define INSTANT -1
+
+struct TraceEvent
+{
+    const char *name;
+    const char *argName;
+    qint64 arg;
+    qint64 start;
+    qint64 duration;
+    int thread;
+};
+
+QAtomicInt Trace::s_enabled;
+
+static QMutex s_mutex;
+static QElapsedTimer s_clock;
+static QVector<TraceEvent> s_events;
+static int s_dropped = 0;
+// Threads are numbered in the order they first record, from 1.
+static QHash<Qt::HANDLE, int> s_threads;
+static QStringList s_threadNames;
+
+// Must hold s_mutex.
+static int threadIndex()
+{
+    const Qt::HANDLE handle = QThread::currentThreadId();
+    QHash<Qt::HANDLE, int>::const_iterator it = s_threads.constFind(handle);
+    if (it != s_threads.constEnd()) return it.value();
+
+    const int index = s_threads.size() + 1;
+    s_threads.insert(handle, index);
+
+    QThread *thread = QThread::currentThread();
+    QString name = thread->objectName();
+    if (name.isEmpty()) {
+        QCoreApplication *app = QCoreApplication::instance();
+        name = app && app->thread() == thread ? QString("main") : QString("Thread %1").arg(index);
+    }
+    s_threadNames << name;
+    return index;
+}
+
+static void record(const char *name, qint64 start, qint64 duration, const char *argName, qint64 arg)
+{
+    QMutexLocker lock(&s_mutex);
+    if (s_events.size() >= Trace::MaxEvents) {
+        ++s_dropped;
+        return;
+    }
+    TraceEvent event;
+    event.name = name;
+    event.argName = argName;
+    event.arg = arg;
+    event.start = start;
+    event.duration = duration;
+    event.thread = threadIndex();
+    s_events.append(event);
+}
+
+// Chrome traces count in us; three decimals keep the ns.
+static void appendMicros(QByteArray *out, qint64 nsecs)
+{
+    out->append(QByteArray::number(nsecs / 1000));
+    out->append('.');
+    out->append(QByteArray::number(nsecs % 1000).rightJustified(3, '0'));
+}
+
+void Trace::setEnabled(bool enabled)
+{
+    QMutexLocker lock(&s_mutex);
+    if (enabled && !s_clock.isValid()) {
+        s_clock.start();
+        s_events.reserve(INITIAL_EVENTS);
+    }
+    // Released after the clock starts, so now() never reads it unstarted.
+    s_enabled.storeRelease(enabled ? 1 : 0);
+}
+
+qint64 Trace::elapsed()
+{
+    return s_clock.nsecsElapsed();
+}
+
+void Trace::complete(const char *name, qint64 start, qint64 end, const char *argName, qint64 arg)
+{
+    if (start < 0 || !isEnabled()) return;
+    record(name, start, qMax(Q_INT64_C(0), end - start), argName, arg);
+}
+
+void Trace::instant(const char *name, const char *argName, qint64 arg)
+{
+    if (!isEnabled()) return;
+    record(name, elapsed(), INSTANT, argName, arg);
+}
+
+void Trace::clear()
+{
+    QMutexLocker lock(&s_mutex);
+    s_events.clear();
+    s_dropped = 0;
+}
+
+int Trace::count()
+{
+    QMutexLocker lock(&s_mutex);
+    return s_events.size();
+}
+
+QByteArray Trace::toJson()
+{
+    QVector<TraceEvent> events;
+    QStringList threadNames;
+    int dropped;
+    {
+        QMutexLocker lock(&s_mutex);
+        events = s_events;
+        threadNames = s_threadNames;
+        dropped = s_dropped;
+    }
+
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray json;
+    json.reserve(256 + events.size() * 96);
+    json.append("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedEvents\":");
+    json.append(QByteArray::number(dropped));
+    json.append("},\"traceEvents\":[\n");
+
+    for (int i = 0; i < threadNames.size(); ++i) {
+        // Quoted and escaped by way of a one element array.
+        QJsonArray quoted;
+        quoted.append(threadNames[i]);
+        const QByteArray name = QJsonDocument(quoted).toJson(QJsonDocument::Compact);
+        json.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid);
+        json.append(",\"tid\":" + QByteArray::number(i + 1));
+        json.append(",\"args\":{\"name\":" + name.mid(1, name.size() - 2) + "}},\n");
+    }
+
+    for (int i = 0; i < events.size(); ++i) {
+        const TraceEvent &event = events[i];
+        json.append("{\"name\":\"");
+        json.append(event.name);
+        if (event.duration == INSTANT) {
+            json.append("\",\"ph\":\"i\",\"s\":\"t\",\"ts\":");
+            appendMicros(&json, event.start);
+        } else {
+            json.append("\",\"ph\":\"X\",\"ts\":");
+            appendMicros(&json, event.start);
+            json.append(",\"dur\":");
+            appendMicros(&json, event.duration);
+        }
+        json.append(",\"pid\":" + pid);
+        json.append(",\"tid\":" + QByteArray::number(event.thread));
+        if (event.argName) {
+            json.append(",\"args\":{\"");
+            json.append(event.argName);
+            json.append("\":" + QByteArray::number(event.arg) + "}");
+        }
+        json.append(i + 1 < events.size() ? "},\n" : "}\n");
+    }
+    // No trailing comma after the thread names when there are no events.
+    if (events.isEmpty() && !threadNames.isEmpty()) {
+        json.chop(2);
+        json.append('\n');
+    }
+
+    json.append("]}\n");
+    return json;
+}
+
+bool Trace::save(const QString &path, QString *error)
+{
+    QSaveFile file(path);
+    const QByteArray json = toJson();
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.commit()) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
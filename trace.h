@@ -0,0 +1,82 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QString>
+
+/*
+ * An optional timeline of where a programming job spends its time, for
+ * viewing in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Tracing is off by default, and while it's off a Scope costs one atomic
+ * load and records nothing. While it's on, each finished scope is kept with
+ * its start and length in ns and the thread it ran on, in one buffer for the
+ * whole process (the first MaxEvents of them). toJson() writes them out in
+ * the Chrome trace event format.
+ *
+ *   bool Bootloader::send(...)
+ *   {
+ *       TRACE_SCOPE("Bootloader::send");
+ *       ...
+ */
+class Trace
+{
+public:
+    enum { MaxEvents = 1000000 };
+
+    static void setEnabled(bool enabled);
+    static bool isEnabled() { return s_enabled.loadAcquire() != 0; }
+
+    // ns on the trace's clock, which starts when tracing is first enabled,
+    // or -1 while tracing is off.
+    static qint64 now();
+
+    // A span that doesn't fit a scope, from two now()s. Ignored if start is
+    // -1. argName, if given, is shown with arg.
+    static void complete(const char *name, qint64 start, qint64 end,
+                         const char *argName = 0, qint64 arg = 0);
+    // A point in time.
+    static void instant(const char *name, const char *argName = 0, qint64 arg = 0);
+
+    static void clear();
+    static int count();
+    static QByteArray toJson();
+    static bool save(const QString &path, QString *error = 0);
+
+    // Records from construction to destruction. The names aren't copied, so
+    // they must outlive the trace; string literals are the usual.
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name) : m_name(name), m_argName(0), m_arg(0), m_start(now()) {}
+        ~Scope() { if (m_start >= 0) complete(m_name, m_start, now(), m_argName, m_arg); }
+
+        void setArg(const char *name, qint64 value) { m_argName = name; m_arg = value; }
+
+    private:
+        Q_DISABLE_COPY(Scope)
+
+        const char *m_name;
+        const char *m_argName;
+        qint64 m_arg;
+        qint64 m_start;
+    };
+
+private:
+    static qint64 elapsed();
+
+    static QAtomicInt s_enabled;
+};
+
+inline qint64 Trace::now()
+{
+    return isEnabled() ? elapsed() : -1;
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Traces the rest of the enclosing block.
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif // TRACE_H
@@ -0,0 +1,277 @@
+#include "transmitqueue.h"
+
+#include <QFile>
+#include <QSerialPort>
+#include <QDebug>
+#include <string.h>
+#include "serialcapture.h"
+
+// Bytes read from a file at a time, and the most we leave in the device's
+// own write buffer before waiting for bytesWritten().
+#define TRANSMIT_CHUNK_SIZE 4096
+#define TRANSMIT_HIGH_WATER 16384
+
+TransmitQueue::TransmitQueue(QObject *parent) :
+    QObject(parent),
+    m_device(0),
+    m_capture(0),
+    m_lineEnding("\n"),
+    m_lineTerminator('\n'),
+    m_charDelay(0),
+    m_lineDelay(0),
+    m_chunkPos(0),
+    m_sent(0),
+    m_total(0),
+    m_busy(false)
+{
+    m_pace.setSingleShot(true);
+    connect(&m_pace, &QTimer::timeout, this, &TransmitQueue::pump);
+}
+
+TransmitQueue::~TransmitQueue()
+{
+    while (!m_items.isEmpty())
+        delete m_items.dequeue().file;
+}
+
+void TransmitQueue::setDevice(QIODevice *device)
+{
+    if (m_device == device) return;
+
+    if (m_device)
+        disconnect(m_device, 0, this, 0);
+    m_device = device;
+    if (m_device)
+        connect(m_device, &QIODevice::bytesWritten, this, &TransmitQueue::pump);
+
+    pump();
+}
+
+void TransmitQueue::setCapture(SerialCapture *capture)
+{
+    m_capture = capture;
+}
+
+void TransmitQueue::setLineEnding(const QByteArray &lineEnding)
+{
+    m_lineEnding = lineEnding;
+    m_lineTerminator = lineEnding.isEmpty() ? '\n' : lineEnding.at(lineEnding.size() - 1);
+}
+
+void TransmitQueue::setCharDelay(int msecs)
+{
+    m_charDelay = qMax(0, msecs);
+}
+
+void TransmitQueue::setLineDelay(int msecs)
+{
+    m_lineDelay = qMax(0, msecs);
+}
+
+void TransmitQueue::enqueue(const QByteArray &data)
+{
+    if (data.isEmpty()) return;
+
+    // Coalesce with a text item that hasn't been started yet.
+    if (!m_items.isEmpty() && !m_items.last().file)
+        m_items.last().data.append(data);
+    else {
+        Item item;
+        item.data = data;
+        m_items.enqueue(item);
+    }
+
+    m_total += data.size();
+    emit progressChanged();
+
+    if (!m_pace.isActive())
+        pump();
+}
+
+void TransmitQueue::enqueueLine(const QByteArray &line)
+{
+    enqueue(line + m_lineEnding);
+}
+
+bool TransmitQueue::enqueueFile(const QString &path)
+{
+    QFile *file = new QFile(path);
+    if (!file->open(QIODevice::ReadOnly)) {
+        emit error(QString("Unable to open %1: %2").arg(path).arg(file->errorString()));
+        delete file;
+        return false;
+    }
+
+    Item item;
+    item.file = file;
+    m_items.enqueue(item);
+
+    m_total += file->size();
+    emit progressChanged();
+
+    if (!m_pace.isActive())
+        pump();
+    return true;
+}
+
+void TransmitQueue::cancel()
+{
+    m_pace.stop();
+    while (!m_items.isEmpty())
+        delete m_items.dequeue().file;
+    m_chunk.clear();
+    m_chunkPos = 0;
+
+    QSerialPort *port = qobject_cast<QSerialPort *>(m_device);
+    if (port && port->isOpen())
+        port->clear(QSerialPort::Output);
+
+    setCurrentFile(QString());
+    finish();
+}
+
+// Makes sure m_chunk has unsent bytes, pulling from the head of the queue.
+// Returns false once everything queued has been handed to the device.
+bool TransmitQueue::fill()
+{
+    while (m_chunkPos >= m_chunk.size()) {
+        m_chunk.resize(0);
+        m_chunkPos = 0;
+
+        if (m_items.isEmpty()) return false;
+
+        Item &item = m_items.head();
+        if (!item.file) {
+            m_chunk = item.data;
+            m_items.dequeue();
+            continue;
+        }
+
+        if (item.file->pos() == 0)
+            setCurrentFile(item.file->fileName());
+
+        m_chunk.resize(TRANSMIT_CHUNK_SIZE);
+        qint64 n = item.file->read(m_chunk.data(), TRANSMIT_CHUNK_SIZE);
+        if (n <= 0) {
+            if (n < 0)
+                emit error(QString("Error reading %1: %2").arg(item.file->fileName())
+                           .arg(item.file->errorString()));
+            // Keep the total honest if the file was shorter than it claimed.
+            m_total -= item.file->size() - item.file->pos();
+            delete m_items.dequeue().file;
+            m_chunk.resize(0);
+            setCurrentFile(QString());
+            continue;
+        }
+        m_chunk.resize(int(n));
+    }
+    return true;
+}
+
+void TransmitQueue::pump()
+{
+    if (m_pace.isActive()) return;
+
+    if (!m_device || !m_device->isOpen()) {
+        if (!m_items.isEmpty() || m_chunkPos < m_chunk.size()) {
+            if (!m_busy) {
+                m_busy = true;
+                emit busyChanged(m_busy);
+            }
+        }
+        return;
+    }
+
+    const qint64 sent = m_sent;
+
+    while (m_device->bytesToWrite() < TRANSMIT_HIGH_WATER) {
+        if (!fill()) {
+            if (m_device->bytesToWrite() == 0)
+                finish();
+            break;
+        }
+
+        if (!m_busy) {
+            m_busy = true;
+            emit busyChanged(m_busy);
+        }
+
+        const char *data = m_chunk.constData() + m_chunkPos;
+        int length = m_chunk.size() - m_chunkPos;
+        if (m_charDelay > 0) {
+            length = 1;
+        } else if (m_lineDelay > 0) {
+            const char *end = static_cast<const char *>(memchr(data, m_lineTerminator, length));
+            if (end) length = int(end - data) + 1;
+        }
+
+        qint64 written = m_device->write(data, length);
+        if (written < 0) {
+            emit error(m_device->errorString());
+            cancel();
+            return;
+        }
+        if (m_capture)
+            m_capture->tx(data, int(written));
+        m_chunkPos += int(written);
+        m_sent += written;
+
+        if (written > 0 && m_lineDelay > 0 && data[written - 1] == m_lineTerminator) {
+            m_pace.start(m_lineDelay);
+            break;
+        }
+        if (m_charDelay > 0) {
+            m_pace.start(m_charDelay);
+            break;
+        }
+        if (written < length) break;
+    }
+
+    if (m_sent != sent)
+        emit progressChanged();
+}
+
+void TransmitQueue::setCurrentFile(const QString &file)
+{
+    if (m_currentFile == file) return;
+    m_currentFile = file;
+    emit currentFileChanged(file);
+}
+
+void TransmitQueue::finish()
+{
+    if (!m_busy) return;
+
+    m_busy = false;
+    m_sent = 0;
+    m_total = 0;
+    emit progressChanged();
+    emit busyChanged(m_busy);
+    emit finished();
+}
+
+bool TransmitQueue::busy() const
+{
+    return m_busy;
+}
+
+qint64 TransmitQueue::bytesSent() const
+{
+    return m_sent;
+}
+
+qint64 TransmitQueue::bytesTotal() const
+{
+    return m_total;
+}
+
+qreal TransmitQueue::progress() const
+{
+    if (m_total <= 0) return m_busy ? 0 : 1;
+    return qreal(m_sent) / qreal(m_total);
+}
+
+QString TransmitQueue::currentFile() const
+{
+    return m_currentFile;
+}
@@ -0,0 +1,102 @@
+#ifndef TRANSMITQUEUE_H
+#define TRANSMITQUEUE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QQueue>
+#include <QTimer>
+
+class QIODevice;
+class QFile;
+class SerialCapture;
+
+/*
+ * Outgoing data for the terminal's port.
+ *
+ * Text and files are queued and fed to the device from the event loop, so
+ * nothing here ever blocks. Consecutive text sends are coalesced into one
+ * buffer. Files are read a chunk at a time and only while the device has
+ * less than a high water mark of unwritten bytes; bytesWritten() pulls the
+ * next chunk, so a large file never sits in memory.
+ *
+ * With a character or line delay set, bytes are released one character or
+ * one line at a time from a timer instead.
+ */
+class TransmitQueue : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
+    Q_PROPERTY(qint64 bytesSent READ bytesSent NOTIFY progressChanged)
+    Q_PROPERTY(qint64 bytesTotal READ bytesTotal NOTIFY progressChanged)
+    Q_PROPERTY(qreal progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(QString currentFile READ currentFile NOTIFY currentFileChanged)
+
+public:
+    explicit TransmitQueue(QObject *parent = 0);
+    ~TransmitQueue();
+
+    // The device must live on this object's thread.
+    void setDevice(QIODevice *device);
+    void setCapture(SerialCapture *capture);
+
+    // lineEnding is appended to every enqueueLine(). The line delay applies
+    // after its last byte, or after '\n' when it is empty.
+    void setLineEnding(const QByteArray &lineEnding);
+    void setCharDelay(int msecs);
+    void setLineDelay(int msecs);
+
+    void enqueue(const QByteArray &data);
+    void enqueueLine(const QByteArray &line);
+    bool enqueueFile(const QString &path);
+
+    // Drops everything not yet handed to the device, including whatever the
+    // device itself still has buffered when it is a serial port.
+    Q_INVOKABLE void cancel();
+
+    bool busy() const;
+    qint64 bytesSent() const;
+    qint64 bytesTotal() const;
+    qreal progress() const;
+    QString currentFile() const;
+
+signals:
+    void busyChanged(bool arg);
+    void progressChanged();
+    void currentFileChanged(QString arg);
+    void finished();
+    void error(QString message);
+
+private slots:
+    void pump();
+
+private:
+    struct Item {
+        Item() : file(0) {}
+        QByteArray data;
+        QFile *file;
+    };
+
+    bool fill();
+    void setCurrentFile(const QString &file);
+    void finish();
+
+    QIODevice *m_device;
+    SerialCapture *m_capture;
+    QByteArray m_lineEnding;
+    char m_lineTerminator;
+    int m_charDelay;
+    int m_lineDelay;
+
+    QQueue<Item> m_items;
+    QByteArray m_chunk;
+    int m_chunkPos;
+    QTimer m_pace;
+    QString m_currentFile;
+
+    qint64 m_sent;
+    qint64 m_total;
+    bool m_busy;
+};
+
+#endif // TRANSMITQUEUE_H
@@ -0,0 +1,269 @@
+#include "triggerengine.h"
+
+#include <QVariantMap>
+#include <QDebug>
+#include <string.h>
+
+#define TRIGGER_MAX_LINE 4096
+#define TRIGGER_MAX_EVENTS 200
+
+TriggerEngine::TriggerEngine(QObject *parent) :
+    QObject(parent),
+    m_dirty(true),
+    m_state(0),
+    m_offset(0),
+    m_lineOffset(0),
+    m_eventCount(0)
+{
+}
+
+void TriggerEngine::addLiteral(QString name, QString pattern)
+{
+    if (pattern.isEmpty()) return;
+
+    Literal literal;
+    literal.name = name;
+    literal.bytes = pattern.toUtf8();
+    m_literals.append(literal);
+    m_dirty = true;
+    emit patternsChanged();
+}
+
+bool TriggerEngine::addRegex(QString name, QString pattern)
+{
+    Regex regex;
+    regex.name = name;
+    regex.expression = QRegularExpression(pattern);
+    if (!regex.expression.isValid()) {
+        qWarning() << "TriggerEngine: Invalid expression" << pattern << regex.expression.errorString();
+        return false;
+    }
+    regex.expression.optimize();
+
+    m_regexes.append(regex);
+    emit patternsChanged();
+    return true;
+}
+
+void TriggerEngine::removePattern(QString name)
+{
+    for (int i = m_literals.size() - 1; i >= 0; --i) {
+        if (m_literals[i].name == name) {
+            m_literals.remove(i);
+            m_dirty = true;
+        }
+    }
+    for (int i = m_regexes.size() - 1; i >= 0; --i) {
+        if (m_regexes[i].name == name)
+            m_regexes.remove(i);
+    }
+    emit patternsChanged();
+}
+
+void TriggerEngine::clearPatterns()
+{
+    m_literals.clear();
+    m_regexes.clear();
+    m_dirty = true;
+    emit patternsChanged();
+}
+
+void TriggerEngine::clearEvents()
+{
+    m_events.clear();
+    m_eventCount = 0;
+    emit eventsChanged();
+}
+
+void TriggerEngine::reset()
+{
+    m_state = 0;
+    m_offset = 0;
+    m_line.resize(0);
+    m_lineOffset = 0;
+}
+
+void TriggerEngine::build()
+{
+    const int count = m_literals.size();
+
+    // Trie, with -1 for missing edges.
+    m_delta = QVector<qint32>(256, -1);
+    m_ownLiteral = QVector<qint32>(1, -1);
+    m_literalNext = QVector<qint32>(count, -1);
+    int states = 1;
+
+    for (int i = 0; i < count; ++i) {
+        const QByteArray &bytes = m_literals[i].bytes;
+        int s = 0;
+        for (int j = 0; j < bytes.size(); ++j) {
+            const int edge = s*256 + (unsigned char)bytes[j];
+            if (m_delta[edge] < 0) {
+                m_delta[edge] = states;
+                m_delta.resize((states + 1) * 256);
+                qint32 *row = m_delta.data() + states*256;
+                for (int c = 0; c < 256; ++c) row[c] = -1;
+                m_ownLiteral.append(-1);
+                ++states;
+            }
+            s = m_delta[edge];
+        }
+        m_literalNext[i] = m_ownLiteral[s];
+        m_ownLiteral[s] = i;
+    }
+
+    // Breadth first, fill in the failure transitions so every state has all
+    // 256 edges and the hot loop never has to walk failure links.
+    QVector<qint32> fail(states, 0);
+    m_outputLink = QVector<qint32>(states, 0);
+    m_isOutput = QVector<quint8>(states, 0);
+
+    QVector<qint32> queue;
+    queue.reserve(states);
+
+    qint32 *delta = m_delta.data();
+    for (int c = 0; c < 256; ++c) {
+        if (delta[c] < 0) {
+            delta[c] = 0;
+        } else {
+            fail[delta[c]] = 0;
+            queue.append(delta[c]);
+        }
+    }
+
+    for (int head = 0; head < queue.size(); ++head) {
+        const int s = queue[head];
+        const int f = fail[s];
+
+        m_outputLink[s] = (m_ownLiteral[f] >= 0) ? f : m_outputLink[f];
+        m_isOutput[s] = (m_ownLiteral[s] >= 0 || m_outputLink[s] != 0);
+
+        qint32 *row = delta + s*256;
+        const qint32 *failRow = delta + f*256;
+        for (int c = 0; c < 256; ++c) {
+            if (row[c] < 0) {
+                row[c] = failRow[c];
+            } else {
+                fail[row[c]] = failRow[c];
+                queue.append(row[c]);
+            }
+        }
+    }
+
+    m_state = 0;
+    m_dirty = false;
+}
+
+void TriggerEngine::feed(const QByteArray &data, qint64 timestamp)
+{
+    feed(data.constData(), data.size(), timestamp);
+}
+
+void TriggerEngine::feed(const char *data, int length, qint64 timestamp)
+{
+    if (length <= 0) return;
+    if (m_dirty) build();
+
+    const int eventCount = m_eventCount;
+
+    if (!m_literals.isEmpty()) {
+        const qint32 *delta = m_delta.constData();
+        const quint8 *isOutput = m_isOutput.constData();
+        const unsigned char *src = reinterpret_cast<const unsigned char *>(data);
+        qint32 state = m_state;
+
+        for (int i = 0; i < length; ++i) {
+            state = delta[state*256 + src[i]];
+            if (!isOutput[state]) continue;
+
+            const qint64 end = m_offset + i + 1;
+            for (qint32 s = state; s != 0; s = m_outputLink[s]) {
+                for (qint32 l = m_ownLiteral[s]; l >= 0; l = m_literalNext[l]) {
+                    const Literal &literal = m_literals[l];
+                    report(literal.name, QString::fromUtf8(literal.bytes),
+                           end - literal.bytes.size(), timestamp);
+                }
+            }
+        }
+
+        m_state = state;
+    }
+
+    if (!m_regexes.isEmpty()) {
+        int start = 0;
+        while (start < length) {
+            const char *newline = static_cast<const char *>(memchr(data + start, '\n', length - start));
+            const int end = newline ? int(newline - data) : length;
+
+            // Overlong lines are truncated rather than growing without bound.
+            const int room = TRIGGER_MAX_LINE - m_line.size();
+            m_line.append(data + start, qMin(end - start, room));
+
+            if (!newline) break;
+
+            matchLine(timestamp);
+            m_line.resize(0);
+            m_lineOffset = m_offset + end + 1;
+            start = end + 1;
+        }
+    } else {
+        m_lineOffset = m_offset + length;
+    }
+
+    m_offset += length;
+
+    if (m_eventCount != eventCount)
+        emit eventsChanged();
+}
+
+void TriggerEngine::matchLine(qint64 timestamp)
+{
+    int length = m_line.size();
+    if (length > 0 && m_line[length - 1] == '\r') --length;
+
+    const QString line = QString::fromUtf8(m_line.constData(), length);
+    for (int i = 0; i < m_regexes.size(); ++i) {
+        QRegularExpressionMatchIterator it = m_regexes[i].expression.globalMatch(line);
+        while (it.hasNext()) {
+            QRegularExpressionMatch match = it.next();
+            const qint64 offset = m_lineOffset + line.left(match.capturedStart()).toUtf8().size();
+            report(m_regexes[i].name, match.captured(), offset, timestamp);
+        }
+    }
+}
+
+void TriggerEngine::report(const QString &name, const QString &match, qint64 offset, qint64 timestamp)
+{
+    QVariantMap event;
+    event["name"] = name;
+    event["match"] = match;
+    event["offset"] = offset;
+    event["timestamp"] = timestamp;
+
+    m_events.append(event);
+    if (m_events.size() > TRIGGER_MAX_EVENTS)
+        m_events.removeFirst();
+    ++m_eventCount;
+
+    emit triggered(name, match, offset, timestamp);
+}
+
+QStringList TriggerEngine::patterns() const
+{
+    QStringList result;
+    foreach (const Literal &literal, m_literals)
+        result << literal.name + ": " + QString::fromUtf8(literal.bytes);
+    foreach (const Regex &regex, m_regexes)
+        result << regex.name + ": /" + regex.expression.pattern() + "/";
+    return result;
+}
+
+QVariantList TriggerEngine::events() const
+{
+    return m_events;
+}
+
+int TriggerEngine::eventCount() const
+{
+    return m_eventCount;
+}
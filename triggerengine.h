@@ -0,0 +1,89 @@
+#ifndef TRIGGERENGINE_H
+#define TRIGGERENGINE_H
+
+#include <QObject>
+#include <QVector>
+#include <QVariantList>
+#include <QStringList>
+#include <QByteArray>
+#include <QRegularExpression>
+
+/*
+ * Watches a byte stream for any number of patterns.
+ *
+ * Literal patterns are compiled into a single Aho-Corasick automaton with a
+ * dense 256-way transition table, so every incoming byte costs one table
+ * lookup regardless of how many literals are registered. The automaton state
+ * carries over between feed() calls, so matches spanning two chunks are
+ * found. Regular expressions are evaluated once per completed line.
+ *
+ * Offsets are absolute byte positions in the stream since the last reset().
+ */
+class TriggerEngine : public QObject
+{
+    Q_OBJECT
+
+    Q_PROPERTY(QStringList patterns READ patterns NOTIFY patternsChanged)
+    Q_PROPERTY(QVariantList events READ events NOTIFY eventsChanged)
+    Q_PROPERTY(int eventCount READ eventCount NOTIFY eventsChanged)
+
+public:
+    explicit TriggerEngine(QObject *parent = 0);
+
+    Q_INVOKABLE void addLiteral(QString name, QString pattern);
+    Q_INVOKABLE bool addRegex(QString name, QString pattern);
+    Q_INVOKABLE void removePattern(QString name);
+    Q_INVOKABLE void clearPatterns();
+    Q_INVOKABLE void clearEvents();
+
+    // Forget the stream position and any partial match.
+    void reset();
+
+    void feed(const QByteArray &data, qint64 timestamp);
+    void feed(const char *data, int length, qint64 timestamp);
+
+    QStringList patterns() const;
+    QVariantList events() const;
+    int eventCount() const;
+
+signals:
+    void triggered(QString name, QString match, qint64 offset, qint64 timestamp);
+
+    void patternsChanged();
+    void eventsChanged();
+
+private:
+    struct Literal {
+        QString name;
+        QByteArray bytes;
+    };
+    struct Regex {
+        QString name;
+        QRegularExpression expression;
+    };
+
+    void build();
+    void matchLine(qint64 timestamp);
+    void report(const QString &name, const QString &match, qint64 offset, qint64 timestamp);
+
+    QVector<Literal> m_literals;
+    QVector<Regex> m_regexes;
+    bool m_dirty;
+
+    // Automaton: m_delta[state*256 + byte] is the next state.
+    QVector<qint32> m_delta;
+    QVector<quint8> m_isOutput;     // State ends at least one literal (directly or by suffix)
+    QVector<qint32> m_ownLiteral;   // Literal ending exactly at this state, or -1
+    QVector<qint32> m_outputLink;   // Next state down the suffix chain with an output, or 0
+    QVector<qint32> m_literalNext;  // Next literal with the same bytes, or -1
+    qint32 m_state;
+
+    qint64 m_offset;
+    QByteArray m_line;
+    qint64 m_lineOffset;
+
+    QVariantList m_events;
+    int m_eventCount;
+};
+
+#endif // TRIGGERENGINE_H
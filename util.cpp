@@ -1,5 +1,9 @@
 #include "util.h"
+#include "portmonitor.h"
+#include "bootloader.h"
+#include "trace.h"
 #include <QThread>
+#include <QElapsedTimer>
 #include <QVariant>
 #include <QDebug>
 #include <QtCore/QMetaObject>
@@ -10,112 +14,77 @@ Util::Util()
 }
 
 
-QString Util::int2hex(int i)
+// Routes what a reset does on the wire to the settings' capture and log.
+class ResetListener : public Bootloader::Listener
 {
-    QString result;
-    result.setNum(i, 16);
-    if (i<16)
-        result.prepend("0");
-
-    return result;
-}
-
-QString Util::char2hex(unsigned char i)
-{
-    QString result;
-    result.setNum(i, 16);
-    if (i<16)
-        result.prepend("0");
-
-    return result;
-}
-
-QString Util::byte2hex(QByteArray bytes)
-{
-    QString result;
-    foreach (char b, bytes)
-        result.append(" " + char2hex(b));
-
-    return result;
-}
+public:
+    ResetListener(Settings *settings, bool logTraffic) :
+        m_settings(settings), m_logTraffic(logTraffic) {}
+
+    void transmitted(const char *data, int length) { m_settings->capture()->tx(data, length); }
+    void received(const char *data, int length) { m_settings->capture()->rx(data, length); }
+
+    void lineChanged(Bootloader::Line line, bool set)
+    {
+        if (line == Bootloader::RequestToSend)
+            m_settings->capture()->rts(set);
+        else
+            m_settings->capture()->dtr(set);
+    }
 
-QString Util::byte2hex(QByteArray byte, int start, int length)
-{
-    QString result;
-    int top = start + length;
-    for (int i = start; i < top; ++i)
-        result.append(" " + int2hex(byte[i]));
+    void message(Bootloader::MessageLevel level, const QString &text)
+    {
+        qDebug() << "Reset:" << text;
+        if (level > Bootloader::DebugMessage || m_logTraffic)
+            m_settings->writeLogLn(text, (Log::Level)level);
+    }
 
-    return result;
-}
+private:
+    Settings *m_settings;
+    bool m_logTraffic;
+};
 
-QString Util::string2hex(QString s)
+bool Util::resetMicro(QSerialPort *port, Settings *settings, const QByteArray &expect, QByteArray *received)
 {
-    QString result;
-    for (int i = 0; i < s.length(); ++i)
-        result.append(" " + int2hex(s[i].unicode()));
-    return result;
+    FlashJob job;
+    job.resetType = (Bootloader::ResetType)settings->resetType();
+    job.resetProfile = settings->resetProfile(port->portName());
+    job.logTraffic = settings->logDownload();
+    return resetMicro(port, settings, job, expect, received);
 }
 
-QString Util::string2decimal(QString s)
+bool Util::resetMicro(QSerialPort *port, Settings *settings, const FlashJob &job,
+                      const QByteArray &expect, QByteArray *received)
 {
-    QString result;
-    for (int i = 0; i < s.length(); ++i) {
-        QString dec;
-        dec.setNum(s[i].unicode());
-        result.append(" " + dec);
-    }
-    return result;
-}
+    TRACE_SCOPE("Util::resetMicro");
+    ResetListener listener(settings, job.logTraffic);
+    qreal latency;
+    const bool found = Bootloader::reset(port, job.resetType, job.resetProfile,
+                                         expect, received, &listener, &latency);
+    if (latency >= 0)
+        settings->recordResetLatency(port->portName(), latency);
 
-void Util::resetMicro(QSerialPort *port, Settings *settings)
-{
-    switch(settings->resetType()) {
-    case Settings::RTS:
-        qDebug() << "Reset: RTS";
-        port->setRequestToSend(true);
-        QThread::msleep(10);
-        port->setRequestToSend(false);
-        if (settings->logDownload())
-            settings->writeLog("-- Reset RTS\n");
-        break;
-
-    case Settings::DTR:
-        qDebug() << "Reset: DTR";
-        port->setDataTerminalReady(true);
-        QThread::msleep(10);
-        port->setDataTerminalReady(false);
-        if (settings->logDownload())
-            settings->writeLog("-- Reset DTR\n");
-        break;
-    case Settings::Software:
-        qDebug() << "Reset: Software";
-        if (!port->isOpen()) {
-            qDebug() << "Port not open";
-            settings->writeLogLn("Port must be open for software reset");
-            return;
-        }
-        port->write("R");
-        port->flush();
-        QThread::msleep(200);
-        QByteArray response = port->readAll();
-        qDebug() << "Response:" << response;
-        if (settings->logDownload()) {
-            settings->writeLogLn(response);
-        }
-        break;
-    }
     qDebug() << "Reset complete";
-    QThread::msleep(10);
+    return found;
 }
 
 QList<QSerialPortInfo> Util::getAvailablePorts()
 {
-    return QSerialPortInfo::availablePorts();
+    PortMonitor *monitor = PortMonitor::instance();
+    QList<QSerialPortInfo> ports;
+    foreach (const QString &name, monitor->portNames()) {
+        QSerialPortInfo info = monitor->find(name);
+        if (!info.portName().isEmpty()) ports << info;
+    }
+    return ports;
 }
 
 QSerialPortInfo Util::findPort(QString name)
 {
+    QSerialPortInfo cached = PortMonitor::instance()->find(name);
+    if (!cached.portName().isEmpty()) return cached;
+
+    // Not seen by the monitor yet; it may have only just appeared.
     foreach (const QSerialPortInfo &info, QSerialPortInfo::availablePorts()) {
         if (name == info.portName()) return info;
     }
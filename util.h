@@ -42,7 +42,15 @@ public:
 
     static QString string2decimal(QString s);
 
-    static void resetMicro(QSerialPort *port, Settings *settings);
+    // Resets the board with the port's reset profile. Returns once expect (or
+    // the profile's own pattern when expect is empty) has been read back,
+    // or false if it never was. Whatever was read is appended to received.
+    static bool resetMicro(QSerialPort *port, Settings *settings,
+                           const QByteArray &expect = QByteArray(), QByteArray *received = 0);
+    // The same, with the reset type and profile taken from job rather than
+    // the settings, which are only used for the capture and log.
+    static bool resetMicro(QSerialPort *port, Settings *settings, const FlashJob &job,
+                           const QByteArray &expect = QByteArray(), QByteArray *received = 0);
 
     static QList<QSerialPortInfo> getAvailablePorts();
 
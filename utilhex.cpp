@@ -0,0 +1,65 @@
+// Util's hex and decimal formatting, apart from the rest of Util so it can
+// be linked without Settings, the serial port code and udev.
+
+#include "util.h"
+#include "hexformatter.h"
+
+QString Util::int2hex(int i)
+{
+    if (i >= 0 && i < 256)
+        return QString::fromLatin1(HexFormatter::hexDigits(i), 2);
+
+    QString result;
+    result.setNum(i, 16);
+    return result;
+}
+
+QString Util::char2hex(unsigned char i)
+{
+    return QString::fromLatin1(HexFormatter::hexDigits(i), 2);
+}
+
+QString Util::byte2hex(QByteArray bytes)
+{
+    return byte2hex(bytes, 0, bytes.length());
+}
+
+QString Util::byte2hex(QByteArray byte, int start, int length)
+{
+    QByteArray result(3*length, ' ');
+    char *dst = result.data();
+    const char *src = byte.constData() + start;
+    for (int i = 0; i < length; ++i) {
+        const char *digits = HexFormatter::hexDigits(src[i]);
+        dst[1] = digits[0];
+        dst[2] = digits[1];
+        dst += 3;
+    }
+    return QString::fromLatin1(result);
+}
+
+QString Util::string2hex(QString s)
+{
+    QString result;
+    for (int i = 0; i < s.length(); ++i)
+        result.append(" " + int2hex(s[i].unicode()));
+    return result;
+}
+
+QString Util::string2decimal(QString s)
+{
+    QByteArray result;
+    result.reserve(4*s.length());
+    for (int i = 0; i < s.length(); ++i) {
+        const ushort c = s[i].unicode();
+        result.append(' ');
+        if (c < 256) {
+            const char *digits = HexFormatter::decDigits(c);
+            int skip = (c < 10) ? 2 : (c < 100) ? 1 : 0;
+            result.append(digits + skip, 3 - skip);
+        } else {
+            result.append(QByteArray::number(c));
+        }
+    }
+    return QString::fromLatin1(result);
+}
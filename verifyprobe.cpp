@@ -0,0 +1,66 @@
+#include "verifyprobe.h"
+
+#include <QElapsedTimer>
+#include "settings.h"
+
+// Longest wait on the port between checks for abort(), ms.
+#define VERIFY_WAIT_STEP 50
+
+VerifyProbe::VerifyProbe(const QVariantMap &result, Settings *settings, const QByteArray &pattern, int timeout) :
+    m_result(result),
+    m_portName(result.value("portName").toString()),
+    m_baud(settings->baudTerminal()),
+    m_dataBits(settings->dataBits()),
+    m_parity(settings->parity()),
+    m_stopBits(settings->stopBits()),
+    m_pattern(pattern),
+    m_timeout(timeout),
+    m_abort(0)
+{
+}
+
+void VerifyProbe::abort()
+{
+    m_abort.storeRelease(1);
+}
+
+void VerifyProbe::run()
+{
+    QSerialPort port(m_portName);
+    if (!port.open(QIODevice::ReadWrite)) {
+        m_result["verified"] = false;
+        m_result["detail"] = "Verify: " + port.errorString();
+        return;
+    }
+    port.setBaudRate(m_baud);
+    port.setDataBits(m_dataBits);
+    port.setParity(m_parity);
+    port.setStopBits(m_stopBits);
+    port.setFlowControl(QSerialPort::NoFlowControl);
+
+    // The programmer has already reset the board; wait for the application
+    // to come up and say hello. No pattern means any output will do.
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray received;
+    bool verified = false;
+    while (!verified && timer.elapsed() < m_timeout && !m_abort.loadAcquire()) {
+        if (!port.waitForReadyRead(qBound(1, int(m_timeout - timer.elapsed()), VERIFY_WAIT_STEP)))
+            continue;
+        received.append(port.readAll());
+        verified = m_pattern.isEmpty() ? !received.isEmpty() : received.indexOf(m_pattern) >= 0;
+        if (received.size() > 4096)
+            received.remove(0, received.size() - qMax(m_pattern.size(), 1024));
+    }
+    port.close();
+
+    m_result["duration"] = m_result.value("duration").toLongLong() + timer.elapsed();
+    m_result["verified"] = verified;
+    if (m_abort.loadAcquire() && !verified) {
+        m_result["detail"] = QString("Verify: cancelled");
+    } else if (!verified) {
+        m_result["detail"] = received.isEmpty()
+                ? QString("Verify: no output from the board")
+                : QString("Verify: expected output not seen");
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef VERIFYPROBE_H
+#define VERIFYPROBE_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QVariantMap>
+#include <QByteArray>
+#include <QSerialPort>
+
+class Settings;
+
+/*
+ * Checks that a freshly flashed board runs its application.
+ *
+ * The bootloader can't read flash back, so instead the board's port is
+ * reopened at the terminal settings and the application must print pattern
+ * within timeout ms. No pattern means any output will do.
+ *
+ * Run on its own thread; read m_result once finished() arrives. It is the
+ * map passed in plus verified, detail (on failure) and the time spent added
+ * to duration (ms). abort() makes it give up within VERIFY_WAIT_STEP ms.
+ */
+class VerifyProbe : public QThread
+{
+public:
+    // The port is taken from result's portName.
+    VerifyProbe(const QVariantMap &result, Settings *settings, const QByteArray &pattern, int timeout);
+
+    QVariantMap m_result;
+
+    // Thread safe.
+    void abort();
+
+protected:
+    void run();
+
+private:
+    QString m_portName;
+    QSerialPort::BaudRate m_baud;
+    QSerialPort::DataBits m_dataBits;
+    QSerialPort::Parity m_parity;
+    QSerialPort::StopBits m_stopBits;
+    QByteArray m_pattern;
+    int m_timeout;
+    QAtomicInt m_abort;
+};
+
+#endif // VERIFYPROBE_H